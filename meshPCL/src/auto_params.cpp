@@ -0,0 +1,282 @@
+#include "auto_params.h"
+
+#include <pcl/console/print.h>
+#include <pcl/search/search.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <unordered_map>
+
+#include "parallel.h"
+#include "trace.h"
+
+typedef pcl::PointCloud<pcl::PointXYZ> CloudXYZ;
+
+// Points per tile of the statistics pass.
+static const std::size_t STATS_TILE = 65536;
+// Sample points per tile of the spacing queries.
+static const std::size_t QUERY_TILE = 1024;
+
+// Whether point i belongs to a sample of one in 'stride'. Picked by a hash
+// of the index, not every stride-th point: scanner files are written row by
+// row and a fixed stride aliases with the rows.
+static inline bool sampled(std::uint64_t i, std::uint64_t stride)
+{
+  i += 0x9E3779B97F4A7C15ULL;
+  i = (i ^ (i >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  i = (i ^ (i >> 27)) * 0x94D049BB133111EBULL;
+  return (i ^ (i >> 31)) % stride == 0;
+}
+
+// Bounding box, finite point count and sampled points of one tile.
+struct TileStats
+{
+  Eigen::Vector3d min, max;
+  std::size_t points;
+  CloudXYZ sample;
+
+  TileStats() : min(Eigen::Vector3d::Constant(std::numeric_limits<double>::max())),
+    max(Eigen::Vector3d::Constant(-std::numeric_limits<double>::max())), points(0) {}
+
+  void add(const double xyz[3], bool keep)
+  {
+    for(int k = 0; k < 3; ++k)
+    {
+      min[k] = std::min(min[k], xyz[k]);
+      max[k] = std::max(max[k], xyz[k]);
+    }
+    ++points;
+    if(keep)
+      sample.push_back(pcl::PointXYZ((float) xyz[0], (float) xyz[1], (float) xyz[2]));
+  }
+};
+
+// Median distance from each point of 'cloud' to its nearest other point,
+// over the non-zero ones; duplicates say nothing about the spacing.
+// 'seconds' receives the wall time of the queries.
+static double medianSpacing(const CloudXYZ::Ptr& cloud, double& seconds)
+{
+  pcl::search::Search<pcl::PointXYZ>::Ptr index = buildSearchIndex<pcl::PointXYZ>(cloud);
+  std::vector<float> spacing(cloud->size(), 0.0f);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  parallelFor(0, cloud->size(), QUERY_TILE, [&](std::size_t first, std::size_t last)
+  {
+    std::vector<int> neighbours(2);
+    std::vector<float> sqr_distances(2);
+    for(std::size_t i = first; i < last; ++i)
+    {
+      if(index->nearestKSearch(cloud->points[i], 2, neighbours, sqr_distances) == 2)
+        spacing[i] = std::sqrt(sqr_distances[1]);
+    }
+  });
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  spacing.erase(std::remove(spacing.begin(), spacing.end(), 0.0f), spacing.end());
+  if(spacing.empty())
+    return 0.0;
+  std::nth_element(spacing.begin(), spacing.begin() + spacing.size() / 2, spacing.end());
+  return spacing[spacing.size() / 2];
+}
+
+// Joins the tiles in order and derives everything else from the sample.
+static void finishStats(std::vector<TileStats>& tiles, CloudStats& stats)
+{
+  stats = CloudStats();
+  CloudXYZ::Ptr sample(new CloudXYZ);
+  Eigen::Vector3d min = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+  Eigen::Vector3d max = -min;
+  for(std::size_t t = 0; t < tiles.size(); ++t)
+  {
+    if(tiles[t].points == 0)
+      continue;
+    stats.points += tiles[t].points;
+    min = min.cwiseMin(tiles[t].min);
+    max = max.cwiseMax(tiles[t].max);
+    *sample += tiles[t].sample;
+  }
+  stats.samples = sample->size();
+  if(stats.samples < 2)
+    return;
+  stats.min = min;
+  stats.max = max;
+
+  // Spacing of the sample and of a quarter of it give the dimension.
+  double seconds = 0.0;
+  const double sample_spacing = medianSpacing(sample, seconds);
+  stats.query_seconds = seconds / stats.samples;
+  if(sample_spacing <= 0.0)
+    return;
+  if(stats.samples >= 64)
+  {
+    CloudXYZ::Ptr quarter(new CloudXYZ);
+    quarter->reserve(stats.samples / 4 + 1);
+    for(std::size_t i = 0; i < stats.samples; ++i)
+    {
+      if(sampled(i, 4))
+        quarter->push_back(sample->points[i]);
+    }
+    double quarter_seconds = 0.0;
+    const double ratio = medianSpacing(quarter, quarter_seconds) / sample_spacing;
+    stats.dimension = ratio > 1.0 ? std::log(4.0) / std::log(ratio) : 3.0;
+    stats.dimension = std::min(3.0, std::max(1.0, stats.dimension));
+  }
+  stats.spacing = sample_spacing * std::pow((double) stats.samples / stats.points, 1.0 / stats.dimension);
+
+  // Cells of a few sample spacings hold enough samples to count on.
+  stats.cell = 4.0 * sample_spacing;
+  std::unordered_map<std::uint64_t, std::uint32_t> cells;
+  for(std::size_t i = 0; i < stats.samples; ++i)
+  {
+    const Eigen::Vector3d p = sample->points[i].getVector3fMap().cast<double>();
+    std::uint64_t key = 0;
+    for(int k = 0; k < 3; ++k)
+      key = (key << 21) | ((std::uint64_t) ((p[k] - min[k]) / stats.cell) & 0x1FFFFF);
+    ++cells[key];
+  }
+  stats.occupied_cells = cells.size();
+  const double scale = (double) stats.points / stats.samples;
+  std::vector<double> counts;
+  counts.reserve(cells.size());
+  for(std::unordered_map<std::uint64_t, std::uint32_t>::const_iterator it = cells.begin(); it != cells.end(); ++it)
+  {
+    const double count = it->second * scale;
+    const std::size_t bin = (std::size_t) std::max(0.0, std::floor(std::log2(count)));
+    if(stats.density.size() <= bin)
+      stats.density.resize(bin + 1, 0);
+    ++stats.density[bin];
+    counts.push_back(count);
+  }
+  std::sort(counts.begin(), counts.end());
+  stats.density_spread = counts[counts.size() * 9 / 10] / counts[counts.size() / 10];
+}
+
+template <typename PointT>
+void scanCloudStats(const pcl::PointCloud<PointT>& cloud, CloudStats& stats)
+{
+  TRACE_SCOPE_VAR(span, "scanCloudStats", cloud.size());
+  const std::size_t stride = std::max<std::size_t>(1, cloud.size() / AUTO_SAMPLE);
+  std::vector<TileStats> tiles((cloud.size() + STATS_TILE - 1) / STATS_TILE);
+  parallelFor(0, cloud.size(), STATS_TILE, [&](std::size_t first, std::size_t last)
+  {
+    TileStats& tile = tiles[first / STATS_TILE];
+    for(std::size_t i = first; i < last; ++i)
+    {
+      const PointT& p = cloud.points[i];
+      if(!pcl::isFinite(p))
+        continue;
+      const double xyz[3] = { p.x, p.y, p.z };
+      tile.add(xyz, sampled(i, stride));
+    }
+  });
+  finishStats(tiles, stats);
+}
+
+void scanCloudStats(const CompactCloud& cloud, CloudStats& stats)
+{
+  TRACE_SCOPE_VAR(span, "scanCloudStats", cloud.size());
+  const std::size_t stride = std::max<std::size_t>(1, cloud.size() / AUTO_SAMPLE);
+  std::vector<std::size_t> first_point(cloud.tiles() + 1, 0);
+  for(std::size_t t = 0; t < cloud.tiles(); ++t)
+    first_point[t + 1] = first_point[t] + cloud.tileSize(t);
+
+  std::vector<TileStats> tiles(cloud.tiles());
+  parallelFor(0, cloud.tiles(), 1, [&](std::size_t first, std::size_t last)
+  {
+    double xyz[3];
+    unsigned char rgb[3];
+    for(std::size_t t = first; t < last; ++t)
+    {
+      const std::size_t n = cloud.tileSize(t);
+      for(std::size_t i = 0; i < n; ++i)
+      {
+        cloud.decode(t, i, xyz, rgb);
+        tiles[t].add(xyz, sampled(first_point[t] + i, stride));
+      }
+    }
+  });
+  finishStats(tiles, stats);
+}
+
+// Points a leaf keeps: each histogram cell its own points, or (cell /
+// leaf)^D of them once the leaf is coarser than their spacing.
+static double keptPoints(const CloudStats& stats, double leaf)
+{
+  const double per_cell = std::pow(stats.cell / leaf, stats.dimension);
+  double kept = 0.0;
+  for(std::size_t b = 0; b < stats.density.size(); ++b)
+    kept += stats.density[b] * std::min(std::ldexp(M_SQRT2, (int) b), per_cell);
+  return kept;
+}
+
+void chooseParams(const CloudStats& stats, const AutoTarget& target, float& leaf_size, MeshParams& params)
+{
+  if(stats.points == 0 || stats.spacing <= 0.0)
+  {
+    pcl::console::print_warn("Cloud statistics are empty, keeping the default parameters\n");
+    return;
+  }
+  // Kept points the budgets allow; meshing makes about two triangles each.
+  double budget = 0.0;
+  if(target.triangles > 0)
+    budget = target.triangles / 2.0;
+  if(target.seconds > 0.0 && stats.query_seconds > 0.0)
+  {
+    const double affordable = target.seconds / (stats.query_seconds * AUTO_QUERIES_PER_POINT);
+    budget = budget > 0.0 ? std::min(budget, affordable) : affordable;
+  }
+  if(budget > 0.0)
+  {
+    // keptPoints falls with the leaf; bisect between the spacing and the box.
+    double low = stats.spacing;
+    double high = std::max((stats.max - stats.min).maxCoeff(), stats.cell);
+    if(keptPoints(stats, low) > budget)
+    {
+      for(int i = 0; i < 40; ++i)
+      {
+        const double middle = std::sqrt(low * high);
+        if(keptPoints(stats, middle) > budget)
+          low = middle;
+        else
+          high = middle;
+      }
+      leaf_size = (float) high;
+    }
+    else
+      leaf_size = (float) low;
+  }
+
+  // Neighbourhoods are sized on the spacing the mesher will actually see.
+  const double unit = std::max((double) leaf_size, stats.spacing);
+  params.normal_k = stats.density_spread > 8.0 ? 16 : 10;
+  params.mls_radius = 3.0 * unit;
+  params.gp3_radius = 4.0 * unit;
+  const double extent = (stats.max - stats.min).maxCoeff();
+  const int depth = extent > unit ? (int) std::ceil(std::log2(extent / unit)) : 5;
+  params.poisson_depth = std::min(12, std::max(5, depth));
+}
+
+void printCloudStats(std::ostream& os, const CloudStats& stats)
+{
+  std::ios::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+  os << std::setprecision(4);
+  const Eigen::Vector3d size = stats.max - stats.min;
+  os << "Cloud statistics: " << stats.points << " points, " << stats.samples << " sampled, box "
+     << size[0] << " x " << size[1] << " x " << size[2] << "\n";
+  os << "  spacing " << stats.spacing << ", dimension " << stats.dimension
+     << ", " << stats.occupied_cells << " cells of " << stats.cell << ", density spread " << stats.density_spread << "\n";
+  os << "  cells by points (2^b):";
+  for(std::size_t b = 0; b < stats.density.size(); ++b)
+    os << " " << stats.density[b];
+  os << std::endl;
+  os.flags(flags);
+  os.precision(precision);
+}
+
+template void scanCloudStats<pcl::PointXYZ>(const pcl::PointCloud<pcl::PointXYZ>&, CloudStats&);
+template void scanCloudStats<pcl::PointXYZRGB>(const pcl::PointCloud<pcl::PointXYZRGB>&, CloudStats&);
+template void scanCloudStats<pcl::PointNormal>(const pcl::PointCloud<pcl::PointNormal>&, CloudStats&);
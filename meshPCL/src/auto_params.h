@@ -0,0 +1,87 @@
+/*********************************
+     AUTOMATIC STAGE PARAMETERS
+**********************************/
+// The MLS radius, normal k, GP3 radius and Poisson depth defaults in
+// MeshParams were tuned on one dataset. -auto replaces them with values
+// derived from the cloud itself, and picks the leaf size that fits a
+// triangle or time budget.
+//
+// One parallel pass over the points collects the bounding box and a
+// sample picked by a hash of the point index; everything else runs on
+// the sample:
+//
+//   spacing     median nearest-neighbour distance in the sample and in a
+//               quarter of it; how fast it grows as points are dropped
+//               gives the apparent dimension D of the sampling (2 for
+//               surfaces), which scales it back to the full cloud
+//   density     histogram of points per occupied cell, uneven sampling
+//               asks for more neighbours per normal
+//   query cost  wall time of the spacing queries, the unit of the time
+//               model: every kept point costs AUTO_QUERIES_PER_POINT
+//
+// A leaf L keeps, in every histogram cell, its points or (cell / L)^D of
+// them, whichever is fewer; meshing makes about two triangles per kept
+// point.
+
+#ifndef MESHPCL_AUTO_PARAMS_H
+#define MESHPCL_AUTO_PARAMS_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+#include "compact_cloud.h"
+#include "pipeline.h"
+
+// Points in the statistics sample.
+static const std::size_t AUTO_SAMPLE = 65536;
+// Time model: nearest-neighbour queries worth of work per kept point
+// across the search tree, outlier removal, normals and meshing; about a
+// third goes to the k-NN normal fit and the rest to the surface method.
+static const double AUTO_QUERIES_PER_POINT = 30.0;
+
+struct CloudStats
+{
+  std::size_t points;            // finite points
+  Eigen::Vector3d min, max;      // bounding box
+  std::size_t samples;
+  double spacing;                // median nearest-neighbour distance, full cloud
+  double dimension;              // apparent dimension D, in [1, 3]
+  double cell;                   // edge of the density histogram cells
+  std::size_t occupied_cells;
+  std::vector<std::size_t> density;  // density[b]: cells holding [2^b, 2^(b+1)) points
+  double density_spread;         // 90th over 10th percentile of points per cell
+  double query_seconds;          // wall time of one nearest-neighbour query
+
+  CloudStats() : points(0), min(Eigen::Vector3d::Zero()), max(Eigen::Vector3d::Zero()), samples(0),
+    spacing(0.0), dimension(2.0), cell(0.0), occupied_cells(0), density_spread(1.0), query_seconds(0.0) {}
+};
+
+struct AutoTarget
+{
+  bool enabled;
+  std::size_t triangles;   // 0: no triangle budget
+  double seconds;          // 0: no time budget
+
+  AutoTarget() : enabled(false), triangles(0), seconds(0.0) {}
+};
+
+// Statistics pass over 'cloud'; non-finite points are skipped. Instantiated
+// for the types in point_fields.h.
+template <typename PointT>
+void scanCloudStats(const pcl::PointCloud<PointT>& cloud, CloudStats& stats);
+// The same over quantized input, decoded tile by tile.
+void scanCloudStats(const CompactCloud& cloud, CloudStats& stats);
+
+// Leaf size and mesh parameters for a cloud with 'stats'. 'leaf_size' is
+// kept when the target sets no budget; params.surface_mode is left as is.
+void chooseParams(const CloudStats& stats, const AutoTarget& target, float& leaf_size, MeshParams& params);
+
+void printCloudStats(std::ostream& os, const CloudStats& stats);
+
+#endif // MESHPCL_AUTO_PARAMS_H
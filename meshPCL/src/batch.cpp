@@ -0,0 +1,220 @@
+#include "batch.h"
+
+#include <pcl/common/io.h>
+#include <pcl/console/print.h>
+#include <pcl/console/time.h>
+#include <pcl/io/ply_io.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "bounded_queue.h"
+#include "cloud_io.h"
+#include "cloud_pool.h"
+#include "trace.h"
+
+struct LoadedCloud
+{
+  std::size_t index;
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+  Eigen::Vector3d offset;
+};
+
+struct MeshedCloud
+{
+  std::size_t index;
+  boost::shared_ptr<pcl::PolygonMesh> mesh;
+  Eigen::Vector3d offset;
+};
+
+bool readCloudList(const std::string& list_file, std::vector<std::string>& inputs)
+{
+  std::ifstream in(list_file.c_str());
+  if(!in.is_open())
+    return false;
+  // relative entries are resolved against the list's own directory
+  boost::filesystem::path base = boost::filesystem::path(list_file).parent_path();
+  std::string line;
+  while(std::getline(in, line))
+  {
+    std::size_t first = line.find_first_not_of(" \t\r");
+    if(first == std::string::npos || line[first] == '#')
+      continue;
+    std::size_t last = line.find_last_not_of(" \t\r");
+    boost::filesystem::path path(line.substr(first, last - first + 1));
+    if(path.is_relative() && !base.empty())
+      path = base / path;
+    inputs.push_back(path.string());
+  }
+  return true;
+}
+
+// <stem>_mesh.ply per input; stems listed more than once (scan.pcd of
+// several stations) get their 1-based list position as a prefix. False if
+// the names still collide.
+static bool outputPaths(const BatchOptions& options, const std::vector<std::string>& inputs,
+  std::vector<std::string>& outputs)
+{
+  std::map<std::string, std::size_t> stems;
+  for(std::size_t i = 0; i < inputs.size(); ++i)
+    ++stems[boost::filesystem::path(inputs[i]).stem().string()];
+
+  std::set<std::string> names;
+  outputs.clear();
+  for(std::size_t i = 0; i < inputs.size(); ++i)
+  {
+    std::string name = boost::filesystem::path(inputs[i]).stem().string();
+    if(stems[name] > 1)
+      name = std::to_string(i + 1) + "_" + name;
+    name += "_mesh.ply";
+    if(!names.insert(name).second)
+    {
+      pcl::console::print_error("Error. %s would overwrite the mesh of another listed cloud (%s)\n",
+        inputs[i].c_str(), name.c_str());
+      return false;
+    }
+    outputs.push_back((boost::filesystem::path(options.output_dir) / name).string());
+  }
+  return true;
+}
+
+// The same stages main runs on a single cloud, minus the unused MLS pass.
+// PCL's Poisson keeps static allocator state, so with several workers the
+// Poisson meshing stage takes turns on 'poisson_mutex'; the stages before
+// it still overlap.
+static void meshCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr& cloud, const BatchOptions& options,
+  CloudPool& pool, std::mutex& poisson_mutex, pcl::PolygonMesh& mesh, Eigen::Vector3d& offset)
+{
+  float leaf_size = options.leaf_size;
+  MeshParams params = options.params;
+  if(options.auto_target.enabled)
+  {
+    CloudStats stats;
+    scanCloudStats<pcl::PointXYZRGB>(*cloud, stats);
+    chooseParams(stats, options.auto_target, leaf_size, params);
+    pcl::console::print_info("Auto parameters: leaf %g, normal k %d, GP3 radius %g, Poisson depth %d\n",
+      leaf_size, params.normal_k, params.gp3_radius, params.poisson_depth);
+  }
+
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out = pool.acquire<pcl::PointXYZRGB>();
+  downSample<pcl::PointXYZRGB>(cloud, cloud_out, leaf_size);
+  cloud.reset(); // the raw cloud is the largest buffer, drop it before meshing
+  if(options.morton)
+  {
+    std::vector<int> order;
+    reorderCloud<pcl::PointXYZRGB>(cloud_out, order);
+  }
+
+  translateCloud<pcl::PointXYZRGB>(cloud_out, offset);
+
+  pcl::search::Search<pcl::PointXYZRGB>::Ptr search_index = buildSearchIndex<pcl::PointXYZRGB>(cloud_out);
+  filterOutliers<pcl::PointXYZRGB>(cloud_out, options.outliers, search_index);
+
+  pcl::PointCloud<pcl::PointNormal>::Ptr cloud_normals = pool.acquire<pcl::PointNormal>(cloud_out->size());
+  calculateNormals<pcl::PointXYZRGB>(cloud_out, cloud_normals, params.normal_k, search_index);
+  cloud_out.reset();
+  std::unique_lock<std::mutex> lock(poisson_mutex, std::defer_lock);
+  if(params.surface_mode == 1)
+    lock.lock();
+  createPlanarMesh(cloud_normals, options.planes, params, options.cluster_tolerance, options.cluster_min, mesh);
+}
+
+int runBatch(const std::vector<std::string>& inputs, const BatchOptions& options)
+{
+  std::vector<std::string> outputs;
+  if(!outputPaths(options, inputs, outputs))
+    return (int) inputs.size();
+
+  pcl::console::TicToc tt;
+  tt.tic();
+
+  const std::size_t workers = options.workers ? options.workers : 1;
+  BoundedQueue<LoadedCloud> loaded(options.queue_depth);
+  BoundedQueue<MeshedCloud> meshed(options.queue_depth);
+  std::atomic<int> failures(0);
+  std::atomic<std::size_t> workers_left(workers);
+  CloudPool pool;
+  pool.setHugePages(options.huge_pages);
+  std::mutex poisson_mutex;
+
+  pcl::console::print_info("Batch of %d clouds, %d compute worker(s), queue depth %d\n",
+    (int) inputs.size(), (int) workers, (int) options.queue_depth);
+
+  std::thread loader([&]()
+  {
+    for(std::size_t i = 0; i < inputs.size(); ++i)
+    {
+      TRACE_SCOPE("batch/load");
+      LoadedCloud item;
+      item.index = i;
+      item.cloud = pool.acquire<pcl::PointXYZRGB>();
+      if(loadCloud<pcl::PointXYZRGB>(inputs[i], item.cloud, item.offset, options.roi) < 0)
+      {
+        ++failures;
+        continue;
+      }
+      if(!loaded.push(item))
+        break;
+    }
+    loaded.close();
+  });
+
+  std::vector<std::thread> computers;
+  for(std::size_t w = 0; w < workers; ++w)
+  {
+    computers.push_back(std::thread([&]()
+    {
+      LoadedCloud item;
+      while(loaded.pop(item))
+      {
+        TRACE_SCOPE_VAR(span, "batch/mesh", item.cloud->size());
+        MeshedCloud result;
+        result.index = item.index;
+        result.mesh.reset(new pcl::PolygonMesh);
+        result.offset = item.offset;
+        meshCloud(item.cloud, options, pool, poisson_mutex, *result.mesh, result.offset);
+        if(!meshed.push(result))
+          break;
+      }
+      // the last worker out ends the save stage
+      if(--workers_left == 0)
+        meshed.close();
+    }));
+  }
+
+  std::thread saver([&]()
+  {
+    MeshedCloud item;
+    while(meshed.pop(item))
+    {
+      TRACE_SCOPE("batch/save");
+      const std::string& output = outputs[item.index];
+      if(saveMeshPLYBinary(output, *item.mesh, item.offset) < 0)
+      {
+        pcl::console::print_error("Error. could not save %s\n", output.c_str());
+        ++failures;
+        continue;
+      }
+      pcl::console::print_info("saved mesh in:%s\n", output.c_str());
+    }
+  });
+
+  loader.join();
+  for(std::size_t w = 0; w < computers.size(); ++w)
+    computers[w].join();
+  saver.join();
+
+  pcl::console::print_info("Batch finished in ");
+  pcl::console::print_value("%g", tt.toc());
+  pcl::console::print_info(" ms, %d of %d clouds failed, %d cloud buffers reused\n",
+    (int) failures, (int) inputs.size(), (int) pool.reused());
+  return failures;
+}
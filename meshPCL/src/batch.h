@@ -0,0 +1,49 @@
+/*********************************
+        PIPELINED BATCH
+**********************************/
+// Meshes a list of clouds with load, compute and save running on their own
+// threads and bounded queues in between, so loading cloud N+1 and saving
+// mesh N-1 overlap with meshing cloud N. Every cloud, raw or intermediate,
+// comes from one CloudPool, so later clouds reuse the buffers of earlier
+// ones instead of reallocating them.
+
+#ifndef MESHPCL_BATCH_H
+#define MESHPCL_BATCH_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "auto_params.h"
+#include "pipeline.h"
+#include "planes.h"
+
+struct BatchOptions
+{
+  float leaf_size;
+  MeshParams params;
+  std::string output_dir;    // meshes are written as <output_dir>/<input stem>_mesh.ply,
+                             // <list position>_<stem>_mesh.ply for repeated stems
+  std::size_t queue_depth;   // clouds/meshes buffered between two stages
+  std::size_t workers;       // concurrent compute stages
+  bool huge_pages;           // advise pooled clouds for transparent huge pages
+  bool morton;               // reorder each downsampled cloud along the Morton curve
+  OutlierParams outliers;    // outlier removal after downsampling, off by default
+  double cluster_tolerance;  // > 0: mesh Euclidean clusters separately
+  std::size_t cluster_min;   // smaller clusters are dropped
+  PlaneParams planes;        // dominant planes meshed as quads, off by default
+  CloudRoi roi;              // applied to every cloud while loading
+  AutoTarget auto_target;    // per-cloud leaf size and mesh parameters, off by default
+
+  BatchOptions() : leaf_size(0.1f), queue_depth(2), workers(1), huge_pages(false), morton(false),
+    cluster_tolerance(0.0), cluster_min(100) {}
+};
+
+// Reads one path per line; blank lines and lines starting with '#' are skipped.
+bool readCloudList(const std::string& list_file, std::vector<std::string>& inputs);
+
+// Returns the number of clouds that failed to load, mesh or save; all of
+// them when two would be saved under the same name.
+int runBatch(const std::vector<std::string>& inputs, const BatchOptions& options);
+
+#endif // MESHPCL_BATCH_H
@@ -0,0 +1,340 @@
+/*********************************
+        STAGE BENCHMARKS
+**********************************/
+// Times every pipeline stage on synthetic clouds of 10K..100M points.
+//
+// Usage: meshpcl_bench [--max_points=N] [--shapes=plane,sphere,terrain,ellipse]
+//                      [--input_dir=DIR] [google benchmark flags]
+// The loadCloud inputs (.pcd/.ply/.txt/.xyz, tens of GB at 100M points) are
+// written to a fresh directory under the system temp path and removed when
+// the run ends. With --input_dir they go to DIR and are kept, so later runs
+// reuse them.
+// Throughput is reported as items_per_second (points/s). For regression
+// comparison write JSON with --benchmark_out=bench.json --benchmark_out_format=json
+// and diff runs with benchmark's tools/compare.py.
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/io/ply_io.h>
+#include <pcl/point_types.h>
+#include <pcl/common/io.h>
+
+#include <benchmark/benchmark.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "pipeline.h"
+#include "synthetic_cloud.h"
+
+typedef pcl::PointCloud<pcl::PointXYZRGB> CloudRGB;
+typedef pcl::PointCloud<pcl::PointXYZ> CloudXYZ;
+typedef pcl::PointCloud<pcl::PointNormal> CloudNormal;
+
+static const float BENCH_SPACING = 0.1f;
+static const float BENCH_LEAF_SIZE = 0.2f;
+
+// Stage functions log progress to stdout; keep it out of the timed region
+// and out of the benchmark report.
+class QuietStdout
+{
+public:
+  QuietStdout() : saved_(std::cout.rdbuf(sink_.rdbuf())) {}
+  ~QuietStdout() { std::cout.rdbuf(saved_); }
+private:
+  std::ostringstream sink_;
+  std::streambuf* saved_;
+};
+
+// Generating 100M points takes longer than most stages, so the last cloud
+// (and what was derived from it) is kept between benchmarks.
+struct CachedInput
+{
+  SyntheticShape shape;
+  std::uint64_t points;
+  CloudRGB::Ptr rgb;
+  CloudXYZ::Ptr xyz;
+  CloudNormal::Ptr normals;
+};
+
+static CachedInput& cachedInput(SyntheticShape shape, std::uint64_t points)
+{
+  static CachedInput cache = {SHAPE_COUNT, 0};
+  if(cache.shape != shape || cache.points != points)
+  {
+    cache = CachedInput();
+    cache.shape = shape;
+    cache.points = points;
+
+    SyntheticParams params;
+    params.shape = shape;
+    params.total_points = points;
+    params.spacing = BENCH_SPACING;
+    params.noise = BENCH_SPACING * 0.1f;
+    cache.rgb.reset(new CloudRGB);
+    generateSyntheticCloud(params, *cache.rgb);
+  }
+  return cache;
+}
+
+static CloudXYZ::Ptr inputXYZ(SyntheticShape shape, std::uint64_t points)
+{
+  CachedInput& input = cachedInput(shape, points);
+  if(!input.xyz)
+  {
+    input.xyz.reset(new CloudXYZ);
+    pcl::copyPointCloud(*input.rgb, *input.xyz);
+  }
+  return input.xyz;
+}
+
+static CloudNormal::Ptr inputNormals(SyntheticShape shape, std::uint64_t points)
+{
+  CachedInput& input = cachedInput(shape, points);
+  if(!input.normals)
+  {
+    CloudXYZ::Ptr xyz = inputXYZ(shape, points);
+    input.normals.reset(new CloudNormal);
+    QuietStdout quiet;
+    calculateNormals<pcl::PointXYZ>(xyz, input.normals);
+  }
+  return input.normals;
+}
+
+// Where inputFile writes; set by main before any benchmark runs.
+static boost::filesystem::path input_dir;
+
+static std::string inputFile(SyntheticShape shape, std::uint64_t points, const std::string& extension)
+{
+  const boost::filesystem::path& dir = input_dir;
+  boost::filesystem::create_directories(dir);
+  std::ostringstream name;
+  name << syntheticShapeName(shape) << "_" << points << extension;
+  boost::filesystem::path path = dir / name.str();
+  if(boost::filesystem::exists(path))
+    return path.string();
+
+  const CloudRGB& cloud = *cachedInput(shape, points).rgb;
+  if(extension == ".pcd")
+  {
+    pcl::io::savePCDFileBinary(path.string(), cloud);
+  }
+  else if(extension == ".ply")
+  {
+    pcl::io::savePLYFileBinary(path.string(), cloud);
+  }
+  else
+  {
+    std::ofstream out(path.string().c_str());
+    for(size_t i = 0; i < cloud.size(); ++i)
+    {
+      const pcl::PointXYZRGB& p = cloud.points[i];
+      out << p.x << " " << p.y << " " << p.z;
+      if(extension == ".txt")
+        out << " " << (int) p.r << " " << (int) p.g << " " << (int) p.b;
+      out << "\n";
+    }
+  }
+  return path.string();
+}
+
+static void finish(benchmark::State& state, std::uint64_t points)
+{
+  state.SetItemsProcessed(state.iterations() * (std::int64_t) points);
+  state.counters["points"] = (double) points;
+}
+
+static void BM_loadCloud(benchmark::State& state, SyntheticShape shape, std::uint64_t points, std::string extension)
+{
+  std::string file = inputFile(shape, points, extension);
+  for(auto _ : state)
+  {
+    CloudRGB::Ptr cloud(new CloudRGB);
+    QuietStdout quiet;
+    loadCloud<pcl::PointXYZRGB>(file, cloud);
+    benchmark::DoNotOptimize(cloud->points.data());
+  }
+  finish(state, points);
+}
+
+static void BM_downSample(benchmark::State& state, SyntheticShape shape, std::uint64_t points)
+{
+  CloudRGB::Ptr cloud = cachedInput(shape, points).rgb;
+  for(auto _ : state)
+  {
+    CloudRGB::Ptr filtered(new CloudRGB);
+    QuietStdout quiet;
+    downSample<pcl::PointXYZRGB>(cloud, filtered, BENCH_LEAF_SIZE);
+    benchmark::DoNotOptimize(filtered->points.data());
+  }
+  finish(state, points);
+}
+
+static void BM_translateCloud(benchmark::State& state, SyntheticShape shape, std::uint64_t points)
+{
+  CloudXYZ::Ptr cloud = inputXYZ(shape, points);
+  for(auto _ : state)
+  {
+    // translateCloud works in place, so every iteration gets a fresh copy
+    state.PauseTiming();
+    CloudXYZ::Ptr translated(new CloudXYZ(*cloud));
+    state.ResumeTiming();
+    QuietStdout quiet;
+    translateCloud<pcl::PointXYZ>(translated);
+    benchmark::DoNotOptimize(translated->points.data());
+  }
+  finish(state, points);
+}
+
+static void BM_applySurfaceApproximation(benchmark::State& state, SyntheticShape shape, std::uint64_t points)
+{
+  CloudXYZ::Ptr cloud = inputXYZ(shape, points);
+  for(auto _ : state)
+  {
+    CloudXYZ::Ptr smoothed(new CloudXYZ);
+    QuietStdout quiet;
+    applySurfaceApproximation<pcl::PointXYZ>(cloud, smoothed);
+    benchmark::DoNotOptimize(smoothed->points.data());
+  }
+  finish(state, points);
+}
+
+static void BM_calculateNormals(benchmark::State& state, SyntheticShape shape, std::uint64_t points)
+{
+  CloudXYZ::Ptr cloud = inputXYZ(shape, points);
+  for(auto _ : state)
+  {
+    CloudNormal::Ptr normals(new CloudNormal);
+    QuietStdout quiet;
+    calculateNormals<pcl::PointXYZ>(cloud, normals);
+    benchmark::DoNotOptimize(normals->points.data());
+  }
+  finish(state, points);
+}
+
+static void BM_createMesh(benchmark::State& state, SyntheticShape shape, std::uint64_t points, int surface_mode)
+{
+  CloudNormal::Ptr normals = inputNormals(shape, points);
+  size_t polygons = 0;
+  for(auto _ : state)
+  {
+    pcl::PolygonMesh mesh;
+    QuietStdout quiet;
+    createMesh(normals, surface_mode, mesh);
+    polygons = mesh.polygons.size();
+  }
+  finish(state, points);
+  state.counters["polygons"] = (double) polygons;
+}
+
+static std::vector<std::string> splitList(const std::string& list)
+{
+  std::vector<std::string> items;
+  std::stringstream ss(list);
+  std::string item;
+  while(std::getline(ss, item, ','))
+  {
+    if(!item.empty())
+      items.push_back(item);
+  }
+  return items;
+}
+
+// Strips our own flags so benchmark::Initialize only sees its own.
+static void parseBenchArgs(int& argc, char** argv, std::uint64_t& max_points, std::vector<SyntheticShape>& shapes,
+  std::string& kept_input_dir)
+{
+  int out = 1;
+  for(int i = 1; i < argc; ++i)
+  {
+    if(std::strncmp(argv[i], "--max_points=", 13) == 0)
+    {
+      max_points = std::strtoull(argv[i] + 13, NULL, 10);
+    }
+    else if(std::strncmp(argv[i], "--input_dir=", 12) == 0)
+    {
+      kept_input_dir = argv[i] + 12;
+    }
+    else if(std::strncmp(argv[i], "--shapes=", 9) == 0)
+    {
+      shapes.clear();
+      std::vector<std::string> names = splitList(argv[i] + 9);
+      for(size_t j = 0; j < names.size(); ++j)
+      {
+        SyntheticShape shape = syntheticShapeFromName(names[j]);
+        if(shape == SHAPE_COUNT)
+          std::cerr << "Unknown shape " << names[j] << ", skipped" << std::endl;
+        else
+          shapes.push_back(shape);
+      }
+    }
+    else
+    {
+      argv[out++] = argv[i];
+    }
+  }
+  argc = out;
+}
+
+int main(int argc, char** argv)
+{
+  std::uint64_t max_points = 100000000;
+  std::vector<SyntheticShape> shapes;
+  for(int s = 0; s < SHAPE_COUNT; ++s)
+    shapes.push_back((SyntheticShape) s);
+
+  std::string kept_input_dir;
+  parseBenchArgs(argc, argv, max_points, shapes, kept_input_dir);
+  const bool keep_inputs = !kept_input_dir.empty();
+  input_dir = keep_inputs ? boost::filesystem::path(kept_input_dir)
+    : boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("meshpcl_bench-%%%%-%%%%-%%%%");
+
+  const char* extensions[] = {".pcd", ".ply", ".txt", ".xyz"};
+
+  // Grouped by input so each cloud is generated once.
+  for(size_t s = 0; s < shapes.size(); ++s)
+  {
+    for(std::uint64_t n = 10000; n <= max_points; n *= 10)
+    {
+      std::string suffix = std::string("/") + syntheticShapeName(shapes[s]) + "/" + std::to_string(n);
+      for(size_t e = 0; e < 4; ++e)
+      {
+        benchmark::RegisterBenchmark((std::string("loadCloud") + extensions[e] + suffix).c_str(),
+          BM_loadCloud, shapes[s], n, std::string(extensions[e]))->Unit(benchmark::kMillisecond)->UseRealTime();
+      }
+      benchmark::RegisterBenchmark(("downSample" + suffix).c_str(), BM_downSample, shapes[s], n)
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+      benchmark::RegisterBenchmark(("translateCloud" + suffix).c_str(), BM_translateCloud, shapes[s], n)
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+      benchmark::RegisterBenchmark(("applySurfaceApproximation" + suffix).c_str(), BM_applySurfaceApproximation, shapes[s], n)
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+      benchmark::RegisterBenchmark(("calculateNormals" + suffix).c_str(), BM_calculateNormals, shapes[s], n)
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+      benchmark::RegisterBenchmark(("createMesh/poisson" + suffix).c_str(), BM_createMesh, shapes[s], n, 1)
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+      benchmark::RegisterBenchmark(("createMesh/gp3" + suffix).c_str(), BM_createMesh, shapes[s], n, 2)
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+    }
+  }
+
+  benchmark::Initialize(&argc, argv);
+  if(benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  if(!keep_inputs)
+  {
+    boost::system::error_code error;
+    boost::filesystem::remove_all(input_dir, error);
+    if(error)
+      std::cerr << "Could not remove " << input_dir.string() << ": " << error.message() << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,66 @@
+/*********************************
+         BOUNDED QUEUE
+**********************************/
+// Blocking multi-producer/multi-consumer queue with a fixed capacity, used
+// between pipeline stages so a fast stage cannot run ahead of a slow one
+// by more than 'capacity' items.
+
+#ifndef MESHPCL_BOUNDED_QUEUE_H
+#define MESHPCL_BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+template <typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(std::size_t capacity) : capacity_(capacity ? capacity : 1), closed_(false) {}
+
+  // Blocks while the queue is full. Returns false if the queue was closed.
+  bool push(T item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this]() { return closed_ || items_.size() < capacity_; });
+    if(closed_)
+      return false;
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Blocks while the queue is empty. Returns false once it is closed and drained.
+  bool pop(T& item)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this]() { return closed_ || !items_.empty(); });
+    if(items_.empty())
+      return false;
+    item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // No more pushes; consumers drain what is left.
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  std::deque<T> items_;
+  std::size_t capacity_;
+  bool closed_;
+};
+
+#endif // MESHPCL_BOUNDED_QUEUE_H
@@ -0,0 +1,273 @@
+/*********************************
+   SYNTHETIC CLOUD GENERATOR
+**********************************/
+// Streams arbitrarily large synthetic clouds to .xyz, .txt, .ply or .pcd
+// for load testing pcd_write without customer data. Points are generated
+// and encoded in parallel, one batch at a time, while a writer thread
+// drains the previous batch, so memory stays bounded by the batch size.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+#include "synthetic_cloud.h"
+
+enum OutputFormat { FORMAT_XYZ, FORMAT_TXT, FORMAT_PLY, FORMAT_PCD };
+
+static const std::size_t CHUNK_POINTS = 1 << 16;
+
+void printUsage (const char* progName){
+  std::cout << "\nUsage: " << progName << " -o <output.xyz|.txt|.ply|.pcd> [options]" << std::endl;
+  std::cout << "options:" << std::endl;
+  std::cout << " -shape <name>        plane, sphere, terrain, ellipse, buildings, cylinders (default terrain)" << std::endl;
+  std::cout << " -points <n>          number of points, e.g. 1000000000 (default 1000000)" << std::endl;
+  std::cout << " -density <n>         points per square unit of surface (default 100)" << std::endl;
+  std::cout << " -noise <sigma>       gaussian noise along the surface normal (default 0)" << std::endl;
+  std::cout << " -outliers <ratio>    fraction of points scattered in the bounding box (default 0)" << std::endl;
+  std::cout << " -no_color            write no colour (r = g = b = 0 for .txt)" << std::endl;
+  std::cout << " -seed <n>            random seed (default 1)" << std::endl;
+  std::cout << " -batch <n>           points generated per batch, bounds memory (default 16M)" << std::endl;
+}
+
+static bool endsWith(const std::string& s, const std::string& suffix)
+{
+  return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static std::string header(OutputFormat format, const SyntheticParams& params)
+{
+  char buf[512];
+  const unsigned long long n = (unsigned long long) params.total_points;
+  switch(format)
+  {
+    case FORMAT_PLY:
+      std::snprintf(buf, sizeof(buf),
+        "ply\nformat binary_little_endian 1.0\ncomment meshpcl synthetic %s seed %llu\n"
+        "element vertex %llu\nproperty float x\nproperty float y\nproperty float z\n%s"
+        "end_header\n",
+        syntheticShapeName(params.shape), (unsigned long long) params.seed, n,
+        params.colored ? "property uchar red\nproperty uchar green\nproperty uchar blue\n" : "");
+      return buf;
+    case FORMAT_PCD:
+      std::snprintf(buf, sizeof(buf),
+        "# .PCD v0.7 - Point Cloud Data file format\nVERSION 0.7\n"
+        "FIELDS x y z%s\nSIZE 4 4 4%s\nTYPE F F F%s\nCOUNT 1 1 1%s\n"
+        "WIDTH %llu\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS %llu\nDATA binary\n",
+        params.colored ? " rgb" : "", params.colored ? " 4" : "", params.colored ? " F" : "",
+        params.colored ? " 1" : "", n, n);
+      return buf;
+    default:
+      return "";
+  }
+}
+
+// Appends points [first, first + count) to out in the output encoding.
+static void encodeChunk(OutputFormat format, const SyntheticParams& params,
+  std::uint64_t first, std::size_t count, std::string& out)
+{
+  std::vector<SyntheticPoint> points(count);
+  generateSyntheticPoints(params, first, count, points.data());
+
+  if(format == FORMAT_PLY || format == FORMAT_PCD)
+  {
+    const std::size_t stride = params.colored ? (format == FORMAT_PLY ? 15 : 16) : 12;
+    out.resize(count * stride);
+    char* dst = &out[0];
+    for(std::size_t i = 0; i < count; ++i, dst += stride)
+    {
+      std::memcpy(dst, &points[i].x, 4);
+      std::memcpy(dst + 4, &points[i].y, 4);
+      std::memcpy(dst + 8, &points[i].z, 4);
+      if(!params.colored)
+        continue;
+      if(format == FORMAT_PLY)
+      {
+        dst[12] = (char) points[i].r;
+        dst[13] = (char) points[i].g;
+        dst[14] = (char) points[i].b;
+      }
+      else
+      {
+        // PCL packs rgb as the bit pattern of a float field.
+        std::uint32_t rgb = (std::uint32_t) points[i].r << 16 | (std::uint32_t) points[i].g << 8 | points[i].b;
+        std::memcpy(dst + 12, &rgb, 4);
+      }
+    }
+    return;
+  }
+
+  out.clear();
+  out.reserve(count * 48);
+  char line[96];
+  for(std::size_t i = 0; i < count; ++i)
+  {
+    int len;
+    if(format == FORMAT_TXT)
+      len = std::snprintf(line, sizeof(line), "%.4f %.4f %.4f %u %u %u\n", points[i].x, points[i].y, points[i].z,
+        (unsigned) points[i].r, (unsigned) points[i].g, (unsigned) points[i].b);
+    else
+      len = std::snprintf(line, sizeof(line), "%.4f %.4f %.4f\n", points[i].x, points[i].y, points[i].z);
+    out.append(line, len);
+  }
+}
+
+// Single-slot handoff between the encoding threads and the writer thread.
+class BatchWriter
+{
+public:
+  explicit BatchWriter(std::ofstream& out)
+    : out_(out), done_(false), failed_(false), thread_(&BatchWriter::run, this) {}
+
+  ~BatchWriter() { finish(); }
+
+  void push(std::vector<std::string>& batch)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this]() { return queue_.empty(); });
+    queue_.push_back(std::vector<std::string>());
+    queue_.back().swap(batch);
+    cond_.notify_all();
+  }
+
+  bool finish()
+  {
+    if(thread_.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+      }
+      cond_.notify_all();
+      thread_.join();
+    }
+    return !failed_;
+  }
+
+private:
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(;;)
+    {
+      cond_.wait(lock, [this]() { return done_ || !queue_.empty(); });
+      if(queue_.empty())
+        return;
+      std::vector<std::string> batch;
+      batch.swap(queue_.front());
+      lock.unlock();
+      for(std::size_t i = 0; i < batch.size(); ++i)
+        out_.write(batch[i].data(), batch[i].size());
+      if(!out_)
+        failed_ = true;
+      lock.lock();
+      queue_.pop_front();
+      cond_.notify_all();
+    }
+  }
+
+  std::ofstream& out_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::vector<std::string> > queue_;
+  bool done_;
+  bool failed_;
+  std::thread thread_;
+};
+
+int main(int argc, char **argv)
+{
+  SyntheticParams params;
+  params.shape = SHAPE_TERRAIN;
+  params.total_points = 1000000;
+  float density = 100.0f;
+  std::uint64_t batch_points = 16 << 20;
+  std::string output;
+
+  for(int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if(arg == "-o" && has_value) output = argv[++i];
+    else if(arg == "-shape" && has_value) params.shape = syntheticShapeFromName(argv[++i]);
+    else if(arg == "-points" && has_value) params.total_points = std::strtoull(argv[++i], NULL, 10);
+    else if(arg == "-density" && has_value) density = (float) std::atof(argv[++i]);
+    else if(arg == "-noise" && has_value) params.noise = (float) std::atof(argv[++i]);
+    else if(arg == "-outliers" && has_value) params.outlier_ratio = (float) std::atof(argv[++i]);
+    else if(arg == "-seed" && has_value) params.seed = std::strtoull(argv[++i], NULL, 10);
+    else if(arg == "-batch" && has_value) batch_points = std::strtoull(argv[++i], NULL, 10);
+    else if(arg == "-no_color") params.colored = false;
+    else
+    {
+      printUsage(argv[0]);
+      return -1;
+    }
+  }
+
+  if(output.empty() || params.shape == SHAPE_COUNT || params.total_points == 0 || density <= 0.0f)
+  {
+    printUsage(argv[0]);
+    return -1;
+  }
+  params.spacing = spacingForDensity(density);
+
+  OutputFormat format;
+  if(endsWith(output, ".xyz")) format = FORMAT_XYZ;
+  else if(endsWith(output, ".txt")) format = FORMAT_TXT;
+  else if(endsWith(output, ".ply")) format = FORMAT_PLY;
+  else if(endsWith(output, ".pcd")) format = FORMAT_PCD;
+  else
+  {
+    std::cerr << "Error. unsupported output type: " << output << std::endl;
+    return -1;
+  }
+  std::ofstream out(output.c_str(), std::ios::binary);
+  if(!out.is_open())
+  {
+    std::cerr << "Error. could not open " << output << std::endl;
+    return -1;
+  }
+  out << header(format, params);
+
+  std::cout << "Generating " << params.total_points << " " << syntheticShapeName(params.shape)
+            << " points on " << parallelThreads() << " threads into " << output << std::endl;
+
+  batch_points = std::max<std::uint64_t>(CHUNK_POINTS, batch_points / CHUNK_POINTS * CHUNK_POINTS);
+  BatchWriter writer(out);
+  std::vector<std::string> batch;
+  for(std::uint64_t first = 0; first < params.total_points; first += batch_points)
+  {
+    std::uint64_t count = std::min(batch_points, params.total_points - first);
+    std::size_t chunks = (std::size_t) ((count + CHUNK_POINTS - 1) / CHUNK_POINTS);
+    batch.resize(chunks);
+    parallelFor(0, chunks, 1, [&](std::size_t begin, std::size_t end)
+    {
+      for(std::size_t c = begin; c < end; ++c)
+      {
+        std::uint64_t chunk_first = first + c * CHUNK_POINTS;
+        std::size_t n = (std::size_t) std::min<std::uint64_t>(CHUNK_POINTS, first + count - chunk_first);
+        encodeChunk(format, params, chunk_first, n, batch[c]);
+      }
+    });
+    writer.push(batch);
+
+    std::cout << "\r" << (first + count) * 100 / params.total_points << "%" << std::flush;
+  }
+  std::cout << std::endl;
+
+  if(!writer.finish())
+  {
+    std::cerr << "Error. writing " << output << " failed" << std::endl;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,314 @@
+#include "cloud_io.h"
+
+#include <pcl/common/io.h>
+#include <pcl/console/print.h>
+#include <pcl/io/ply_io.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#include "parallel.h"
+#include "point_fields.h"
+#include "trace.h"
+
+TextCloudReader::~TextCloudReader()
+{
+  if(data_)
+    munmap(const_cast<char*>(data_), size_);
+}
+
+int TextCloudReader::open(const std::string& filename, bool with_color, const CloudRoi& roi)
+{
+  return open(filename, with_color, roi, Scan());
+}
+
+int TextCloudReader::open(const std::string& filename, bool with_color, const CloudRoi& roi, const Scan& hook)
+{
+  TRACE_SCOPE("TextCloudReader::open");
+  with_color_ = with_color;
+  roi_ = roi;
+  use_roi_ = roi.active();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    std::printf("Error: Could not find %s\n", filename.c_str());
+    return -1;
+  }
+  struct stat info;
+  if(fstat(fd, &info) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  size_ = (std::size_t) info.st_size;
+  if(size_ == 0)
+  {
+    close(fd);
+    return 0;
+  }
+  void* mapped = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(mapped == MAP_FAILED)
+  {
+    std::printf("Error: Could not map %s\n", filename.c_str());
+    size_ = 0;
+    return -1;
+  }
+  madvise(mapped, size_, MADV_SEQUENTIAL);
+  data_ = static_cast<const char*>(mapped);
+  const char* data_end = data_ + size_;
+
+  // Chunks start on line boundaries.
+  const std::size_t chunk_bytes = std::max<std::size_t>(std::size_t(1) << 20, size_ / (parallelThreads() * 8) + 1);
+  for(const char* begin = data_; begin < data_end; )
+  {
+    const char* end = begin + std::min<std::size_t>(chunk_bytes, data_end - begin);
+    if(end < data_end)
+    {
+      const char* newline = static_cast<const char*>(std::memchr(end, '\n', data_end - end));
+      end = newline ? newline + 1 : data_end;
+    }
+    Chunk chunk;
+    chunk.begin = begin;
+    chunk.end = end;
+    chunks_.push_back(chunk);
+    begin = end;
+  }
+
+  if(hook.chunks)
+    hook.chunks(chunks_.size());
+
+  // Pass 1: count points and bound them in double precision.
+  {
+    TRACE_SCOPE_VAR(scan, "TextCloudReader::open/scan", size_);
+    parallelFor(0, chunks_.size(), 1, [&](std::size_t first, std::size_t last)
+    {
+      for(std::size_t c = first; c < last; ++c)
+      {
+        Chunk& chunk = chunks_[c];
+        chunk.points = 0;
+        for(int k = 0; k < 3; ++k)
+        {
+          chunk.min[k] = std::numeric_limits<double>::max();
+          chunk.max[k] = -std::numeric_limits<double>::max();
+        }
+        for(const char* line = chunk.begin; line < chunk.end; )
+        {
+          const char* newline = static_cast<const char*>(std::memchr(line, '\n', chunk.end - line));
+          const char* line_end = newline ? newline : chunk.end;
+          double xyz[3];
+          unsigned char rgb[3];
+          if(parseLine(line, line_end, with_color_, xyz, rgb) && (!use_roi_ || roi_.contains(xyz)))
+          {
+            ++chunk.points;
+            for(int k = 0; k < 3; ++k)
+            {
+              chunk.min[k] = std::min(chunk.min[k], xyz[k]);
+              chunk.max[k] = std::max(chunk.max[k], xyz[k]);
+            }
+            if(hook.point)
+              hook.point(c, xyz);
+          }
+          line = line_end + 1;
+        }
+      }
+    });
+  }
+
+  double min[3] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+  double max[3] = { -std::numeric_limits<double>::max(), -std::numeric_limits<double>::max(), -std::numeric_limits<double>::max() };
+  for(std::size_t c = 0; c < chunks_.size(); ++c)
+  {
+    chunks_[c].first = points_;
+    points_ += chunks_[c].points;
+    for(int k = 0; k < 3; ++k)
+    {
+      min[k] = std::min(min[k], chunks_[c].min[k]);
+      max[k] = std::max(max[k], chunks_[c].max[k]);
+    }
+  }
+  if(points_ > 0)
+  {
+    for(int k = 0; k < 3; ++k)
+      offset_[k] = std::floor(0.5 * (min[k] + max[k]));
+  }
+  return 0;
+}
+
+template <typename PointT>
+int loadTextCloud(const std::string& filename, bool with_color,
+  pcl::PointCloud<PointT>& cloud, Eigen::Vector3d& offset, const CloudRoi& roi)
+{
+  TRACE_SCOPE("loadTextCloud");
+  TextCloudReader reader;
+  if(reader.open(filename, with_color, roi) < 0)
+    return -1;
+  offset = reader.offset();
+
+  // Pass 2: store float32 coordinates relative to the offset.
+  cloud.points.resize(reader.points());
+  TRACE_SCOPE_VAR(parse, "loadTextCloud/parse", reader.points());
+  parallelFor(0, reader.chunks(), 1, [&](std::size_t first, std::size_t last)
+  {
+    for(std::size_t c = first; c < last; ++c)
+    {
+      std::size_t index = reader.chunkFirst(c);
+      reader.readChunk(c, [&](const double xyz[3], const unsigned char rgb[3])
+      {
+        PointT& pt = cloud.points[index++];
+        pt = PointT();
+        pt.x = (float) xyz[0];
+        pt.y = (float) xyz[1];
+        pt.z = (float) xyz[2];
+        if(with_color)
+        {
+          setPointColor(pt, rgb);
+        }
+      });
+    }
+  });
+  return 0;
+}
+
+template int loadTextCloud<pcl::PointXYZ>(const std::string&, bool, pcl::PointCloud<pcl::PointXYZ>&, Eigen::Vector3d&, const CloudRoi&);
+template int loadTextCloud<pcl::PointXYZRGB>(const std::string&, bool, pcl::PointCloud<pcl::PointXYZRGB>&, Eigen::Vector3d&, const CloudRoi&);
+template int loadTextCloud<pcl::PointNormal>(const std::string&, bool, pcl::PointCloud<pcl::PointNormal>&, Eigen::Vector3d&, const CloudRoi&);
+
+// PLY name and size of a PCLPointField datatype; NULL when PLY has none.
+static const char* plyType(std::uint8_t datatype, std::size_t& bytes)
+{
+  switch(datatype)
+  {
+    case pcl::PCLPointField::INT8:    bytes = 1; return "char";
+    case pcl::PCLPointField::UINT8:   bytes = 1; return "uchar";
+    case pcl::PCLPointField::INT16:   bytes = 2; return "short";
+    case pcl::PCLPointField::UINT16:  bytes = 2; return "ushort";
+    case pcl::PCLPointField::INT32:   bytes = 4; return "int";
+    case pcl::PCLPointField::UINT32:  bytes = 4; return "uint";
+    case pcl::PCLPointField::FLOAT32: bytes = 4; return "float";
+    case pcl::PCLPointField::FLOAT64: bytes = 8; return "double";
+    default:                          bytes = 0; return NULL;
+  }
+}
+
+int saveMeshPLYBinary(const std::string& filename, const pcl::PolygonMesh& mesh,
+  const Eigen::Vector3d& offset)
+{
+  if(offset.isZero())
+    return pcl::io::savePLYFileBinary(filename, mesh);
+
+  const pcl::PCLPointCloud2& cloud = mesh.cloud;
+  const std::size_t vertices = (std::size_t) cloud.width * cloud.height;
+  if(pcl::getFieldIndex(cloud, "x") < 0 || pcl::getFieldIndex(cloud, "y") < 0 || pcl::getFieldIndex(cloud, "z") < 0)
+    return -1;
+
+  // One entry per PLY property group, in field order. Packed colour is split
+  // into uchar channels and normals take PLY's nx/ny/nz names, as in PCL's
+  // writer; every other field is copied as is.
+  struct Property { std::size_t offset; std::size_t bytes; std::uint32_t count; int colour; };
+  std::vector<Property> properties;
+  std::ostringstream header;
+  for(std::size_t f = 0; f < cloud.fields.size(); ++f)
+  {
+    const pcl::PCLPointField& field = cloud.fields[f];
+    if(field.name == "_" || field.count == 0)
+      continue;
+    Property property = { field.offset, 0, field.count, 0 };
+    if(field.name == "rgb" || field.name == "rgba")
+    {
+      property.colour = field.name == "rgba" ? 4 : 3;
+      header << "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+      if(property.colour == 4)
+        header << "property uchar alpha\n";
+      properties.push_back(property);
+      continue;
+    }
+    const char* type = plyType(field.datatype, property.bytes);
+    if(!type)
+    {
+      pcl::console::print_warn("Field %s has no PLY type, not written to %s\n", field.name.c_str(), filename.c_str());
+      continue;
+    }
+    std::string name = field.name;
+    if(name == "normal_x" || name == "normal_y" || name == "normal_z")
+      name = "n" + name.substr(7);
+    if(field.count == 1)
+      header << "property " << type << ' ' << name << '\n';
+    else
+      header << "property list uint " << type << ' ' << name << '\n';
+    properties.push_back(property);
+  }
+
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  if(!out.is_open())
+    return -1;
+
+  // Same layout as pcl::io::savePLYFileBinary plus the offset comment.
+  char comment[160];
+  std::snprintf(comment, sizeof(comment), "comment offset %.6f %.6f %.6f\n", offset[0], offset[1], offset[2]);
+  out << "ply\nformat binary_little_endian 1.0\ncomment PCL generated\n" << comment
+      << "element vertex " << vertices << '\n' << header.str()
+      << "element face " << mesh.polygons.size() << "\nproperty list uchar int vertex_indices\nend_header\n";
+
+  std::vector<char> buffer;
+  buffer.reserve(std::size_t(1) << 20);
+  for(std::size_t i = 0; i < vertices; ++i)
+  {
+    const char* point = reinterpret_cast<const char*>(&cloud.data[i * cloud.point_step]);
+    for(std::size_t p = 0; p < properties.size(); ++p)
+    {
+      const Property& property = properties[p];
+      const char* value = point + property.offset;
+      if(property.colour)
+      {
+        std::uint32_t packed;
+        std::memcpy(&packed, value, 4);
+        buffer.push_back((char) ((packed >> 16) & 0xff));
+        buffer.push_back((char) ((packed >> 8) & 0xff));
+        buffer.push_back((char) (packed & 0xff));
+        if(property.colour == 4)
+          buffer.push_back((char) ((packed >> 24) & 0xff));
+        continue;
+      }
+      if(property.count != 1)
+        buffer.insert(buffer.end(), reinterpret_cast<const char*>(&property.count), reinterpret_cast<const char*>(&property.count) + 4);
+      buffer.insert(buffer.end(), value, value + property.bytes * property.count);
+    }
+    if(buffer.size() >= (std::size_t(1) << 20))
+    {
+      out.write(buffer.data(), buffer.size());
+      buffer.clear();
+    }
+  }
+  for(std::size_t p = 0; p < mesh.polygons.size(); ++p)
+  {
+    const std::vector<uint32_t>& indices = mesh.polygons[p].vertices;
+    buffer.push_back((char) (unsigned char) indices.size());
+    for(std::size_t k = 0; k < indices.size(); ++k)
+    {
+      int32_t index = (int32_t) indices[k];
+      buffer.insert(buffer.end(), reinterpret_cast<char*>(&index), reinterpret_cast<char*>(&index) + 4);
+    }
+    if(buffer.size() >= (std::size_t(1) << 20))
+    {
+      out.write(buffer.data(), buffer.size());
+      buffer.clear();
+    }
+  }
+  out.write(buffer.data(), buffer.size());
+  return out.good() ? 0 : -1;
+}
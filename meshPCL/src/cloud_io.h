@@ -0,0 +1,175 @@
+/*********************************
+     GEOREFERENCED CLOUD I/O
+**********************************/
+// Text clouds in UTM or ECEF coordinates do not fit float32: at 10^6 m a
+// float resolves only ~6 cm. The text loader therefore parses in double,
+// picks a whole-metre offset near the centre of the bounding box in a first
+// parallel pass, and stores float32 coordinates relative to it in a second
+// pass. The offset travels with the cloud through the pipeline and is
+// written as a PLY header comment, so original = stored + offset:
+//
+//   comment offset <x> <y> <z>
+//
+// A region of interest is tested on the parsed double coordinates in both
+// passes: points outside it are neither counted, bounded nor stored.
+
+#ifndef MESHPCL_CLOUD_IO_H
+#define MESHPCL_CLOUD_IO_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PolygonMesh.h>
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "roi.h"
+
+// Memory-mapped .xyz/.txt file split into line-aligned chunks. open() runs
+// the first pass (point count and offset); readChunk() is the second pass
+// and may be called for different chunks concurrently.
+class TextCloudReader
+{
+public:
+  TextCloudReader() : data_(NULL), size_(0), with_color_(false), use_roi_(false), points_(0), offset_(Eigen::Vector3d::Zero()) {}
+  ~TextCloudReader();
+
+  // Returns -1 if the file cannot be read. Only points inside 'roi' are
+  // counted, bounded and later passed to readChunk.
+  int open(const std::string& filename, bool with_color, const CloudRoi& roi = CloudRoi());
+
+  // First-pass hook, so callers can size their storage without parsing the
+  // file again: chunks(n) once the file is split, then point(c, file_xyz)
+  // for every counted point. Chunks run concurrently; the points of one
+  // chunk in order on one thread.
+  struct Scan
+  {
+    std::function<void(std::size_t chunks)> chunks;
+    std::function<void(std::size_t c, const double file_xyz[3])> point;
+  };
+  int open(const std::string& filename, bool with_color, const CloudRoi& roi, const Scan& hook);
+
+  const Eigen::Vector3d& offset() const { return offset_; }
+  std::size_t points() const { return points_; }
+  std::size_t chunks() const { return chunks_.size(); }
+  // Index of chunk c's first point among all points of the file.
+  std::size_t chunkFirst(std::size_t c) const { return chunks_[c].first; }
+
+  // Calls fn(local_xyz, rgb) for every point of chunk c in file order, with
+  // local_xyz = parsed - offset() in double.
+  template <typename PointFn>
+  void readChunk(std::size_t c, PointFn fn) const
+  {
+    visitChunk(c, true, fn);
+  }
+
+  // As readChunk with fn(file_xyz, rgb): the parsed coordinates, bit for
+  // bit the ones the first pass handed to Scan::point.
+  template <typename PointFn>
+  void readChunkFile(std::size_t c, PointFn fn) const
+  {
+    visitChunk(c, false, fn);
+  }
+
+  // Parses "x y z [r g b]" from [begin, end). Longer lines are truncated.
+  static bool parseLine(const char* begin, const char* end, bool with_color, double xyz[3], unsigned char rgb[3])
+  {
+    char line[256];
+    std::size_t length = std::min<std::size_t>(end - begin, sizeof(line) - 1);
+    std::memcpy(line, begin, length);
+    line[length] = '\0';
+
+    char* cursor = line;
+    for(int k = 0; k < 3; ++k)
+    {
+      char* next;
+      xyz[k] = std::strtod(cursor, &next);
+      if(next == cursor)
+        return false;
+      cursor = next;
+    }
+    if(!with_color)
+      return true;
+    for(int k = 0; k < 3; ++k)
+    {
+      char* next;
+      rgb[k] = (unsigned char) std::strtoul(cursor, &next, 10);
+      if(next == cursor)
+        return false;
+      cursor = next;
+    }
+    return true;
+  }
+
+private:
+  struct Chunk
+  {
+    const char* begin;
+    const char* end;
+    std::size_t points;
+    std::size_t first;
+    double min[3];
+    double max[3];
+  };
+
+  template <typename PointFn>
+  void visitChunk(std::size_t c, bool local, PointFn& fn) const
+  {
+    const char* begin = chunks_[c].begin;
+    const char* end = chunks_[c].end;
+    while(begin < end)
+    {
+      const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+      const char* line_end = newline ? newline : end;
+      double xyz[3];
+      unsigned char rgb[3] = { 0, 0, 0 };
+      if(parseLine(begin, line_end, with_color_, xyz, rgb) && (!use_roi_ || roi_.contains(xyz)))
+      {
+        if(local)
+        {
+          xyz[0] -= offset_[0];
+          xyz[1] -= offset_[1];
+          xyz[2] -= offset_[2];
+        }
+        fn(xyz, rgb);
+      }
+      begin = line_end + 1;
+    }
+  }
+
+  TextCloudReader(const TextCloudReader&);
+  TextCloudReader& operator=(const TextCloudReader&);
+
+  const char* data_;
+  std::size_t size_;
+  bool with_color_;
+  CloudRoi roi_;
+  bool use_roi_;
+  std::vector<Chunk> chunks_;
+  std::size_t points_;
+  Eigen::Vector3d offset_;
+};
+
+// Loads an .xyz (x y z) or .txt (x y z r g b) file in local coordinates and
+// sets 'offset' to the frame origin. Lines that do not parse are skipped.
+// Returns -1 if the file cannot be read. Colour is kept only when PointT
+// has an rgb field; instantiated for the types in point_fields.h. Points
+// outside 'roi' are skipped while parsing.
+template <typename PointT>
+int loadTextCloud(const std::string& filename, bool with_color,
+  pcl::PointCloud<PointT>& cloud, Eigen::Vector3d& offset, const CloudRoi& roi = CloudRoi());
+
+// savePLYFileBinary with the offset comment; a zero offset writes exactly
+// what PCL writes. Every vertex field is written with its own PLY type;
+// fields PLY cannot hold are dropped with a warning.
+int saveMeshPLYBinary(const std::string& filename, const pcl::PolygonMesh& mesh,
+  const Eigen::Vector3d& offset);
+
+#endif // MESHPCL_CLOUD_IO_H
@@ -0,0 +1,49 @@
+#include "cloud_pool.h"
+
+#include <sys/mman.h>
+
+static const std::size_t HUGE_PAGE_BYTES = std::size_t(2) << 20;
+
+void adviseHugePages(void* data, std::size_t bytes)
+{
+#ifdef MADV_HUGEPAGE
+  // madvise needs a page-aligned range; only whole huge pages gain anything.
+  std::uintptr_t begin = (reinterpret_cast<std::uintptr_t>(data) + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+  std::uintptr_t end = (reinterpret_cast<std::uintptr_t>(data) + bytes) & ~(HUGE_PAGE_BYTES - 1);
+  if(end > begin)
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE);
+#else
+  (void) data;
+  (void) bytes;
+#endif
+}
+
+void CloudPool::clear()
+{
+  Free free;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    free.swap(state_->free);
+    state_->pooled_bytes = 0;
+  }
+  for(Free::iterator it = free.begin(); it != free.end(); ++it)
+    it->second.destroy(it->second.cloud);
+}
+
+std::uint64_t CloudPool::pooledBytes() const
+{
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->pooled_bytes;
+}
+
+std::size_t CloudPool::reused() const
+{
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->reused;
+}
+
+std::size_t CloudPool::allocated() const
+{
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->allocated;
+}
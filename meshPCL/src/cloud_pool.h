@@ -0,0 +1,166 @@
+/*********************************
+        CLOUD BUFFER POOL
+**********************************/
+// Recycles the point vectors of intermediate clouds across batch jobs. A
+// cloud handed out by acquire() returns to the pool when its last Ptr goes
+// away, keeping its capacity, so the next job that needs a cloud of that
+// point type starts from a buffer that is already big enough instead of
+// growing a fresh one through reallocation. Only batch mode holds a pool:
+// a single run meshes one cloud and would never get a buffer back.
+//
+// With huge pages enabled, every buffer the pool presizes is advised for
+// transparent huge pages (MADV_HUGEPAGE), cutting TLB misses on the
+// multi-gigabyte clouds. reserveCloud does the same without a pool.
+
+#ifndef MESHPCL_CLOUD_POOL_H
+#define MESHPCL_CLOUD_POOL_H
+
+#include <pcl/point_cloud.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <typeindex>
+
+// Advises [data, data + bytes) for transparent huge pages; no-op where
+// unsupported or for buffers smaller than one huge page.
+void adviseHugePages(void* data, std::size_t bytes);
+
+// Reserves exact room for 'points' points before a stage fills the cloud,
+// advising the buffer for huge pages before it is first touched.
+template <typename PointT>
+void reserveCloud(pcl::PointCloud<PointT>& cloud, std::size_t points, bool huge_pages)
+{
+  if(points <= cloud.points.capacity())
+    return;
+  cloud.points.reserve(points);
+  if(huge_pages)
+    adviseHugePages(cloud.points.data(), cloud.points.capacity() * sizeof(PointT));
+}
+
+class CloudPool
+{
+public:
+  // max_bytes: pooled capacity kept across jobs; larger returns are freed.
+  explicit CloudPool(std::uint64_t max_bytes = std::uint64_t(8) << 30)
+    : state_(new State(max_bytes)) {}
+  ~CloudPool() { clear(); }
+
+  void setHugePages(bool enable) { state_->huge_pages = enable; }
+  bool hugePages() const { return state_->huge_pages; }
+
+  // An empty cloud with room for at least reserve_points points, reusing
+  // the largest pooled buffer of the same point type when there is one.
+  template <typename PointT>
+  typename pcl::PointCloud<PointT>::Ptr acquire(std::size_t reserve_points = 0)
+  {
+    pcl::PointCloud<PointT>* cloud = NULL;
+    {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      typename Free::iterator best = state_->free.end();
+      std::pair<typename Free::iterator, typename Free::iterator> range = state_->free.equal_range(typeid(PointT));
+      for(typename Free::iterator it = range.first; it != range.second; ++it)
+      {
+        if(best == state_->free.end() || it->second.bytes > best->second.bytes)
+          best = it;
+      }
+      if(best != state_->free.end())
+      {
+        cloud = static_cast<pcl::PointCloud<PointT>*>(best->second.cloud);
+        state_->pooled_bytes -= best->second.bytes;
+        state_->free.erase(best);
+        ++state_->reused;
+      }
+      else
+      {
+        ++state_->allocated;
+      }
+    }
+    if(!cloud)
+      cloud = new pcl::PointCloud<PointT>();
+    typename pcl::PointCloud<PointT>::Ptr ptr(cloud, Recycler<PointT>(state_));
+    presize(*ptr, reserve_points);
+    return ptr;
+  }
+
+  // Reserves exact room for 'points' points, advising huge pages if enabled.
+  template <typename PointT>
+  void presize(pcl::PointCloud<PointT>& cloud, std::size_t points) const
+  {
+    reserveCloud(cloud, points, state_->huge_pages);
+  }
+
+  void clear();
+
+  std::uint64_t pooledBytes() const;
+  std::size_t reused() const;
+  std::size_t allocated() const;
+
+private:
+  struct Entry
+  {
+    void* cloud;
+    std::uint64_t bytes;
+    void (*destroy)(void*);
+  };
+  typedef std::multimap<std::type_index, Entry> Free;
+
+  struct State
+  {
+    explicit State(std::uint64_t max)
+      : max_bytes(max), pooled_bytes(0), reused(0), allocated(0), huge_pages(false) {}
+    std::mutex mutex;
+    Free free;
+    std::uint64_t max_bytes;
+    std::uint64_t pooled_bytes;
+    std::size_t reused;
+    std::size_t allocated;
+    bool huge_pages;
+  };
+
+  template <typename PointT>
+  static void destroy(void* cloud) { delete static_cast<pcl::PointCloud<PointT>*>(cloud); }
+
+  // Deleter of pooled Ptrs: clears the cloud and hands it back, or frees it
+  // if the pool is gone or full.
+  template <typename PointT>
+  struct Recycler
+  {
+    explicit Recycler(const std::shared_ptr<State>& state) : state(state) {}
+
+    void operator()(pcl::PointCloud<PointT>* cloud) const
+    {
+      std::shared_ptr<State> pool = state.lock();
+      if(pool)
+      {
+        cloud->points.clear();
+        cloud->width = 0;
+        cloud->height = 0;
+        cloud->header = pcl::PCLHeader();
+        Entry entry;
+        entry.cloud = cloud;
+        entry.bytes = cloud->points.capacity() * sizeof(PointT);
+        entry.destroy = &CloudPool::destroy<PointT>;
+
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if(entry.bytes > 0 && pool->pooled_bytes + entry.bytes <= pool->max_bytes)
+        {
+          pool->free.insert(std::make_pair(std::type_index(typeid(PointT)), entry));
+          pool->pooled_bytes += entry.bytes;
+          return;
+        }
+      }
+      delete cloud;
+    }
+
+    std::weak_ptr<State> state;
+  };
+
+  std::shared_ptr<State> state_;
+};
+
+#endif // MESHPCL_CLOUD_POOL_H
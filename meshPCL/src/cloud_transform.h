@@ -0,0 +1,147 @@
+/*********************************
+      IN-PLACE CLOUD TRANSFORM
+**********************************/
+// Centroid and rigid transform kernels that work on the cloud's own
+// buffer. The centroid is a compensated (Kahan-Babuska) sum in double over
+// fixed tiles, combined in tile order, so the result does not depend on
+// the thread count. The transforms run per tile on the 16-byte aligned
+// xyz1 block every PCL point starts with, which Eigen maps onto SSE/AVX.
+
+#ifndef MESHPCL_CLOUD_TRANSFORM_H
+#define MESHPCL_CLOUD_TRANSFORM_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "parallel.h"
+
+// Points per task of the centroid and transform kernels.
+static const std::size_t TRANSFORM_TILE = 16384;
+
+// Sum of 3-vectors in double with a running compensation term per axis.
+struct KahanSum3
+{
+  double sum[3];
+  double carry[3];
+  std::size_t count;
+
+  KahanSum3() : count(0)
+  {
+    for(int k = 0; k < 3; ++k)
+      sum[k] = carry[k] = 0.0;
+  }
+
+  void add(int k, double value)
+  {
+    double t = sum[k] + value;
+    if(std::fabs(sum[k]) >= std::fabs(value))
+      carry[k] += (sum[k] - t) + value;
+    else
+      carry[k] += (value - t) + sum[k];
+    sum[k] = t;
+  }
+
+  void add(double x, double y, double z)
+  {
+    add(0, x);
+    add(1, y);
+    add(2, z);
+    ++count;
+  }
+
+  void merge(const KahanSum3& other)
+  {
+    for(int k = 0; k < 3; ++k)
+    {
+      add(k, other.sum[k]);
+      add(k, other.carry[k]);
+    }
+    count += other.count;
+  }
+
+  double total(int k) const { return sum[k] + carry[k]; }
+};
+
+namespace cloud_transform_detail
+{
+  // Normals turn with the points; types without normals skip this.
+  template <typename PointT>
+  auto rotateNormal(PointT& p, const Eigen::Matrix4f& m, int) -> decltype(p.getNormalVector4fMap(), void())
+  {
+    Eigen::Vector4f n = p.getNormalVector4fMap();
+    n[3] = 0.0f;
+    p.getNormalVector4fMap() = m * n;
+  }
+
+  template <typename PointT>
+  void rotateNormal(PointT&, const Eigen::Matrix4f&, long) {}
+}
+
+// Centroid of the finite points of 'cloud'. Returns false when there are
+// none, leaving 'centroid' untouched.
+template <typename PointT>
+bool computeCentroidKahan(const pcl::PointCloud<PointT>& cloud, Eigen::Vector3d& centroid)
+{
+  const std::size_t n = cloud.points.size();
+  std::vector<KahanSum3> tiles((n + TRANSFORM_TILE - 1) / TRANSFORM_TILE);
+  const bool dense = cloud.is_dense;
+  parallelFor(0, n, TRANSFORM_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    KahanSum3& tile = tiles[begin / TRANSFORM_TILE];
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      const PointT& p = cloud.points[i];
+      if(!dense && !(std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z)))
+        continue;
+      tile.add(p.x, p.y, p.z);
+    }
+  });
+
+  KahanSum3 total;
+  for(std::size_t t = 0; t < tiles.size(); ++t)
+    total.merge(tiles[t]);
+  if(total.count == 0)
+    return false;
+  for(int k = 0; k < 3; ++k)
+    centroid[k] = total.total(k) / (double) total.count;
+  return true;
+}
+
+// cloud += shift, in place.
+template <typename PointT>
+void translateCloudInPlace(pcl::PointCloud<PointT>& cloud, const Eigen::Vector3f& shift)
+{
+  const Eigen::Vector4f delta(shift[0], shift[1], shift[2], 0.0f);
+  parallelFor(0, cloud.points.size(), TRANSFORM_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    for(std::size_t i = begin; i < end; ++i)
+      cloud.points[i].getVector4fMap() += delta;
+  });
+}
+
+// cloud = transform * cloud, in place; normals are rotated as well.
+template <typename PointT>
+void transformCloudInPlace(pcl::PointCloud<PointT>& cloud, const Eigen::Affine3f& transform)
+{
+  const Eigen::Matrix4f m = transform.matrix();
+  parallelFor(0, cloud.points.size(), TRANSFORM_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      PointT& p = cloud.points[i];
+      Eigen::Vector4f v = p.getVector4fMap();
+      v[3] = 1.0f;
+      p.getVector4fMap() = m * v;
+      cloud_transform_detail::rotateNormal(p, m, 0);
+    }
+  });
+}
+
+#endif // MESHPCL_CLOUD_TRANSFORM_H
@@ -0,0 +1,330 @@
+#include "clusters.h"
+
+#include <pcl/common/io.h>
+#include <pcl/conversions.h>
+#include <pcl/console/print.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+#include "morton_order.h"
+#include "parallel.h"
+#include "task_scheduler.h"
+#include "trace.h"
+
+// Voxels per task of the union pass.
+static const std::size_t CLUSTER_TILE = 4096;
+
+// Voxel coordinates are kept in 21 bits per axis, the Morton code range.
+static const std::int64_t CELL_LIMIT = (std::int64_t(1) << 21) - 1;
+
+// Lock-free union-find over voxel indices; roots are the smallest index of
+// their set, so the final labelling does not depend on thread timing.
+class ConcurrentUnionFind
+{
+public:
+  explicit ConcurrentUnionFind(std::size_t size) : parent_(new std::atomic<std::uint32_t>[size])
+  {
+    for(std::size_t i = 0; i < size; ++i)
+      parent_[i].store((std::uint32_t) i, std::memory_order_relaxed);
+  }
+
+  std::uint32_t find(std::uint32_t x)
+  {
+    for(;;)
+    {
+      std::uint32_t p = parent_[x].load(std::memory_order_relaxed);
+      if(p == x)
+        return x;
+      std::uint32_t gp = parent_[p].load(std::memory_order_relaxed);
+      // path halving; losing the race only costs a longer walk later
+      parent_[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+      x = gp;
+    }
+  }
+
+  void unite(std::uint32_t a, std::uint32_t b)
+  {
+    for(;;)
+    {
+      a = find(a);
+      b = find(b);
+      if(a == b)
+        return;
+      if(a < b)
+        std::swap(a, b);
+      // link the larger root under the smaller one, if it is still a root
+      std::uint32_t expected = a;
+      if(parent_[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel))
+        return;
+    }
+  }
+
+private:
+  std::unique_ptr<std::atomic<std::uint32_t>[]> parent_;
+};
+
+std::size_t euclideanClusters(const pcl::PointCloud<pcl::PointNormal>& cloud, double tolerance,
+  std::size_t min_size, std::vector<std::vector<int> >& clusters)
+{
+  TRACE_SCOPE_VAR(span, "euclideanClusters", cloud.size());
+  clusters.clear();
+  const std::size_t n = cloud.size();
+  if(n == 0 || tolerance <= 0.0)
+    return 0;
+
+  float min[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+  for(std::size_t i = 0; i < n; ++i)
+  {
+    min[0] = std::min(min[0], cloud.points[i].x);
+    min[1] = std::min(min[1], cloud.points[i].y);
+    min[2] = std::min(min[2], cloud.points[i].z);
+  }
+
+  // Points sorted by voxel: Morton codes of the voxel coordinates.
+  const double inverse = 1.0 / tolerance;
+  std::vector<std::uint64_t> codes(n);
+  std::vector<int> order(n);
+  parallelFor(0, n, MORTON_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      const pcl::PointNormal& p = cloud.points[i];
+      std::uint32_t cell[3];
+      const float xyz[3] = { p.x, p.y, p.z };
+      for(int k = 0; k < 3; ++k)
+        cell[k] = (std::uint32_t) std::min<std::int64_t>((std::int64_t) ((xyz[k] - min[k]) * inverse), CELL_LIMIT);
+      codes[i] = mortonEncode(cell[0], cell[1], cell[2]);
+      order[i] = (int) i;
+    }
+  });
+  radixSortMorton(codes, order);
+
+  // Occupied voxels with their point ranges in 'order'.
+  std::vector<std::uint64_t> voxel_codes;
+  std::vector<std::size_t> voxel_first;
+  for(std::size_t i = 0; i < n; ++i)
+  {
+    if(i == 0 || codes[i] != codes[i - 1])
+    {
+      voxel_codes.push_back(codes[i]);
+      voxel_first.push_back(i);
+    }
+  }
+  voxel_first.push_back(n);
+  const std::size_t voxels = voxel_codes.size();
+  std::vector<std::uint64_t>().swap(codes);
+
+  ConcurrentUnionFind sets(voxels);
+  {
+    TRACE_SCOPE_VAR(join, "euclideanClusters/union", voxels);
+    parallelFor(0, voxels, CLUSTER_TILE, [&](std::size_t begin, std::size_t end)
+    {
+      for(std::size_t v = begin; v < end; ++v)
+      {
+        const pcl::PointNormal& p = cloud.points[order[voxel_first[v]]];
+        const float xyz[3] = { p.x, p.y, p.z };
+        std::int64_t cell[3];
+        for(int k = 0; k < 3; ++k)
+          cell[k] = std::min<std::int64_t>((std::int64_t) ((xyz[k] - min[k]) * inverse), CELL_LIMIT);
+        // Each touching pair is joined once, from its lower-coded side;
+        // higher codes sit after v in the sorted voxel list.
+        for(int dz = -1; dz <= 1; ++dz)
+        for(int dy = -1; dy <= 1; ++dy)
+        for(int dx = -1; dx <= 1; ++dx)
+        {
+          const std::int64_t x = cell[0] + dx, y = cell[1] + dy, z = cell[2] + dz;
+          if(x < 0 || y < 0 || z < 0 || x > CELL_LIMIT || y > CELL_LIMIT || z > CELL_LIMIT)
+            continue;
+          const std::uint64_t code = mortonEncode((std::uint32_t) x, (std::uint32_t) y, (std::uint32_t) z);
+          if(code <= voxel_codes[v])
+            continue;
+          std::vector<std::uint64_t>::const_iterator it = std::lower_bound(voxel_codes.begin() + v, voxel_codes.end(), code);
+          if(it != voxel_codes.end() && *it == code)
+            sets.unite((std::uint32_t) v, (std::uint32_t) (it - voxel_codes.begin()));
+        }
+      }
+    });
+  }
+
+  // One cluster per root, points in voxel order.
+  std::vector<std::uint32_t> cluster_of(voxels, std::numeric_limits<std::uint32_t>::max());
+  std::vector<std::vector<int> > all;
+  for(std::size_t v = 0; v < voxels; ++v)
+  {
+    std::uint32_t root = sets.find((std::uint32_t) v);
+    if(cluster_of[root] == std::numeric_limits<std::uint32_t>::max())
+    {
+      cluster_of[root] = (std::uint32_t) all.size();
+      all.push_back(std::vector<int>());
+    }
+    std::vector<int>& members = all[cluster_of[root]];
+    members.insert(members.end(), order.begin() + voxel_first[v], order.begin() + voxel_first[v + 1]);
+  }
+
+  std::size_t dropped = 0;
+  for(std::size_t c = 0; c < all.size(); ++c)
+  {
+    if(all[c].size() >= min_size)
+    {
+      clusters.push_back(std::vector<int>());
+      clusters.back().swap(all[c]);
+    }
+    else
+      dropped += all[c].size();
+  }
+  std::stable_sort(clusters.begin(), clusters.end(), [](const std::vector<int>& a, const std::vector<int>& b)
+  {
+    return a.size() > b.size();
+  });
+
+  pcl::console::print_info("Euclidean clustering: %d clusters of %d voxels, %d points in clusters below %d points\n",
+    (int) clusters.size(), (int) voxels, (int) dropped, (int) min_size);
+  return dropped;
+}
+
+void meshClusters(const pcl::PointCloud<pcl::PointNormal>::Ptr& cloud,
+  const std::vector<std::vector<int> >& clusters, const MeshParams& params,
+  pcl::PolygonMesh& mesh)
+{
+  TRACE_SCOPE_VAR(span, "meshClusters", cloud->size());
+  std::vector<pcl::PolygonMesh> parts(clusters.size());
+  auto meshCluster = [&](std::size_t c)
+  {
+    TRACE_SCOPE_VAR(part, "meshClusters/cluster", clusters[c].size());
+    pcl::PointCloud<pcl::PointNormal>::Ptr part_cloud (new pcl::PointCloud<pcl::PointNormal>);
+    pcl::copyPointCloud(*cloud, clusters[c], *part_cloud);
+    createMesh(part_cloud, params, parts[c]);
+  };
+  if(params.surface_mode == 1)
+  {
+    // Poisson runs one at a time process-wide; scheduler tasks must not wait
+    // on its mutex, so the clusters take turns on this thread instead.
+    for(std::size_t c = 0; c < clusters.size(); ++c)
+      meshCluster(c);
+  }
+  else
+  {
+    // Largest clusters are submitted first so they do not end up last on the critical path.
+    TaskGroup group;
+    for(std::size_t c = 0; c < clusters.size(); ++c)
+      group.run([&, c]() { meshCluster(c); });
+    group.wait();
+  }
+  concatenateMeshes(parts, mesh);
+}
+
+void createClusteredMesh(const pcl::PointCloud<pcl::PointNormal>::Ptr& cloud, const MeshParams& params,
+  double tolerance, std::size_t min_size, pcl::PolygonMesh& mesh)
+{
+  if(tolerance <= 0.0)
+  {
+    pcl::PointCloud<pcl::PointNormal>::Ptr whole = cloud;
+    createMesh(whole, params, mesh);
+    return;
+  }
+  std::vector<std::vector<int> > clusters;
+  euclideanClusters(*cloud, tolerance, min_size, clusters);
+  meshClusters(cloud, clusters, params, mesh);
+}
+
+// Whether two vertex clouds carry the same fields at the same offsets.
+static bool sameLayout(const pcl::PCLPointCloud2& a, const pcl::PCLPointCloud2& b)
+{
+  if(a.point_step != b.point_step || a.fields.size() != b.fields.size())
+    return false;
+  for(std::size_t f = 0; f < a.fields.size(); ++f)
+  {
+    if(a.fields[f].name != b.fields[f].name || a.fields[f].offset != b.fields[f].offset ||
+      a.fields[f].datatype != b.fields[f].datatype || a.fields[f].count != b.fields[f].count)
+      return false;
+  }
+  return true;
+}
+
+void concatenateMeshes(const std::vector<pcl::PolygonMesh>& parts, pcl::PolygonMesh& mesh)
+{
+  TRACE_SCOPE_VAR(span, "concatenateMeshes", parts.size());
+
+  // Poisson emits bare xyz, GP3 and the plane quads carry normals: mixed
+  // parts are all reduced to xyz first.
+  const pcl::PCLPointCloud2* first = NULL;
+  bool mixed = false;
+  for(std::size_t p = 0; p < parts.size(); ++p)
+  {
+    if((std::size_t) parts[p].cloud.width * parts[p].cloud.height == 0)
+      continue;
+    if(!first)
+      first = &parts[p].cloud;
+    else if(!sameLayout(*first, parts[p].cloud))
+      mixed = true;
+  }
+  if(mixed)
+  {
+    std::vector<pcl::PolygonMesh> reduced(parts.size());
+    for(std::size_t p = 0; p < parts.size(); ++p)
+    {
+      if((std::size_t) parts[p].cloud.width * parts[p].cloud.height == 0)
+        continue;
+      pcl::PointCloud<pcl::PointXYZ> xyz;
+      pcl::fromPCLPointCloud2(parts[p].cloud, xyz);
+      pcl::toPCLPointCloud2(xyz, reduced[p].cloud);
+      reduced[p].header = parts[p].header;
+      reduced[p].polygons = parts[p].polygons;
+    }
+    concatenateMeshes(reduced, mesh);
+    return;
+  }
+
+  mesh = pcl::PolygonMesh();
+  std::size_t polygons = 0;
+  std::size_t bytes = 0;
+  const pcl::PolygonMesh* layout = NULL;
+  for(std::size_t p = 0; p < parts.size(); ++p)
+  {
+    const std::size_t count = (std::size_t) parts[p].cloud.width * parts[p].cloud.height;
+    if(count == 0)
+      continue;
+    if(!layout)
+      layout = &parts[p];
+    polygons += parts[p].polygons.size();
+    bytes += parts[p].cloud.data.size();
+  }
+  if(!layout)
+    return;
+
+  mesh.header = layout->cloud.header;
+  mesh.cloud.header = layout->cloud.header;
+  mesh.cloud.fields = layout->cloud.fields;
+  mesh.cloud.is_bigendian = layout->cloud.is_bigendian;
+  mesh.cloud.point_step = layout->cloud.point_step;
+  mesh.cloud.is_dense = layout->cloud.is_dense;
+  mesh.cloud.data.reserve(bytes);
+  mesh.polygons.reserve(polygons);
+
+  std::uint32_t base = 0;
+  for(std::size_t p = 0; p < parts.size(); ++p)
+  {
+    const pcl::PCLPointCloud2& part = parts[p].cloud;
+    const std::uint32_t count = part.width * part.height;
+    if(count == 0)
+      continue;
+    mesh.cloud.data.insert(mesh.cloud.data.end(), part.data.begin(), part.data.end());
+    for(std::size_t f = 0; f < parts[p].polygons.size(); ++f)
+    {
+      pcl::Vertices face = parts[p].polygons[f];
+      for(std::size_t k = 0; k < face.vertices.size(); ++k)
+        face.vertices[k] += base;
+      mesh.polygons.push_back(face);
+    }
+    base += count;
+  }
+  mesh.cloud.width = base;
+  mesh.cloud.height = 1;
+  mesh.cloud.row_step = mesh.cloud.point_step * base;
+}
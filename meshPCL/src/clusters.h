@@ -0,0 +1,47 @@
+/*********************************
+      EUCLIDEAN CLUSTER MESHING
+**********************************/
+// Splits the normal cloud into spatially disconnected parts and meshes
+// each on its own, so several objects become several small Poisson/GP3
+// problems instead of one octree spanning the empty space between them.
+//
+// Points are binned into voxels of edge 'tolerance'. Occupied voxels that
+// touch (26-neighbourhood) are joined with a lock-free union-find run in
+// parallel over the voxels. Two points closer than 'tolerance' therefore
+// always share a cluster; parts further apart than 2 * sqrt(3) * tolerance
+// never do.
+
+#ifndef MESHPCL_CLUSTERS_H
+#define MESHPCL_CLUSTERS_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PolygonMesh.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "pipeline.h"
+
+// Clusters of at least 'min_size' points, largest first, as indices into
+// 'cloud'. Returns the number of points left out in smaller clusters.
+std::size_t euclideanClusters(const pcl::PointCloud<pcl::PointNormal>& cloud, double tolerance,
+  std::size_t min_size, std::vector<std::vector<int> >& clusters);
+
+// Meshes every cluster with createMesh and concatenates the results in
+// cluster order into 'mesh'. GP3 clusters are meshed concurrently; Poisson
+// is serialized process-wide, so its clusters run one after another on the
+// calling thread.
+void meshClusters(const pcl::PointCloud<pcl::PointNormal>::Ptr& cloud,
+  const std::vector<std::vector<int> >& clusters, const MeshParams& params,
+  pcl::PolygonMesh& mesh);
+
+// Meshes 'cloud' in clusters when tolerance > 0, in one piece otherwise.
+void createClusteredMesh(const pcl::PointCloud<pcl::PointNormal>::Ptr& cloud, const MeshParams& params,
+  double tolerance, std::size_t min_size, pcl::PolygonMesh& mesh);
+
+// Appends the vertices and faces of 'parts' into 'mesh'. Parts with
+// differing vertex layouts are reduced to xyz; empty parts are skipped.
+void concatenateMeshes(const std::vector<pcl::PolygonMesh>& parts, pcl::PolygonMesh& mesh);
+
+#endif // MESHPCL_CLUSTERS_H
@@ -0,0 +1,358 @@
+#include "compact_cloud.h"
+
+#include <pcl/console/print.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+
+#include "cloud_io.h"
+#include "parallel.h"
+#include "point_fields.h"
+#include "trace.h"
+
+static const std::int64_t TILE_KEY_BIAS = std::int64_t(1) << 20;
+static const std::int64_t TILE_KEY_MASK = (std::int64_t(1) << 21) - 1;
+
+CompactCloud::CompactCloud(int bits, double precision, bool colored)
+  : bits_(bits == 21 ? 21 : 16), precision_(precision > 0 ? precision : 0.001), colored_(colored), size_(0)
+{
+  frame_[0] = frame_[1] = frame_[2] = 0.0;
+  max_q_ = (std::uint32_t(1) << bits_) - 1;
+  tile_extent_ = precision_ * (double) (std::uint64_t(1) << bits_);
+}
+
+std::uint64_t CompactCloud::bytes() const
+{
+  std::uint64_t bytes = sizeof(*this) + index_.size() * (sizeof(std::int64_t) + sizeof(std::size_t) + sizeof(void*));
+  for(std::size_t t = 0; t < tiles_.size(); ++t)
+  {
+    bytes += sizeof(Tile) + tiles_[t].q16.capacity() * sizeof(std::uint16_t)
+      + tiles_[t].q21.capacity() * sizeof(std::uint64_t) + tiles_[t].rgb.capacity();
+  }
+  return bytes;
+}
+
+std::size_t CompactCloud::tileSize(std::size_t tile) const
+{
+  return bits_ == 21 ? tiles_[tile].q21.size() : tiles_[tile].q16.size() / 3;
+}
+
+void CompactCloud::decode(std::size_t tile, std::size_t i, double xyz[3], unsigned char rgb[3]) const
+{
+  const Tile& t = tiles_[tile];
+  std::uint32_t q[3];
+  if(bits_ == 21)
+  {
+    std::uint64_t packed = t.q21[i];
+    q[0] = (std::uint32_t) (packed & max_q_);
+    q[1] = (std::uint32_t) ((packed >> 21) & max_q_);
+    q[2] = (std::uint32_t) ((packed >> 42) & max_q_);
+  }
+  else
+  {
+    q[0] = t.q16[3 * i];
+    q[1] = t.q16[3 * i + 1];
+    q[2] = t.q16[3 * i + 2];
+  }
+  for(int k = 0; k < 3; ++k)
+    xyz[k] = t.origin[k] + q[k] * precision_;
+  if(colored_)
+  {
+    rgb[0] = t.rgb[3 * i];
+    rgb[1] = t.rgb[3 * i + 1];
+    rgb[2] = t.rgb[3 * i + 2];
+  }
+}
+
+void CompactCloud::setFrame(const Eigen::Vector3d& frame)
+{
+  for(int k = 0; k < 3; ++k)
+    frame_[k] = frame[k];
+}
+
+std::int64_t CompactCloud::tileKey(const double xyz[3]) const
+{
+  std::int64_t key = 0;
+  for(int k = 0; k < 3; ++k)
+  {
+    const std::int64_t cell = (std::int64_t) std::floor(xyz[k] / tile_extent_);
+    key |= ((cell + TILE_KEY_BIAS) & TILE_KEY_MASK) << (21 * k);
+  }
+  return key;
+}
+
+std::size_t CompactCloud::tileIndex(std::int64_t key)
+{
+  std::unordered_map<std::int64_t, std::size_t>::iterator it = index_.find(key);
+  if(it != index_.end())
+    return it->second;
+
+  index_[key] = tiles_.size();
+  tiles_.push_back(Tile());
+  Tile& tile = tiles_.back();
+  for(int k = 0; k < 3; ++k)
+  {
+    const std::int64_t cell = ((key >> (21 * k)) & TILE_KEY_MASK) - TILE_KEY_BIAS;
+    tile.origin[k] = cell * tile_extent_ - frame_[k];
+  }
+  return tiles_.size() - 1;
+}
+
+// Steps of 'precision' from the tile origin, clamped into the tile.
+static inline void quantize(const double xyz[3], const double frame[3], const double origin[3],
+  double precision, std::uint32_t max_q, std::uint32_t q[3])
+{
+  for(int k = 0; k < 3; ++k)
+  {
+    double steps = std::floor((xyz[k] - frame[k] - origin[k]) / precision + 0.5);
+    q[k] = (std::uint32_t) std::min<double>(std::max(steps, 0.0), max_q);
+  }
+}
+
+void CompactCloud::add(const double xyz[3], const unsigned char rgb[3])
+{
+  Tile& tile = tiles_[tileIndex(tileKey(xyz))];
+  std::uint32_t q[3];
+  quantize(xyz, frame_, tile.origin, precision_, max_q_, q);
+  if(bits_ == 21)
+  {
+    tile.q21.push_back((std::uint64_t) q[0] | (std::uint64_t) q[1] << 21 | (std::uint64_t) q[2] << 42);
+  }
+  else
+  {
+    tile.q16.push_back((std::uint16_t) q[0]);
+    tile.q16.push_back((std::uint16_t) q[1]);
+    tile.q16.push_back((std::uint16_t) q[2]);
+  }
+  if(colored_)
+    tile.rgb.insert(tile.rgb.end(), rgb, rgb + 3);
+  ++size_;
+}
+
+void CompactCloud::resizeTile(std::size_t tile, std::size_t points)
+{
+  Tile& t = tiles_[tile];
+  size_ -= tileSize(tile);
+  if(bits_ == 21)
+    t.q21.resize(points);
+  else
+    t.q16.resize(3 * points);
+  if(colored_)
+    t.rgb.resize(3 * points);
+  size_ += points;
+}
+
+void CompactCloud::place(std::size_t tile, std::size_t i, const double xyz[3], const unsigned char rgb[3])
+{
+  Tile& t = tiles_[tile];
+  std::uint32_t q[3];
+  quantize(xyz, frame_, t.origin, precision_, max_q_, q);
+  if(bits_ == 21)
+  {
+    t.q21[i] = (std::uint64_t) q[0] | (std::uint64_t) q[1] << 21 | (std::uint64_t) q[2] << 42;
+  }
+  else
+  {
+    t.q16[3 * i] = (std::uint16_t) q[0];
+    t.q16[3 * i + 1] = (std::uint16_t) q[1];
+    t.q16[3 * i + 2] = (std::uint16_t) q[2];
+  }
+  if(colored_)
+    std::copy(rgb, rgb + 3, t.rgb.begin() + 3 * i);
+}
+
+void CompactCloud::clear()
+{
+  tiles_.clear();
+  index_.clear();
+  size_ = 0;
+}
+
+int loadCompactTextCloud(const std::string& filename, bool with_color,
+  CompactCloud& cloud, Eigen::Vector3d& offset, const CloudRoi& roi)
+{
+  TRACE_SCOPE("loadCompactTextCloud");
+  // Tiles are keyed on file coordinates, which the reader's first pass
+  // already sees, so it also counts every chunk's points per tile.
+  cloud = CompactCloud(cloud.bits(), cloud.precision(), with_color);
+  struct ChunkTile
+  {
+    std::size_t tile;
+    std::size_t next;   // points counted, then the chunk's next slot in the tile
+  };
+  typedef std::unordered_map<std::int64_t, ChunkTile> ChunkTiles;
+  std::vector<ChunkTiles> counts;
+  TextCloudReader::Scan scan;
+  scan.chunks = [&](std::size_t chunks) { counts.resize(chunks); };
+  scan.point = [&](std::size_t c, const double xyz[3]) { ++counts[c][cloud.tileKey(xyz)].next; };
+  TextCloudReader reader;
+  if(reader.open(filename, with_color, roi, scan) < 0)
+    return -1;
+  offset = reader.offset();
+  cloud.setFrame(offset);
+
+  // Tiles sized exactly; each chunk's points start where the previous
+  // chunk's end, so the file order is kept within every tile.
+  std::vector<std::size_t> filled;
+  {
+    TRACE_SCOPE_VAR(size, "loadCompactTextCloud/size", reader.points());
+    for(std::size_t c = 0; c < counts.size(); ++c)
+    {
+      for(ChunkTiles::iterator it = counts[c].begin(); it != counts[c].end(); ++it)
+      {
+        ChunkTile& chunk_tile = it->second;
+        chunk_tile.tile = cloud.tileIndex(it->first);
+        if(filled.size() <= chunk_tile.tile)
+          filled.resize(chunk_tile.tile + 1, 0);
+        const std::size_t points = chunk_tile.next;
+        chunk_tile.next = filled[chunk_tile.tile];
+        filled[chunk_tile.tile] += points;
+      }
+    }
+    for(std::size_t t = 0; t < filled.size(); ++t)
+      cloud.resizeTile(t, filled[t]);
+  }
+
+  TRACE_SCOPE_VAR(parse, "loadCompactTextCloud/parse", reader.points());
+  parallelFor(0, reader.chunks(), 1, [&](std::size_t first, std::size_t last)
+  {
+    for(std::size_t c = first; c < last; ++c)
+    {
+      ChunkTiles& tiles = counts[c];
+      reader.readChunkFile(c, [&](const double xyz[3], const unsigned char rgb[3])
+      {
+        ChunkTile& chunk_tile = tiles.find(cloud.tileKey(xyz))->second;
+        cloud.place(chunk_tile.tile, chunk_tile.next++, xyz, rgb);
+      });
+    }
+  });
+  return 0;
+}
+
+typedef std::array<std::int64_t, 3> VoxelKey;
+
+struct VoxelKeyHash
+{
+  std::size_t operator()(const VoxelKey& key) const
+  {
+    std::uint64_t h = (std::uint64_t) key[0] * 73856093ULL ^ (std::uint64_t) key[1] * 19349663ULL ^ (std::uint64_t) key[2] * 83492791ULL;
+    return (std::size_t) (h ^ (h >> 29));
+  }
+};
+
+struct VoxelSum
+{
+  std::int64_t ijk[3];
+  double xyz[3];
+  std::uint64_t rgb[3];
+  std::uint64_t count;
+
+  bool operator<(const VoxelSum& other) const
+  {
+    return std::lexicographical_compare(ijk, ijk + 3, other.ijk, other.ijk + 3);
+  }
+  bool sameVoxel(const VoxelSum& other) const
+  {
+    return ijk[0] == other.ijk[0] && ijk[1] == other.ijk[1] && ijk[2] == other.ijk[2];
+  }
+  void add(const VoxelSum& other)
+  {
+    for(int k = 0; k < 3; ++k)
+    {
+      xyz[k] += other.xyz[k];
+      rgb[k] += other.rgb[k];
+    }
+    count += other.count;
+  }
+};
+
+template <typename PointT>
+void downSampleCompact(const CompactCloud& cloud,
+  typename pcl::PointCloud<PointT>::Ptr& cloudFiltered, float leafSize)
+{
+  TRACE_SCOPE_VAR(span, "downSampleCompact", cloud.size());
+  const double inverse_leaf = 1.0 / leafSize;
+
+  // Per tile, then merged: voxels on tile borders collect points from both
+  // sides. Memory is per voxel, not per point.
+  std::vector<std::vector<VoxelSum> > per_tile(cloud.tiles());
+  parallelFor(0, cloud.tiles(), 1, [&](std::size_t first, std::size_t last)
+  {
+    for(std::size_t t = first; t < last; ++t)
+    {
+      std::vector<VoxelSum>& sums = per_tile[t];
+      std::unordered_map<VoxelKey, std::size_t, VoxelKeyHash> index;
+      const std::size_t n = cloud.tileSize(t);
+      for(std::size_t i = 0; i < n; ++i)
+      {
+        VoxelSum point;
+        unsigned char rgb[3] = { 0, 0, 0 };
+        cloud.decode(t, i, point.xyz, rgb);
+        VoxelKey key;
+        for(int k = 0; k < 3; ++k)
+        {
+          point.ijk[k] = key[k] = (std::int64_t) std::floor(point.xyz[k] * inverse_leaf);
+          point.rgb[k] = rgb[k];
+        }
+        point.count = 1;
+
+        std::pair<std::unordered_map<VoxelKey, std::size_t, VoxelKeyHash>::iterator, bool> slot =
+          index.insert(std::make_pair(key, sums.size()));
+        if(slot.second)
+          sums.push_back(point);
+        else
+          sums[slot.first->second].add(point);
+      }
+    }
+  });
+
+  std::vector<VoxelSum> voxels;
+  {
+    TRACE_SCOPE_VAR(merge, "downSampleCompact/merge", cloud.tiles());
+    std::size_t total = 0;
+    for(std::size_t t = 0; t < per_tile.size(); ++t)
+      total += per_tile[t].size();
+    voxels.reserve(total);
+    for(std::size_t t = 0; t < per_tile.size(); ++t)
+    {
+      voxels.insert(voxels.end(), per_tile[t].begin(), per_tile[t].end());
+      std::vector<VoxelSum>().swap(per_tile[t]);
+    }
+    std::sort(voxels.begin(), voxels.end());
+  }
+
+  cloudFiltered->points.clear();
+  cloudFiltered->points.reserve(voxels.size());
+  for(std::size_t i = 0; i < voxels.size(); )
+  {
+    VoxelSum sum = voxels[i++];
+    while(i < voxels.size() && voxels[i].sameVoxel(sum))
+      sum.add(voxels[i++]);
+
+    PointT pt;
+    pt.x = (float) (sum.xyz[0] / sum.count);
+    pt.y = (float) (sum.xyz[1] / sum.count);
+    pt.z = (float) (sum.xyz[2] / sum.count);
+    if(cloud.colored())
+    {
+      unsigned char rgb[3];
+      for(int k = 0; k < 3; ++k)
+        rgb[k] = (unsigned char) (sum.rgb[k] / sum.count);
+      setPointColor(pt, rgb);
+    }
+    cloudFiltered->points.push_back(pt);
+  }
+  cloudFiltered->width = (std::uint32_t) cloudFiltered->points.size();
+  cloudFiltered->height = 1;
+  cloudFiltered->is_dense = true;
+
+  std::cerr << "Compact cloud of " << cloud.size() << " points (" << cloud.bytes() / (1 << 20)
+       << " MiB, " << cloud.tiles() << " tiles) after filtering: " << cloudFiltered->size()
+       << " data points." << std::endl;
+}
+
+template void downSampleCompact<pcl::PointXYZ>(const CompactCloud&, pcl::PointCloud<pcl::PointXYZ>::Ptr&, float);
+template void downSampleCompact<pcl::PointXYZRGB>(const CompactCloud&, pcl::PointCloud<pcl::PointXYZRGB>::Ptr&, float);
+template void downSampleCompact<pcl::PointNormal>(const CompactCloud&, pcl::PointCloud<pcl::PointNormal>::Ptr&, float);
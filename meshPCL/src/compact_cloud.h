@@ -0,0 +1,101 @@
+/*********************************
+      COMPACT QUANTIZED CLOUD
+**********************************/
+// Storage for the load and downsample stages of large text clouds. Space
+// is cut into cubic tiles of precision * 2^bits metres. Each point keeps
+// its offset inside its tile quantized to 'precision':
+//
+//   16 bits: three uint16 (6 bytes), 65.5 m tiles at 1 mm
+//   21 bits: one uint64 (8 bytes), 2.1 km tiles at 1 mm
+//
+// plus 3 bytes of RGB when the input has colour, against 32 bytes for a
+// PointXYZRGB. Points are decoded into PCL types only by
+// downSampleCompact, whose output is already the reduced cloud.
+
+#ifndef MESHPCL_COMPACT_CLOUD_H
+#define MESHPCL_COMPACT_CLOUD_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "roi.h"
+
+class CompactCloud
+{
+public:
+  // bits: 16 or 21 per axis.
+  explicit CompactCloud(int bits = 16, double precision = 0.001, bool colored = true);
+
+  int bits() const { return bits_; }
+  double precision() const { return precision_; }
+  bool colored() const { return colored_; }
+  double tileExtent() const { return tile_extent_; }
+
+  std::size_t size() const { return size_; }
+  std::size_t tiles() const { return tiles_.size(); }
+  std::uint64_t bytes() const;
+
+  std::size_t tileSize(std::size_t tile) const;
+  // Decodes point i of a tile; rgb is left untouched for uncoloured clouds.
+  void decode(std::size_t tile, std::size_t i, double xyz[3], unsigned char rgb[3]) const;
+
+  // Coordinates given to add() and place() are 'frame' plus the decoded
+  // ones, so tiles can be keyed before the frame is known. Set while empty.
+  void setFrame(const Eigen::Vector3d& frame);
+
+  void add(const double xyz[3], const unsigned char rgb[3]);
+
+  // Presized filling: tileKey() is thread-safe, tileIndex() appends the
+  // tile on first use, resizeTile() makes room for exactly 'points', and
+  // place() may then write distinct slots concurrently.
+  std::int64_t tileKey(const double xyz[3]) const;
+  std::size_t tileIndex(std::int64_t key);
+  void resizeTile(std::size_t tile, std::size_t points);
+  void place(std::size_t tile, std::size_t i, const double xyz[3], const unsigned char rgb[3]);
+
+  void clear();
+
+private:
+  struct Tile
+  {
+    double origin[3];
+    std::vector<std::uint16_t> q16;  // x y z per point, 16-bit mode
+    std::vector<std::uint64_t> q21;  // x | y << 21 | z << 42, 21-bit mode
+    std::vector<std::uint8_t> rgb;   // r g b per point
+  };
+
+  int bits_;
+  double precision_;
+  bool colored_;
+  double tile_extent_;
+  double frame_[3];
+  std::uint32_t max_q_;
+  std::size_t size_;
+  std::vector<Tile> tiles_;
+  std::unordered_map<std::int64_t, std::size_t> index_;
+};
+
+// Parses an .xyz/.txt file straight into compact storage, without ever
+// holding a full-precision copy. The reader's first pass counts the points
+// of every tile, so tiles are allocated once at their exact size and each
+// chunk decodes into its own range of them. 'offset' and 'roi' as for
+// loadTextCloud.
+int loadCompactTextCloud(const std::string& filename, bool with_color,
+  CompactCloud& cloud, Eigen::Vector3d& offset, const CloudRoi& roi = CloudRoi());
+
+// Voxel-grid downsample with the same global grid and centroid averaging
+// as pcl::VoxelGrid, decoding tiles in parallel. Instantiated for the
+// types in point_fields.h; the averaged colour is kept where PointT has rgb.
+template <typename PointT>
+void downSampleCompact(const CompactCloud& cloud,
+  typename pcl::PointCloud<PointT>::Ptr& cloudFiltered, float leafSize);
+
+#endif // MESHPCL_COMPACT_CLOUD_H
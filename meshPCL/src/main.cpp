@@ -61,17 +61,106 @@
 #include <boost/algorithm/algorithm.hpp>
 #include <boost/thread/thread.hpp>
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <type_traits>
+
+#include "auto_params.h"
+#include "batch.h"
+#include "cloud_io.h"
+#include "cloud_pool.h"
+#include "clusters.h"
+#include "compact_cloud.h"
+#include "memory_report.h"
+#include "merge_clouds.h"
+#include "mesh_metrics.h"
+#include "organized.h"
+#include "pipeline.h"
+#include "planes.h"
+#include "progressive.h"
+#include "result_cache.h"
+#include "sweep.h"
+#include "thumbnail.h"
+#include "trace.h"
 
 void printUsage (const char* progName){
-  std::cout << "\nUsage: " << progName << " <input cloud> <surface method> <leaf size> <output dir>"  << std::endl;
+  std::cout << "\nUsage: " << progName << " <input cloud> [<input cloud> ...] <surface method> <leaf size> <output dir>"  << std::endl;
+  std::cout << "input cloud: .ply, .pcd, .txt, .xyz, or a .lst file with one cloud per line (batch)" << std::endl;
+  std::cout << "  several clouds (one per scanner station, any mix of formats) are loaded in parallel and merged;" << std::endl;
+  std::cout << "  where stations overlap, each voxel keeps the points of the station densest in it" << std::endl;
   std::cout << "surface method: \n '1' for poisson \n '2' for gp3" << std::endl;
+  std::cout << "options:" << std::endl;
+  std::cout << " -trace <file.json>   write a Chrome/Perfetto trace of every stage and print a timing summary" << std::endl;
+  std::cout << " -mem_report <file.json>  record RSS/heap per stage and the size and lifetime of every intermediate buffer" << std::endl;
+  std::cout << " -metrics <file.json>  measure cloud-to-mesh and mesh-to-cloud RMS and Hausdorff distances of the result" << std::endl;
+  std::cout << " -headless            never open a window (implied when DISPLAY is not set)" << std::endl;
+  std::cout << " -thumbnail <file.png>    render an offscreen PNG preview of the mesh" << std::endl;
+  std::cout << " -thumbnail_size <w,h>    thumbnail size in pixels (default 256,256)" << std::endl;
+  std::cout << " -compact <16|21>     keep .txt/.xyz input quantized per tile until downsampling (6 or 8 bytes per point plus colour)" << std::endl;
+  std::cout << " -compact_precision <m>  quantization step for -compact (default 0.001)" << std::endl;
+  std::cout << " -outliers <stat|radius>  remove outliers after downsampling: mean k-NN distance or neighbours within a radius" << std::endl;
+  std::cout << " -outlier_k <n>       stat: neighbours per point (default 8)" << std::endl;
+  std::cout << " -outlier_stddev <x>  stat: keep mean distance <= mean + x * stddev (default 1.0)" << std::endl;
+  std::cout << " -outlier_radius <r>  radius: search radius (default 2 * <leaf size>)" << std::endl;
+  std::cout << " -outlier_min <n>     radius: neighbours required within it (default 2)" << std::endl;
+  std::cout << " -clusters <d>        mesh every Euclidean cluster (gaps wider than d) on its own, concurrently" << std::endl;
+  std::cout << " -cluster_min <n>     clusters: drop clusters with fewer points (default 100)" << std::endl;
+  std::cout << " -planes <n>          replace up to n dominant planes (RANSAC) with quads, mesh only the rest" << std::endl;
+  std::cout << " -plane_distance <d>  planes: inlier distance (default <leaf size>)" << std::endl;
+  std::cout << " -plane_min <n>       planes: stop at planes with fewer inliers (default 1000)" << std::endl;
+  std::cout << " -plane_cell <c>      planes: quad grid cell (default 2 * <leaf size>)" << std::endl;
+  std::cout << " -roi_box <x0,y0,z0,x1,y1,z1>  only load points inside the box (input file coordinates)" << std::endl;
+  std::cout << " -roi_sphere <x,y,z,r>    only load points within r of (x,y,z)" << std::endl;
+  std::cout << " -roi_z <z0,z1>       only load points with z0 <= z <= z1" << std::endl;
+  std::cout << " -roi_hull <x0,y0,x1,y1,...>  only load points inside the XY polygon (3 or more vertices)" << std::endl;
+  std::cout << " -no_organized        mesh organized (grid) .pcd/.ply clouds like unorganized ones" << std::endl;
+  std::cout << " -organized_step <n>  organized: triangle size in grid pixels (default 1)" << std::endl;
+  std::cout << " -organized_max_edge <d>  organized: drop triangles with longer edges (default no limit)" << std::endl;
+  std::cout << " -auto               derive normal k, GP3 radius and Poisson depth from a statistics pass over the cloud" << std::endl;
+  std::cout << " -auto_triangles <n>  auto: also pick the leaf size for about n triangles" << std::endl;
+  std::cout << " -auto_seconds <s>    auto: also pick the leaf size for about s seconds of meshing" << std::endl;
+  std::cout << " -progressive <n>     write n meshes, coarsest first, refining in the background and replacing the output each time" << std::endl;
+  std::cout << " -progressive_seconds <s>  progressive: start no level that would end after s seconds" << std::endl;
+  std::cout << " -cache <dir>         reuse downsampled clouds, normals and meshes of identical input and options from <dir>" << std::endl;
+  std::cout << " -morton              reorder the downsampled cloud along a Morton curve before the neighbour-search stages" << std::endl;
+  std::cout << " -huge_pages          back large intermediate clouds with transparent huge pages" << std::endl;
+  std::cout << " -queue_depth <n>     batch: clouds/meshes buffered between load, mesh and save (default 2)" << std::endl;
+  std::cout << " -workers <n>         batch: clouds meshed concurrently (default 1)" << std::endl;
+  std::cout << " -sweep               mesh every combination of the lists below and write <output dir>/sweep.csv instead of one mesh" << std::endl;
+  std::cout << " -sweep_leaf <a,b,..>     leaf sizes (default <leaf size>)" << std::endl;
+  std::cout << " -sweep_mode <a,b,..>     surface methods (default <surface method>)" << std::endl;
+  std::cout << " -sweep_k <a,b,..>        normal estimation k (default 5)" << std::endl;
+  std::cout << " -sweep_depth <a,b,..>    poisson depths (default 7)" << std::endl;
+  std::cout << " -sweep_radius <a,b,..>   gp3 search radii (default 10)" << std::endl;
   //std::cout << "normal estimation method: \n '1' for normal estimation \n '2' for mls normal estimation" << std::endl;
 }
 
-void vizualizeMesh(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud,pcl::PolygonMesh &mesh)
+// Original cloud in yellow when it has no colour of its own.
+template <typename PointT>
+void addOriginalCloud(pcl::visualization::PCLVisualizer& viewer, typename pcl::PointCloud<PointT>::Ptr & cloud, int port)
+{
+  pcl::visualization::PointCloudColorHandlerCustom<PointT> color_handler(cloud,255,255,0);
+  viewer.addPointCloud(cloud,color_handler,"original_cloud",port);
+}
+
+template <>
+void addOriginalCloud<pcl::PointXYZRGB>(pcl::visualization::PCLVisualizer& viewer, pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud, int port)
+{
+  if(cloud->points[0].r <= 0 and cloud->points[0].g <= 0 and cloud->points[0].b<= 0 ){
+    pcl::visualization::PointCloudColorHandlerCustom<pcl::PointXYZRGB> color_handler(cloud,255,255,0);
+    viewer.removeAllPointClouds(0);
+    viewer.addPointCloud(cloud,color_handler,"original_cloud",port);
+  }else{
+    viewer.addPointCloud(cloud,"original_cloud",port);
+  }
+}
+
+template <typename PointT>
+void vizualizeMesh(typename pcl::PointCloud<PointT>::Ptr & cloud,pcl::PolygonMesh &mesh)
 {
 
   boost::shared_ptr<pcl::visualization::PCLVisualizer> viewer (new pcl::visualization::PCLVisualizer ("MAP3D MESH"));
@@ -99,13 +188,7 @@ void vizualizeMesh(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud,pcl::PolygonMe
   viewer->addText3D("y", p2, 0.2, 0, 1, 0, "y_");
   viewer->addText3D ("z", p3, 0.2, 0, 0, 1, "z_");
 
-  if(cloud->points[0].r <= 0 and cloud->points[0].g <= 0 and cloud->points[0].b<= 0 ){
-    pcl::visualization::PointCloudColorHandlerCustom<pcl::PointXYZRGB> color_handler(cloud,255,255,0);
-    viewer->removeAllPointClouds(0);
-    viewer->addPointCloud(cloud,color_handler,"original_cloud",PORT1);
-  }else{
-    viewer->addPointCloud(cloud,"original_cloud",PORT1);
-  }
+  addOriginalCloud<PointT>(*viewer, cloud, PORT1);
     
   viewer->initCameraParameters ();
   viewer->resetCamera();
@@ -169,444 +252,702 @@ void vizualizeClouds(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud,
   }
 }
 
-/*
-void cloudPointFilter(pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud,pcl::PointCloud<pcl::PointXYZ>::Ptr& filterCloud){
-
-  std::cout << "Filtering point cloud..." << std::endl;
-  std::cout << "Point cloud before filter:" << cloud->points.size()<< std::endl;
-
-  pcl::RadiusOutlierRemoval<pcl::PointXYZ> radius_outlier_removal;
-  radius_outlier_removal.setInputCloud(cloud);
-  radius_outlier_removal.setRadiusSearch(0.01);
-  radius_outlier_removal.setMinNeighborsInRadius(1);
-  radius_outlier_removal.filter(*filterCloud);
-
-  std::cout << "Point cloud after filter:" << filterCloud->points.size() << std::endl;
+void writeTrace(const std::string& trace_file)
+{
+  std::cout << std::endl;
+  Tracer::instance().printSummary(std::cout);
+  if(Tracer::instance().writeChromeTrace(trace_file))
+    pcl::console::print_info("Trace written to %s\n", trace_file.c_str());
+  else
+    pcl::console::print_error("Could not write trace to %s\n", trace_file.c_str());
 }
-*/
 
-void downSample(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud,
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloudFiltered,
-  float leafSize)
+// Everything the single-cloud path needs once the arguments are parsed.
+struct RunOptions
 {
+  std::string input;
+  std::vector<std::string> inputs;   // every input; more than one are merged
+  bool file_is_txt;
+  bool file_is_xyz;
+  float leaf_size;
+  MeshParams mesh;   // surface_mode from the command line, the rest default or from -auto
+  std::string output_dir;
+  bool headless;
+  bool huge_pages;
+  bool morton;
+  OutlierParams outliers;
+  double cluster_tolerance;
+  int cluster_min;
+  PlaneParams planes;
+  int compact_bits;
+  double compact_precision;
+  std::string thumbnail_file;
+  std::vector<int> thumbnail_size;
+  std::string trace_file;
+  std::string mem_report_file;
+  std::string metrics_file;
+  CloudRoi roi;
+  AutoTarget auto_target;
+  ProgressiveParams progressive;
+  bool organized;
+  OrganizedParams organized_params;
+  std::string cache_dir;
+};
+
+// Cache keys of the stages meshCloudFile can skip, each chained on the
+// previous one so that any change upstream invalidates everything after it.
+struct StageKeys
+{
+  std::string downsample;
+  std::string normals;
+  std::string mesh;
+};
 
-  pcl::VoxelGrid<pcl::PointXYZRGB> sor;
-  // pcl::toPCLPointCloud2(cloud, point_cloud2);
-  sor.setInputCloud (cloud);
-  sor.setLeafSize (leafSize, leafSize, leafSize); // was 0.85f
-  sor.filter(*cloudFiltered);
-
-
-  std::cerr << "PointCloud before filtering: " << cloud->width * cloud->height 
-       << " data points (" << pcl::getFieldsList (*cloud) << ")." << std::endl;
-  std:cerr << "" << std::endl;
-  std::cerr << "PointCloud after filtering: " << cloudFiltered->width * cloudFiltered->height 
-       << " data points (" << pcl::getFieldsList (*cloudFiltered) << ")." << std::endl;
+template <typename PointT>
+StageKeys stageKeys(const RunOptions& options, const std::string& input_hash)
+{
+  StageKeys keys;
+  std::ostringstream params;
+  params.precision(17);
+  const CloudRoi& roi = options.roi;
+  params << cloudPointTypeName(CloudPointTypeOf<PointT>::value) << ' ' << options.file_is_txt
+    << " leaf " << options.leaf_size << " compact " << options.compact_bits << ' ' << options.compact_precision
+    << " roi " << roi.has_box << ' ' << roi.box_min.transpose() << ' ' << roi.box_max.transpose()
+    << ' ' << roi.has_sphere << ' ' << roi.center.transpose() << ' ' << roi.radius
+    << ' ' << roi.has_z << ' ' << roi.z_min << ' ' << roi.z_max;
+  for(std::size_t i = 0; i < roi.hull.size(); ++i)
+    params << ' ' << roi.hull[i].transpose();
+  keys.downsample = ResultCache::key(input_hash, "downsample", params.str());
+
+  params.str("");
+  const OutlierParams& outliers = options.outliers;
+  params << "morton " << options.morton << " outliers " << outliers.mode << ' ' << outliers.mean_k << ' '
+    << outliers.stddev_mul << ' ' << outliers.radius << ' ' << outliers.min_neighbors
+    << " k " << options.mesh.normal_k << " mls " << options.mesh.mls_radius;
+  keys.normals = ResultCache::key(keys.downsample, "normals", params.str());
+
+  params.str("");
+  const MeshParams& mesh = options.mesh;
+  const PlaneParams& planes = options.planes;
+  const OrganizedParams& grid = options.organized_params;
+  params << "mode " << mesh.surface_mode << ' ' << mesh.poisson_depth << ' ' << mesh.gp3_radius
+    << " clusters " << options.cluster_tolerance << ' ' << options.cluster_min
+    << " planes " << planes.max_planes << ' ' << planes.distance << ' ' << planes.max_angle << ' '
+    << planes.min_points << ' ' << planes.hypotheses << ' ' << planes.cell
+    << " organized " << options.organized << ' ' << grid.pixel_step << ' ' << grid.max_depth_change << ' '
+    << grid.smoothing << ' ' << grid.max_edge;
+  keys.mesh = ResultCache::key(keys.normals, "mesh", params.str());
+  return keys;
 }
 
-void decreaseRadius(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud, 
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloudReduced)
+// Parses the input into 'cloud', or into 'compact' when use_compact.
+// Several inputs are merged into 'cloud', file f from slices[f] on.
+template <typename PointT>
+static int loadInput(const RunOptions& options, MemoryReport& memory, typename pcl::PointCloud<PointT>::Ptr& cloud,
+  CompactCloud& compact, bool use_compact, Eigen::Vector3d& load_origin, std::vector<std::size_t>& slices)
 {
-  //searchPoint
-  pcl::PointXYZRGB searchPoint = cloud->at(0) ;
-
-  //result from radiusSearch()
-  std::vector<int> pointIdxRadiusSearch;
-  std::vector<float> pointRadiusSquaredDistance;
+  MemoryStageScope load_mem(memory, "load");
+  TRACE_SCOPE_VAR(load_span, "load", -1);
+	pcl::console::print_highlight("Loading ");
 
-  //kdTree
-  pcl::KdTreeFLANN<pcl::PointXYZRGB> kdtree;
-  kdtree.setInputCloud (cloud);
-  kdtree.setSortedResults(true);
+	if(use_compact)
+	{
+		if(loadCompactTextCloud(options.input, options.file_is_txt, compact, load_origin, options.roi) < 0)
+		{
+			return -1;
+		}
+		TRACE_SET_POINTS(load_span, compact.size());
+		memory.useBuffer("compact", compact.bytes());
+	}
+	else
+	{
+		if(options.compact_bits != 0)
+		{
+			pcl::console::print_warn("-compact applies to a single .txt/.xyz input without -sweep, loading normally\n");
+		}
+		if(options.inputs.size() > 1)
+		{
+			if(loadClouds<PointT>(options.inputs, cloud, slices, load_origin, options.roi) < 0)
+			{
+				return -1;
+			}
+		}
+		else if(loadCloud<PointT>(options.input, cloud, load_origin, options.roi) < 0)
+		{
+			return -1;
+		}
+		TRACE_SET_POINTS(load_span, cloud->size());
+		memory.useBuffer("cloud", cloudBytes(*cloud));
+	}
+	return 0;
+}
 
-  if ( kdtree.radiusSearch (searchPoint, 100, pointIdxRadiusSearch, pointRadiusSquaredDistance) > 0 )
+// Load, mesh, save and show one cloud with PointT as picked by
+// detectPointType; no other point type is materialized on the way.
+// 'options' is a copy: -auto replaces its leaf size and mesh parameters.
+template <typename PointT>
+int meshCloudFile(RunOptions options, MemoryReport& memory)
+{
+  typename pcl::PointCloud<PointT>::Ptr cloud (new pcl::PointCloud<PointT>());
+
+  // Local frame origin of the cloud, in input coordinates.
+  Eigen::Vector3d origin = Eigen::Vector3d::Zero();
+  // Quantized input when -compact applies; cloud then stays empty until downsampling.
+  CompactCloud compact(options.compact_bits, options.compact_precision);
+  bool use_compact = options.compact_bits != 0 and (options.file_is_txt or options.file_is_xyz);
+
+  // Frame origin of the loaded cloud; the cache already holds the one of its results.
+  Eigen::Vector3d load_origin = Eigen::Vector3d::Zero();
+  // First point of every input file when several are merged, else empty.
+  std::vector<std::size_t> slices;
+  bool loaded = false;
+  if(options.auto_target.enabled)
   {
-    //delete every point in target
-    for (size_t j = 0; j < pointIdxRadiusSearch.size (); ++j)
+    // The picked parameters are part of the cache keys, so the points come first.
+    if(loadInput<PointT>(options, memory, cloud, compact, use_compact, load_origin, slices) < 0)
+    {
+      return -1;
+    }
+    loaded = true;
+    CloudStats stats;
     {
-      cloudReduced->push_back(cloud->points[pointIdxRadiusSearch[j]]);
+      MemoryStageScope mem(memory, "scanCloudStats");
+      if(use_compact)
+        scanCloudStats(compact, stats);
+      else
+        scanCloudStats<PointT>(*cloud, stats);
     }
+    printCloudStats(std::cout, stats);
+    chooseParams(stats, options.auto_target, options.leaf_size, options.mesh);
+    pcl::console::print_info("Auto parameters: leaf %g, normal k %d, MLS radius %g, GP3 radius %g, Poisson depth %d\n",
+      options.leaf_size, options.mesh.normal_k, options.mesh.mls_radius, options.mesh.gp3_radius, options.mesh.poisson_depth);
   }
-}
-
-void calculateNormals(pcl::PointCloud<pcl::PointXYZ>::Ptr& inputCloud,
-  pcl::PointCloud<pcl::PointNormal>::Ptr& outputCloud)
-{
-  std::cout << "Input dimension" << inputCloud->size()<<std::endl;
-  pcl::search::KdTree<pcl::PointXYZ>::Ptr kdTree (new pcl::search::KdTree<pcl::PointXYZ>);
-  kdTree->setInputCloud(inputCloud);
-
-  //Normal Estimation
-  std::cout << "Using normal method estimation...";
-  pcl::NormalEstimationOMP<pcl::PointXYZ, pcl::Normal> estimator;
-  estimator.setNumberOfThreads(3);
-  pcl::PointCloud<pcl::Normal>::Ptr normals (new pcl::PointCloud<pcl::Normal>);
-  estimator.setInputCloud(inputCloud);
-  estimator.setSearchMethod(kdTree);
-  estimator.setKSearch(5); //It was 20
-  estimator.compute(*normals);//Normals are estimated using standard method.
-
-  // pcl::PointCloud<pcl::PointNormal>::Ptr cloud_with_normals (new pcl::PointCloud<pcl::PointNormal> ());
-  pcl::concatenateFields(*inputCloud, *normals, *outputCloud);
-
-  std::cout << "Normal Estimation...[OK]" << std::endl;
-}
 
-void applySurfaceApproximation(pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud,
-  pcl::PointCloud<pcl::PointXYZ>::Ptr & outCloud)
-{
-
-  /* ****kdtree search and msl object**** */
-  pcl::search::KdTree<pcl::PointXYZ>::Ptr kdTree (new pcl::search::KdTree<pcl::PointXYZ>);
-  kdTree->setInputCloud(cloud);
-
-  std::cout << "Using MLS for Surface Approximation...";
-
-  pcl::PointCloud<pcl::PointXYZ>::Ptr mls_points (new pcl::PointCloud<pcl::PointXYZ>());
-  pcl::MovingLeastSquares<pcl::PointXYZ, pcl::PointXYZ> mls;       
-  mls.setNumberOfThreads(3);
-
-  // mls.setComputeNormals(true);
-  mls.setInputCloud(cloud); //ORIGINAL
-  // Set parameters
-  mls.setDilationIterations(10);
-  mls.setDilationVoxelSize(0.5);
-  mls.setSqrGaussParam(2.0);
-  mls.setUpsamplingRadius(5);
-  mls.setPolynomialOrder (2); 
-  mls.setPointDensity(30);
-
-  mls.setSearchMethod(kdTree);
-  mls.setSearchRadius(0.4);
-  mls.process(*mls_points);
-
-  pcl::PointCloud<pcl::PointXYZ>::Ptr temp(new pcl::PointCloud<pcl::PointXYZ>());
-  // pcl::PointCloud<pcl::PointXYZ>::Ptr outputCloud(new pcl::PointCloud<pcl::PointXYZ>());
-
-  for(int i = 0; i < mls_points->points.size(); i++)
+  // Coarse-to-fine levels are written as they complete and never cached.
+  const bool progressive = options.progressive.levels > 1;
+  if(progressive and not options.cache_dir.empty())
   {
-    pcl::PointXYZ pt;
-    pt.x = cloud->points[i].x; 
-    pt.y = cloud->points[i].y; 
-    pt.z = cloud->points[i].z;
-    temp->points.push_back(pt);            
+    pcl::console::print_warn("-cache does not apply to -progressive runs\n");
+    options.cache_dir.clear();
   }
 
-  pcl::concatenateFields (*temp, *mls_points, *outCloud);
-  // pcl::copyPointCloud(*outputCloud,*cloud);
-  std::cout << "MLS Surface Approximation...[OK]" << std::endl;
-}
-
-// void ballPivotingSurfaceReconstruction(){
+  // Latest cached stage for this input and these options, looked up before
+  // loading: headless runs that hit the cache never parse the input.
+  ResultCache cache(options.cache_dir);
+  StageKeys keys;
+  typename pcl::PointCloud<PointT>::Ptr cached_down (new pcl::PointCloud<PointT>());
+  pcl::PointCloud<pcl::PointNormal>::Ptr cached_normals (new pcl::PointCloud<pcl::PointNormal>());
+  pcl::PolygonMesh cloud_mesh;
+  bool mesh_cached = false, normals_cached = false, down_cached = false;
+  if(cache.enabled())
+  {
+    // Merged inputs key on their content hashes in order.
+    std::string input_hash;
+    for(std::size_t f = 0; f < options.inputs.size(); ++f)
+    {
+      std::string file_hash = hashFileContents(options.inputs[f]);
+      if(file_hash.empty())
+      {
+        pcl::console::print_error("Error. could not read %s\n", options.inputs[f].c_str());
+        return -1;
+      }
+      input_hash += file_hash;
+    }
+    keys = stageKeys<PointT>(options, input_hash);
+    mesh_cached = cache.loadMesh(keys.mesh, cloud_mesh, origin);
+    normals_cached = not mesh_cached and cache.loadCloud<pcl::PointNormal>(keys.normals, *cached_normals, origin);
+    down_cached = not mesh_cached and not normals_cached and cache.loadCloud<PointT>(keys.downsample, *cached_down, origin);
+  }
+  const bool cached = mesh_cached or normals_cached or down_cached;
 
-// }
+  if(not loaded and (not cached or not options.headless or not options.metrics_file.empty()))
+  {
+    if(loadInput<PointT>(options, memory, cloud, compact, use_compact, load_origin, slices) < 0)
+    {
+      return -1;
+    }
+  }
+  if(not cached)
+  {
+    origin = load_origin;
+  }
 
-void createMesh(pcl::PointCloud<pcl::PointNormal>::Ptr& inputCloud,int& surface_mode,pcl::PolygonMesh& triangles)
-{
+  const bool organized = not mesh_cached and not use_compact and options.organized and cloud->height > 1;
+  if(mesh_cached){
+  	pcl::console::print_info("Mesh served from the cache\n");
+  } else if(use_compact or cloud -> height <= 1){
+  	pcl::console::print_info("Point cloud is unorganized\n");
+  } else if(organized) {
+  	pcl::console::print_info("Point cloud is organized\n");
+  } else {
+  	pcl::console::print_info("Point cloud is organized, meshing it as unorganized (-no_organized)\n");
+  }
 
-  bool gp3_mode = false;
-  bool poisson_mode = false;
-  bool rolling_ball_mode = false;
+  std::string output_dir = options.output_dir + "/cloud_mesh.ply";
+  const bool progressive_run = progressive and not mesh_cached and not organized;
 
-  if(surface_mode == 1)
+  if(mesh_cached)
   {
-    poisson_mode = true;
+    memory.useBuffer("cloud_mesh", meshBytes(cloud_mesh));
   }
-  else if(surface_mode == 2)
+  else if(progressive_run)
   {
-    gp3_mode = true;
+    typename ProgressiveMesher<PointT>::Source source = [&](float leaf, typename pcl::PointCloud<PointT>::Ptr& level)
+    {
+      level.reset(new pcl::PointCloud<PointT>);
+      if(use_compact)
+        downSampleCompact<PointT>(compact, level, leaf);
+      else
+        downSampleMerged<PointT>(cloud, slices, level, leaf);
+    };
+    ProgressiveMesher<PointT> mesher(source, options.progressive, options.leaf_size, options.mesh,
+      options.outliers, options.planes, options.cluster_tolerance, options.cluster_min, options.morton,
+      origin, output_dir);
+    {
+      MemoryStageScope mem(memory, "progressiveCoarse");
+      if(not mesher.start())
+        return -1;
+    }
+    if(not options.headless)
+    {
+      // The coarse mesh is on screen while the finer levels are computed.
+      pcl::PolygonMesh preview = mesher.preview();
+      vizualizeMesh<PointT>(cloud, preview);
+    }
+    {
+      MemoryStageScope mem(memory, "progressiveRefine");
+      const int written = mesher.wait(cloud_mesh, origin);
+      pcl::console::print_info("Progressive meshing wrote %d of %d levels\n", written, options.progressive.levels);
+      memory.useBuffer("cloud_mesh", meshBytes(cloud_mesh));
+    }
   }
-  else if(surface_mode == 3)
+  else if(organized)
   {
-    rolling_ball_mode = true;
+    // Grid neighbourhoods replace downsampling, the kd-tree and Poisson.
+    pcl::PointCloud<pcl::PointNormal>::Ptr cloud_normals (new pcl::PointCloud<pcl::PointNormal>);
+    {
+      MemoryStageScope mem(memory, "organizedNormals");
+      organizedNormals<PointT>(cloud, options.organized_params, cloud_normals);
+      memory.useBuffer("cloud", cloudBytes(*cloud));
+      memory.useBuffer("cloud_normals", cloudBytes(*cloud_normals));
+    }
+    {
+      MemoryStageScope mem(memory, "organizedMesh");
+      organizedMesh(cloud_normals, options.organized_params, cloud_mesh);
+      memory.useBuffer("cloud_normals", cloudBytes(*cloud_normals));
+      memory.useBuffer("cloud_mesh", meshBytes(cloud_mesh));
+    }
   }
   else
   {
-    std::cout << "Select: \n'1' for surface poisson method \n '2' for surface gp3 method " << std::endl;
-    std::exit(-1);
-  }
+    // Intermediate clouds are presized before each stage; only batch mode
+    // has later jobs to hand them on to through a CloudPool.
+    pcl::PointCloud<pcl::PointNormal>::Ptr cloud_normals (new pcl::PointCloud<pcl::PointNormal>);
+    typename pcl::PointCloud<PointT>::Ptr cloud_out (new pcl::PointCloud<PointT>);
 
-  // Create search tree*
-  pcl::search::KdTree<pcl::PointNormal>::Ptr kdtree_normals (new pcl::search::KdTree<pcl::PointNormal>);
-  std::cout << inputCloud-> width << std::endl;
-  kdtree_normals->setInputCloud(inputCloud);
-
-  std::cout << "Applying surface meshing...";
+    if(normals_cached)
+    {
+      cloud_normals = cached_normals;
+    }
+    else
+    {
+      if(down_cached)
+      {
+        cloud_out = cached_down;
+        if(use_compact)
+          cloud = cloud_out;
+      }
+      else if(use_compact)
+      {
+        MemoryStageScope mem(memory, "downSampleCompact");
+        downSampleCompact<PointT>(compact, cloud_out, options.leaf_size);
+        memory.useBuffer("compact", compact.bytes());
+        memory.useBuffer("cloud_out", cloudBytes(*cloud_out));
+        compact.clear();
+        // the full cloud was never decoded; the viewer shows the downsampled one
+        cloud = cloud_out;
+      }
+      else
+      {
+        MemoryStageScope mem(memory, "downSample");
+        downSampleMerged<PointT>(cloud, slices, cloud_out, options.leaf_size);
+        memory.useBuffer("cloud", cloudBytes(*cloud));
+        memory.useBuffer("cloud_out", cloudBytes(*cloud_out));
+      }
+      if(not down_cached)
+      {
+        cache.storeCloud<PointT>(keys.downsample, *cloud_out, origin);
+      }
+      if(options.morton)
+      {
+        MemoryStageScope mem(memory, "reorderCloud");
+        std::vector<int> order;
+        reorderCloud<PointT>(cloud_out, order);
+        memory.useBuffer("cloud_out", cloudBytes(*cloud_out));
+      }
+      {
+        MemoryStageScope mem(memory, "translateCloud");
+        translateCloud<PointT>(cloud_out, origin);
+        memory.useBuffer("cloud_out", cloudBytes(*cloud_out));
+      }
+      // One kd-tree over the translated cloud serves outlier removal and normals.
+      typename pcl::search::Search<PointT>::Ptr search_index = buildSearchIndex<PointT>(cloud_out);
+      if(options.outliers.mode != OUTLIERS_NONE)
+      {
+        MemoryStageScope mem(memory, "filterOutliers");
+        filterOutliers<PointT>(cloud_out, options.outliers, search_index);
+        memory.useBuffer("cloud_out", cloudBytes(*cloud_out));
+      }
+      {
+        MemoryStageScope mem(memory, "calculateNormals");
+        // input normals are used in place, nothing to presize for them
+        if(not std::is_same<PointT, pcl::PointNormal>::value)
+          reserveCloud(*cloud_normals, cloud_out->size(), options.huge_pages);
+        meshNormals<PointT>(cloud_out, cloud_normals, options.mesh.normal_k, search_index);
+        memory.useBuffer("cloud_out", cloudBytes(*cloud_out));
+        memory.useBuffer("cloud_normals", cloudBytes(*cloud_normals));
+      }
+  
+      std::cout << cloud-> width << std::endl;
+      std::cout << cloud_out-> width << std::endl;
+      cache.storeCloud<pcl::PointNormal>(keys.normals, *cloud_normals, origin);
+    }
 
-  if(gp3_mode)
+    {
+      MemoryStageScope mem(memory, "createMesh");
+      createPlanarMesh(cloud_normals,options.planes,options.mesh,options.cluster_tolerance,options.cluster_min,cloud_mesh);
+      memory.useBuffer("cloud_normals", cloudBytes(*cloud_normals));
+      memory.useBuffer("cloud_mesh", meshBytes(cloud_mesh));
+    }
+  }
+  if(not mesh_cached)
   {
-    std::cout << "Using surface method: gp3 ..." << std::endl;
-
-    int searchK = 100;
-    int search_radius = 10;
-    int setMU = 5;
-    int maxiNearestNeighbors = 584682;
-    bool normalConsistency = false;
+    cache.storeMesh(keys.mesh, cloud_mesh, origin);
+  }
 
-    pcl::GreedyProjectionTriangulation<pcl::PointNormal> gp3;
+  std::string sav = "saved mesh in:";
+  sav += output_dir;
 
-    gp3.setSearchRadius(search_radius);//It was 0.025
-    gp3.setMu(setMU); //It was 2.5
-    gp3.setMaximumNearestNeighbors(maxiNearestNeighbors);    //It was 100
-    gp3.setMaximumSurfaceAngle(M_PI/4); // 45 degrees    //it was 4
-    gp3.setMinimumAngle(M_PI/18); // 10 degrees //It was 18
-    gp3.setMaximumAngle(M_PI/1.5); // 120 degrees        //it was 1.5
-    gp3.setNormalConsistency(normalConsistency); //It was false
-    gp3.setInputCloud(inputCloud);
-    gp3.setSearchMethod(kdtree_normals);
-    gp3.reconstruct(triangles);
+  //COMMENTED OUT CODE
+  //typedef pcl::geometry::DefaultMeshTraits <>      MeshTraits;
+  //COMMENTED OUT CODE
+  //typedef pcl::geometry::TriangleMesh <MeshTraits> Mesh;
+  //COMMENTED OUT CODE
+  //typedef pcl::geometry::MeshIO <Mesh>             MeshIO;
 
-    vtkSmartPointer<vtkPolyData> polydata = vtkSmartPointer<vtkPolyData>::New();
-    pcl::PolygonMesh mesh_pcl;
-    //pcl::VTKUtils::convertToVTK(triangles,polydata);
-    pcl::VTKUtils::convertToPCL(polydata,mesh_pcl);
+  pcl::console::print_info(sav.c_str());
+  std::cout << std::endl;
 
-    pcl::io::savePolygonFilePLY("mesh.ply", mesh_pcl);
+  if(not progressive_run)
+  {
+    MemoryStageScope mem(memory, "savePLYFileBinary");
+    TRACE_SCOPE_VAR(span, "savePLYFileBinary", cloud_mesh.cloud.width * cloud_mesh.cloud.height);
+    saveMeshPLYBinary(output_dir, cloud_mesh, origin);
+    memory.useBuffer("cloud_mesh", meshBytes(cloud_mesh));
+  }
 
-    std::cout << "OK" << std::endl;
+  if(not options.metrics_file.empty())
+  {
+    // Compact input is only ever decoded downsampled, in the local frame.
+    const Eigen::Vector3d cloud_origin = use_compact ? origin : load_origin;
+    MeshMetrics metrics;
+    MemoryStageScope mem(memory, "computeMeshMetrics");
+    if(not computeMeshMetrics<PointT>(*cloud, cloud_origin - origin, cloud_mesh, metrics))
+      pcl::console::print_warn("No cloud or no faces to measure the mesh against\n");
+    else
+    {
+      if(use_compact)
+        pcl::console::print_warn("-compact input is measured against the downsampled cloud\n");
+      printMeshMetrics(std::cout, metrics);
+      if(writeMeshMetricsJson(options.metrics_file, metrics))
+        pcl::console::print_info("Mesh metrics written to %s\n", options.metrics_file.c_str());
+      else
+        pcl::console::print_error("Could not write mesh metrics to %s\n", options.metrics_file.c_str());
+    }
   }
-  else if(poisson_mode)
+
+  if(memory.enabled())
   {
-    std::cout << "Using surface method: poisson ..." << std::endl;
+    // vizualizeMesh still shows the original cloud once the report is out.
+    memory.useBuffer("cloud", cloudBytes(*cloud));
+    std::cout << std::endl;
+    memory.printSummary(std::cout);
+    if(memory.writeJson(options.mem_report_file))
+      pcl::console::print_info("Memory report written to %s\n", options.mem_report_file.c_str());
+    else
+      pcl::console::print_error("Could not write memory report to %s\n", options.mem_report_file.c_str());
+  }
 
-    int nThreads=8;
-    int setKsearch=10;
-    int depth=7; //typical 9
-    float pointWeight=4.0;
-    float samplePNode=1.5; // typical 1.5
-    float scale=0.4; //typical 1.1
-    int isoDivide=8;
-    bool confidence=true;
-    bool outputPolygons=true;
-    bool manifold=true;
-    int solverDivide=8;
+  if(Tracer::instance().enabled())
+  {
+    writeTrace(options.trace_file);
+  }
+  //COMMENTED OUT CODE
+  //pcl::io::savePolygonFilePLY(output_dir.c_str(),cloud_mesh,true);
+           
+           
+  vtkObject::GlobalWarningDisplayOff(); // Disable vtk render warning   
 
-    pcl::Poisson<pcl::PointNormal> poisson;
+  if(not options.thumbnail_file.empty())
+  {
+    MemoryStageScope mem(memory, "renderMeshThumbnail");
+    if(renderMeshThumbnail(cloud_mesh, options.thumbnail_file, options.thumbnail_size[0], options.thumbnail_size[1]) == 0)
+      pcl::console::print_info("Thumbnail written to %s\n", options.thumbnail_file.c_str());
+  }
 
-    poisson.setDepth(depth);//9
-    poisson.setInputCloud(inputCloud);
-    poisson.setPointWeight(pointWeight);//4
-    poisson.setDegree(2);
-    poisson.setSamplesPerNode(samplePNode);//1.5
-    poisson.setScale(scale);//1.1
-    poisson.setIsoDivide(isoDivide);//8
-    poisson.setConfidence(confidence);
-    poisson.setOutputPolygons(outputPolygons);
-    poisson.setManifold(manifold);
-    poisson.setSolverDivide(solverDivide);//8
-    poisson.reconstruct(triangles);
+  if(options.headless or progressive_run)
+  {
+    return 0;
+  }
+  // vizualizeClouds(cloud,cloud_xyz);
 
-    //pcl::PolygonMesh mesh2;
-    //poisson.reconstruct(mesh2);
-    //pcl::surface::SimplificationRemoveUnusedVertices rem;
-    //rem.simplify(mesh2,triangles);
+  // View Mesh
+  vizualizeMesh<PointT>(cloud,cloud_mesh);
+   
+  return 0;
+}
 
-    std::cout << "OK" << std::endl;
+// -roi_* options; false when one is malformed.
+static bool parseRoi(int argc, char **argv, CloudRoi& roi)
+{
+  std::vector<double> values;
+  if(pcl::console::parse_x_arguments(argc, argv, "-roi_box", values) >= 0)
+  {
+    if(values.size() != 6)
+      return false;
+    roi.has_box = true;
+    roi.box_min = Eigen::Vector3d(std::min(values[0], values[3]), std::min(values[1], values[4]), std::min(values[2], values[5]));
+    roi.box_max = Eigen::Vector3d(std::max(values[0], values[3]), std::max(values[1], values[4]), std::max(values[2], values[5]));
   }
-  else if(rolling_ball_mode)
+  values.clear();
+  if(pcl::console::parse_x_arguments(argc, argv, "-roi_sphere", values) >= 0)
   {
-
+    if(values.size() != 4 or values[3] <= 0.0)
+      return false;
+    roi.has_sphere = true;
+    roi.center = Eigen::Vector3d(values[0], values[1], values[2]);
+    roi.radius = values[3];
   }
-  else
+  values.clear();
+  if(pcl::console::parse_x_arguments(argc, argv, "-roi_z", values) >= 0)
+  {
+    if(values.size() != 2)
+      return false;
+    roi.has_z = true;
+    roi.z_min = std::min(values[0], values[1]);
+    roi.z_max = std::max(values[0], values[1]);
+  }
+  values.clear();
+  if(pcl::console::parse_x_arguments(argc, argv, "-roi_hull", values) >= 0)
   {
-    std::cout << "Select: \n'1' for surface poisson method \n '2' for surface gp3 method " << std::endl;
-    std::exit(-1);
+    if(values.size() < 6 or values.size() % 2 != 0)
+      return false;
+    for(std::size_t i = 0; i < values.size(); i += 2)
+      roi.hull.push_back(Eigen::Vector2d(values[i], values[i + 1]));
   }
+  return true;
 }
 
-void translateCloud(pcl::PointCloud<pcl::PointXYZ>::Ptr& inputCloud,
-  pcl::PointCloud<pcl::PointXYZ>::Ptr& outputCloud) {
-  /*****Translated point cloud to origin*****/
-  Eigen::Vector4f centroid;
-  pcl::compute3DCentroid(*inputCloud, centroid);
-
-  Eigen::Affine3f transform = Eigen::Affine3f::Identity();
-  transform.translation() << -centroid[0], -centroid[1], -centroid[2];
-
-  pcl::transformPointCloud(*inputCloud, *outputCloud, transform);
-  std::cout << "Cloud Translated width: " << outputCloud-> width << std::endl;
+// The three values after argv[last_input]: surface method, leaf size and
+// output dir. Anything after them must be an option.
+static bool positionalArguments(int argc, char** argv, int last_input, std::string values[3])
+{
+  if(last_input + 3 >= argc)
+    return false;
+  for(int i = 0; i < 3; ++i)
+  {
+    const char* value = argv[last_input + 1 + i];
+    if(value[0] == '-')
+      return false;
+    values[i] = value;
+  }
+  return last_input + 4 == argc or argv[last_input + 4][0] == '-';
 }
 
 int main(int argc, char **argv){
 
-	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>());
-	pcl::PolygonMesh cl;
-
   // File list and types
 	std::vector<int> filenames;
-	bool file_is_pcd = false;
-	bool file_is_ply = false;
 	bool file_is_txt = false;
 	bool file_is_xyz = false;  
 
-	if(argc<5 or argc>5){
+	if(argc<5){
 	  printUsage(argv[0]);
 	  return -1;
 	}
 
-	pcl::console::TicToc tt;
-	pcl::console::print_highlight("Loading ");
+  std::string trace_file;
+  if(pcl::console::parse_argument(argc, argv, "-trace", trace_file) >= 0)
+  {
+    Tracer::instance().enable();
+  }
+
+  bool headless = pcl::console::find_switch(argc, argv, "-headless");
+  if(not headless and std::getenv("DISPLAY") == NULL)
+  {
+    pcl::console::print_info("DISPLAY is not set, running headless\n");
+    headless = true;
+  }
+
+  std::string thumbnail_file;
+  pcl::console::parse_argument(argc, argv, "-thumbnail", thumbnail_file);
+  std::vector<int> thumbnail_size;
+  if(pcl::console::parse_x_arguments(argc, argv, "-thumbnail_size", thumbnail_size) < 0 or thumbnail_size.size() != 2)
+  {
+    thumbnail_size.assign(2, 256);
+  }
+
+  bool huge_pages = pcl::console::find_switch(argc, argv, "-huge_pages");
+  bool morton = pcl::console::find_switch(argc, argv, "-morton");
+
+  OutlierParams outliers;
+  std::string outlier_mode;
+  if(pcl::console::parse_argument(argc, argv, "-outliers", outlier_mode) >= 0)
+  {
+    if(outlier_mode == "stat")
+      outliers.mode = OUTLIERS_STATISTICAL;
+    else if(outlier_mode == "radius")
+      outliers.mode = OUTLIERS_RADIUS;
+    else
+    {
+      printUsage(argv[0]);
+      return -1;
+    }
+  }
+  pcl::console::parse_argument(argc, argv, "-outlier_k", outliers.mean_k);
+  pcl::console::parse_argument(argc, argv, "-outlier_stddev", outliers.stddev_mul);
+  pcl::console::parse_argument(argc, argv, "-outlier_radius", outliers.radius);
+  pcl::console::parse_argument(argc, argv, "-outlier_min", outliers.min_neighbors);
+
+  double cluster_tolerance = 0.0;
+  int cluster_min = 100;
+  pcl::console::parse_argument(argc, argv, "-clusters", cluster_tolerance);
+  pcl::console::parse_argument(argc, argv, "-cluster_min", cluster_min);
+  PlaneParams planes;
+  int plane_min = (int) planes.min_points;
+  planes.distance = 0.0;
+  planes.cell = 0.0;
+  pcl::console::parse_argument(argc, argv, "-planes", planes.max_planes);
+  pcl::console::parse_argument(argc, argv, "-plane_distance", planes.distance);
+  pcl::console::parse_argument(argc, argv, "-plane_min", plane_min);
+  pcl::console::parse_argument(argc, argv, "-plane_cell", planes.cell);
+  if(outliers.mean_k < 1 or outliers.min_neighbors < 0 or cluster_tolerance < 0.0 or cluster_min < 1 or
+    planes.max_planes < 0 or planes.distance < 0.0 or planes.cell < 0.0 or plane_min < 3)
+  {
+    printUsage(argv[0]);
+    return -1;
+  }
+
+  CloudRoi roi;
+  if(not parseRoi(argc, argv, roi))
+  {
+    printUsage(argv[0]);
+    return -1;
+  }
+
+  std::string cache_dir;
+  pcl::console::parse_argument(argc, argv, "-cache", cache_dir);
+
+  bool organized = not pcl::console::find_switch(argc, argv, "-no_organized");
+  OrganizedParams organized_params;
+  pcl::console::parse_argument(argc, argv, "-organized_step", organized_params.pixel_step);
+  pcl::console::parse_argument(argc, argv, "-organized_max_edge", organized_params.max_edge);
+  if(organized_params.pixel_step < 1 or organized_params.max_edge < 0.0f)
+  {
+    printUsage(argv[0]);
+    return -1;
+  }
+
+  int compact_bits = 0;
+  double compact_precision = 0.001;
+  pcl::console::parse_argument(argc, argv, "-compact", compact_bits);
+  pcl::console::parse_argument(argc, argv, "-compact_precision", compact_precision);
+  if(compact_bits != 0 and compact_bits != 16 and compact_bits != 21)
+  {
+    printUsage(argv[0]);
+    return -1;
+  }
+
+  MemoryReport memory;
+  std::string mem_report_file;
+  if(pcl::console::parse_argument(argc, argv, "-mem_report", mem_report_file) >= 0)
+  {
+    memory.enable();
+  }
+  std::string metrics_file;
+  pcl::console::parse_argument(argc, argv, "-metrics", metrics_file);
+
+  ProgressiveParams progressive;
+  pcl::console::parse_argument(argc, argv, "-progressive", progressive.levels);
+  pcl::console::parse_argument(argc, argv, "-progressive_seconds", progressive.seconds);
+
+  AutoTarget auto_target;
+  auto_target.enabled = pcl::console::find_switch(argc, argv, "-auto");
+  int auto_triangles = 0;
+  if(pcl::console::parse_argument(argc, argv, "-auto_triangles", auto_triangles) >= 0 and auto_triangles > 0)
+  {
+    auto_target.triangles = (std::size_t) auto_triangles;
+    auto_target.enabled = true;
+  }
+  if(pcl::console::parse_argument(argc, argv, "-auto_seconds", auto_target.seconds) >= 0 and auto_target.seconds > 0.0)
+  {
+    auto_target.enabled = true;
+  }
 
-	filenames = pcl::console::parse_file_extension_argument(argc, argv, ".ply");
-	if(filenames.size()<=0)
+	// Every cloud argument is an input, in command line order.
+	const char* extensions[] = { ".ply", ".pcd", ".txt", ".xyz" };
+	std::vector<int> by_extension[4];
+	for(int e = 0; e < 4; ++e)
 	{
-		filenames = pcl::console::parse_file_extension_argument(argc, argv, ".pcd");
-		if(filenames.size()<=0)
-		{
-			filenames = pcl::console::parse_file_extension_argument(argc, argv, ".txt");
-			if(filenames.size()<=0)
-			{
-				filenames = pcl::console::parse_file_extension_argument(argc, argv, ".xyz");
-				if(filenames.size()<=0)
-				{
-					printUsage (argv[0]);
-					return -1;
-				}
-				else if(filenames.size() == 1)
-				{
-					file_is_xyz = true;
-				}
-			}
-			else if(filenames.size() == 1)
-			{
-				file_is_txt = true;
-			}
-		}
-		else if(filenames.size() == 1)
-		{
-	      file_is_pcd = true;
-		}
+		by_extension[e] = pcl::console::parse_file_extension_argument(argc, argv, extensions[e]);
+		filenames.insert(filenames.end(), by_extension[e].begin(), by_extension[e].end());
 	}
-	else if(filenames.size() == 1)
+	std::sort(filenames.begin(), filenames.end());
+	std::vector<int> lists = pcl::console::parse_file_extension_argument(argc, argv, ".lst");
+	if(filenames.empty() and lists.size() != 1)
 	{
-		file_is_ply = true;
-	}
-	else{
 		printUsage (argv[0]);
 		return -1;
 	}
+	// Text-specific paths (-compact) only apply to a single input.
+	if(filenames.size() == 1)
+	{
+		file_is_txt = not by_extension[2].empty();
+		file_is_xyz = not by_extension[3].empty();
+	}
+	std::vector<std::string> inputs;
+	for(std::size_t f = 0; f < filenames.size(); ++f)
+	{
+		inputs.push_back(argv[filenames[f]]);
+	}
 
-	if(file_is_pcd)
-  { 
-    if(pcl::io::loadPCDFile(argv[filenames[0]], *cloud) < 0){
-            std::cout << "Error loading point cloud " << argv[filenames[0]]  << "\n";
-            return -1;
-    }
-    pcl::console::print_info("\nFound pcd file.\n");
-    pcl::console::print_info ("[done, ");
-    pcl::console::print_value ("%g", tt.toc ());
-    pcl::console::print_info (" ms : ");
-    pcl::console::print_value ("%d", cloud->size ());
-    pcl::console::print_info (" points]\n");
-  }
-	else if(file_is_ply)
-  {
-    pcl::io::loadPLYFile(argv[filenames[0]],*cloud);
-    if(cloud->points.size()<=0 || cloud->points[0].x<=0 && cloud->points[0].y<=0 && cloud->points[0].z<=0){
-        pcl::console::print_warn("\nloadPLYFile could not read the cloud, attempting to loadPolygonFile...\n");
-        pcl::io::loadPolygonFile(argv[filenames[0]], cl);
-        pcl::fromPCLPointCloud2(cl.cloud, *cloud);
-        if(cloud->points.size()<=0 || cloud->points[0].x<=0 && cloud->points[0].y<=0 && cloud->points[0].z<=0){
-            pcl::console::print_warn("\nloadPolygonFile could not read the cloud, attempting to PLYReader...\n");
-            pcl::PLYReader plyRead;
-            plyRead.read(argv[filenames[0]],*cloud);
-            if(cloud->points.size()<=0 || cloud->points[0].x<=0 && cloud->points[0].y<=0 && cloud->points[0].z<=0){
-                pcl::console::print_error("\nError. ply file is not compatible.\n");
-                return -1;
-            }
-        }
-     }
-
-    pcl::console::print_info("\nFound ply file.");
-    pcl::console::print_info ("[done, ");
-    pcl::console::print_value ("%g", tt.toc ());
-    pcl::console::print_info (" ms : ");
-    pcl::console::print_value ("%d", cloud->size ());
-    pcl::console::print_info (" points]\n");
-
-    }
-    else if(file_is_txt){
-      std::ifstream file(argv[filenames[0]]);
-      if(!file.is_open()){
-          std::cout << "Error: Could not find "<< argv[filenames[0]] << std::endl;
-          return -1;
-      }
-      
-      std::cout << "file opened." << std::endl;
-      double x_,y_,z_;
-      unsigned int r, g, b; 
-
-      while(file >> x_ >> y_ >> z_ >> r >> g >> b){
-          pcl::PointXYZRGB pt;
-          pt.x = x_;
-          pt.y = y_;
-          pt.z= z_;            
-          
-          uint8_t r_, g_, b_; 
-          r_ = uint8_t(r); 
-          g_ = uint8_t(g); 
-          b_ = uint8_t(b); 
-
-          uint32_t rgb_ = ((uint32_t)r_ << 16 | (uint32_t)g_ << 8 | (uint32_t)b_); 
-          pt.rgb = *reinterpret_cast<float*>(&rgb_);               
-              
-          cloud->points.push_back(pt);
-          //std::cout << "pointXYZRGB:" <<  pt << std::endl;
-      }      
-     
-      pcl::console::print_info("\nFound txt file.\n");
-      pcl::console::print_info ("[done, ");
-      pcl::console::print_value ("%g", tt.toc ());
-      pcl::console::print_info (" ms : ");
-      pcl::console::print_value ("%d", cloud->points.size ());
-      pcl::console::print_info (" points]\n");
-    }
-    else if(file_is_xyz)
-    {
-      std::ifstream file(argv[filenames[0]]);
-      if(!file.is_open()){
-          std::cout << "Error: Could not find "<< argv[filenames[0]] << std::endl;
-          return -1;
-      }
-      
-      std::cout << "file opened." << std::endl;
-      double x_,y_,z_;
-
-      while(file >> x_ >> y_ >> z_){
-          
-          pcl::PointXYZRGB pt;
-          pt.x = x_;
-          pt.y = y_;
-          pt.z= z_;            
-          
-          cloud->points.push_back(pt);
-          //std::cout << "pointXYZRGB:" <<  pt << std::endl;
-      }      
-     
-      pcl::console::print_info("\nFound xyz file.\n");
-      pcl::console::print_info ("[done, ");
-      pcl::console::print_value ("%g", tt.toc ());
-      pcl::console::print_info (" ms : ");
-      pcl::console::print_value ("%d", cloud->points.size ());
-      pcl::console::print_info (" points]\n");
-  }
-
-  cloud->width = (int) cloud->points.size();
-  cloud->height = 1;
-  cloud->is_dense = true;
-
-  if(cloud -> height == 1){
-  	pcl::console::print_info("Point cloud is unorganized\n");
-  } else {
-  	pcl::console::print_info("Point cloud is organized\n");
-  }
+	// surface method, leaf size and output dir follow the last input
+	std::string positional[3];
+	if(not positionalArguments(argc, argv, lists.size() == 1 ? lists[0] : filenames.back(), positional))
+	{
+		printUsage (argv[0]);
+		return -1;
+	}
 
-  std::string select_mode = argv[2];
-  std::string select_leaf_size = argv[3];
-  std::string output_dir = argv[4];//10
+  std::string select_mode = positional[0];
+  std::string select_leaf_size = positional[1];
+  std::string output_dir = positional[2];
 
   float leaf_size = std::atof(select_leaf_size.c_str());
   int surface_mode = std::atoi(select_mode.c_str());
+  if(outliers.radius <= 0.0)
+  {
+    outliers.radius = 2.0 * leaf_size;
+  }
+  planes.min_points = (std::size_t) plane_min;
+  if(planes.distance <= 0.0)
+  {
+    planes.distance = leaf_size;
+  }
+  if(planes.cell <= 0.0)
+  {
+    planes.cell = 2.0 * leaf_size;
+  }
  
   boost::filesystem::path dirPath(output_dir);     
 
@@ -616,52 +957,148 @@ int main(int argc, char **argv){
       std::exit(-1);
   }
 
-  pcl::PointCloud<pcl::PointNormal>::Ptr cloud_normals (new pcl::PointCloud<pcl::PointNormal>);
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud_out (new pcl::PointCloud<pcl::PointXYZRGB>());
-  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_xyz (new pcl::PointCloud<pcl::PointXYZ>());
-  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_translated (new pcl::PointCloud<pcl::PointXYZ>());
-
-  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_temp(new pcl::PointCloud<pcl::PointXYZ>());
-
-  pcl::PolygonMesh cloud_mesh;
-
-  downSample(cloud, cloud_out, leaf_size);
-  pcl::copyPointCloud(*cloud_out,*cloud_xyz);
-
-  translateCloud(cloud_xyz, cloud_translated);
-  applySurfaceApproximation(cloud_translated, cloud_temp);
-  calculateNormals(cloud_translated, cloud_normals);
-  
-  std::cout << cloud-> width << std::endl;
-  std::cout << cloud_out-> width << std::endl;
-
-  createMesh(cloud_normals,surface_mode,cloud_mesh);
-
-  output_dir += "/cloud_mesh.ply";
-
-  std::string sav = "saved mesh in:";
-  sav += output_dir;
-
-  //COMMENTED OUT CODE
-  //typedef pcl::geometry::DefaultMeshTraits <>      MeshTraits;
-  //COMMENTED OUT CODE
-  //typedef pcl::geometry::TriangleMesh <MeshTraits> Mesh;
-  //COMMENTED OUT CODE
-  //typedef pcl::geometry::MeshIO <Mesh>             MeshIO;
+  if(lists.size() == 1)
+  {
+    std::vector<std::string> listed;
+    if(not readCloudList(argv[lists[0]], listed) or listed.empty())
+    {
+      pcl::console::print_error("Error. no clouds listed in %s\n", argv[lists[0]]);
+      return -1;
+    }
+    if(surface_mode != 1 and surface_mode != 2)
+    {
+      printUsage(argv[0]);
+      return -1;
+    }
+    // batch workers run the plain unorganized pipeline per cloud
+    if(not mem_report_file.empty())
+      pcl::console::print_warn("-mem_report does not apply to .lst batches, ignoring\n");
+    if(not metrics_file.empty())
+      pcl::console::print_warn("-metrics does not apply to .lst batches, ignoring\n");
+    if(compact_bits != 0)
+      pcl::console::print_warn("-compact does not apply to .lst batches, loading normally\n");
+    if(not cache_dir.empty())
+      pcl::console::print_warn("-cache does not apply to .lst batches, ignoring\n");
+    if(progressive.levels > 1)
+      pcl::console::print_warn("-progressive does not apply to .lst batches, writing one mesh per cloud\n");
+    if(pcl::console::find_argument(argc, argv, "-organized_step") >= 0 or pcl::console::find_argument(argc, argv, "-organized_max_edge") >= 0)
+      pcl::console::print_warn("-organized_step/-organized_max_edge do not apply to .lst batches, organized clouds are meshed as unorganized\n");
+
+    BatchOptions batch;
+    batch.leaf_size = leaf_size;
+    batch.params.surface_mode = surface_mode;
+    batch.auto_target = auto_target;
+    batch.output_dir = output_dir;
+    batch.huge_pages = huge_pages;
+    batch.morton = morton;
+    batch.outliers = outliers;
+    batch.cluster_tolerance = cluster_tolerance;
+    batch.cluster_min = cluster_min;
+    batch.planes = planes;
+    batch.roi = roi;
+    int value = 0;
+    if(pcl::console::parse_argument(argc, argv, "-queue_depth", value) >= 0 and value > 0)
+      batch.queue_depth = value;
+    if(pcl::console::parse_argument(argc, argv, "-workers", value) >= 0 and value > 0)
+      batch.workers = value;
+
+    int failures = runBatch(listed, batch);
+    if(Tracer::instance().enabled())
+    {
+      writeTrace(trace_file);
+    }
+    return failures == 0 ? 0 : -1;
+  }
 
-  pcl::console::print_info(sav.c_str());
-  std::cout << std::endl;
+  if(pcl::console::find_switch(argc, argv, "-sweep"))
+  {
+    // the sweep compares meshes of one cloud and always runs on PointXYZRGB
+    if(outliers.mode != OUTLIERS_NONE)
+      pcl::console::print_warn("-outliers does not apply to -sweep, ignoring\n");
+    if(morton)
+      pcl::console::print_warn("-morton does not apply to -sweep, ignoring\n");
+    if(planes.max_planes > 0)
+      pcl::console::print_warn("-planes does not apply to -sweep, ignoring\n");
+    if(cluster_tolerance > 0.0)
+      pcl::console::print_warn("-clusters does not apply to -sweep, ignoring\n");
+    if(auto_target.enabled)
+      pcl::console::print_warn("-auto does not apply to -sweep, sweeping the given parameters\n");
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>());
+    {
+      MemoryStageScope load_mem(memory, "load");
+      TRACE_SCOPE_VAR(load_span, "load", -1);
+      pcl::console::print_highlight("Loading ");
+      Eigen::Vector3d offset;
+      std::vector<std::size_t> slices;
+      if(inputs.size() > 1 ? loadClouds<pcl::PointXYZRGB>(inputs, cloud, slices, offset, roi) < 0
+                           : loadCloud<pcl::PointXYZRGB>(inputs[0], cloud, offset, roi) < 0)
+      {
+        return -1;
+      }
+      TRACE_SET_POINTS(load_span, cloud->size());
+    }
 
-  pcl::io::savePLYFileBinary(output_dir.c_str(),cloud_mesh);
-  //COMMENTED OUT CODE
-  //pcl::io::savePolygonFilePLY(output_dir.c_str(),cloud_mesh,true);
-           
-           
-  vtkObject::GlobalWarningDisplayOff(); // Disable vtk render warning   
-  // vizualizeClouds(cloud,cloud_xyz);
+    SweepOptions sweep;
+    if(pcl::console::parse_x_arguments(argc, argv, "-sweep_leaf", sweep.leaf_sizes) < 0)
+      sweep.leaf_sizes.push_back(leaf_size);
+    if(pcl::console::parse_x_arguments(argc, argv, "-sweep_mode", sweep.surface_modes) < 0)
+      sweep.surface_modes.push_back(surface_mode);
+    if(pcl::console::parse_x_arguments(argc, argv, "-sweep_k", sweep.normal_ks) < 0)
+      sweep.normal_ks.push_back(MeshParams().normal_k);
+    if(pcl::console::parse_x_arguments(argc, argv, "-sweep_depth", sweep.poisson_depths) < 0)
+      sweep.poisson_depths.push_back(MeshParams().poisson_depth);
+    if(pcl::console::parse_x_arguments(argc, argv, "-sweep_radius", sweep.gp3_radii) < 0)
+      sweep.gp3_radii.push_back(MeshParams().gp3_radius);
+    sweep.csv_path = output_dir + "/sweep.csv";
+
+    int result = runParameterSweep(cloud, sweep);
+    if(Tracer::instance().enabled())
+    {
+      writeTrace(trace_file);
+    }
+    return result;
+  }
 
-  // View Mesh
-  vizualizeMesh(cloud,cloud_mesh);
-   
-  return 0;
+  RunOptions options;
+  options.input = inputs[0];
+  options.inputs = inputs;
+  options.file_is_txt = file_is_txt;
+  options.file_is_xyz = file_is_xyz;
+  options.leaf_size = leaf_size;
+  options.mesh.surface_mode = surface_mode;
+  options.output_dir = output_dir;
+  options.headless = headless;
+  options.huge_pages = huge_pages;
+  options.morton = morton;
+  options.outliers = outliers;
+  options.cluster_tolerance = cluster_tolerance;
+  options.cluster_min = cluster_min;
+  options.planes = planes;
+  options.roi = roi;
+  options.auto_target = auto_target;
+  options.progressive = progressive;
+  options.organized = organized;
+  options.organized_params = organized_params;
+  options.cache_dir = cache_dir;
+  options.compact_bits = compact_bits;
+  options.compact_precision = compact_precision;
+  options.thumbnail_file = thumbnail_file;
+  options.thumbnail_size = thumbnail_size;
+  options.trace_file = trace_file;
+  options.mem_report_file = mem_report_file;
+  options.metrics_file = metrics_file;
+
+  // One dispatch on the input's fields; every stage after it is compiled for that type.
+  CloudPointType point_type = inputs.size() > 1 ? commonPointType(inputs) : detectPointType(options.input);
+  pcl::console::print_info("Input fields map to %s\n", cloudPointTypeName(point_type));
+  switch(point_type)
+  {
+    case CLOUD_XYZ:
+      return meshCloudFile<pcl::PointXYZ>(options, memory);
+    case CLOUD_XYZ_NORMAL:
+      return meshCloudFile<pcl::PointNormal>(options, memory);
+    case CLOUD_XYZRGB:
+    default:
+      return meshCloudFile<pcl::PointXYZRGB>(options, memory);
+  }
 }
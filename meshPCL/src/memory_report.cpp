@@ -0,0 +1,263 @@
+#include "memory_report.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include <unistd.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+static std::uint64_t readStatusKb(const char* key)
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  size_t key_len = std::strlen(key);
+  while(std::getline(status, line))
+  {
+    if(line.compare(0, key_len, key) == 0)
+      return std::strtoull(line.c_str() + key_len + 1, NULL, 10);
+  }
+  return 0;
+}
+
+static std::uint64_t currentRssBytes()
+{
+  std::FILE* statm = std::fopen("/proc/self/statm", "r");
+  if(statm == NULL)
+    return 0;
+  unsigned long long size = 0, resident = 0;
+  int n = std::fscanf(statm, "%llu %llu", &size, &resident);
+  std::fclose(statm);
+  return n == 2 ? resident * (std::uint64_t) sysconf(_SC_PAGESIZE) : 0;
+}
+
+static std::uint64_t heapBytesInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 mi = mallinfo2();
+  return (std::uint64_t) mi.uordblks + (std::uint64_t) mi.hblkhd;
+#elif defined(__GLIBC__)
+  struct mallinfo mi = mallinfo();
+  return (std::uint64_t)(unsigned int) mi.uordblks + (std::uint64_t)(unsigned int) mi.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+// Resets VmHWM to the current RSS (Linux >= 4.0).
+static bool resetPeakRss()
+{
+  std::FILE* refs = std::fopen("/proc/self/clear_refs", "w");
+  if(refs == NULL)
+    return false;
+  bool ok = std::fputs("5", refs) >= 0;
+  return std::fclose(refs) == 0 && ok;
+}
+
+MemorySample sampleMemory()
+{
+  MemorySample sample = {currentRssBytes(), heapBytesInUse()};
+  return sample;
+}
+
+std::uint64_t availableMemoryBytes()
+{
+  std::ifstream meminfo("/proc/meminfo");
+  std::string line;
+  while(std::getline(meminfo, line))
+  {
+    if(line.compare(0, 13, "MemAvailable:") == 0)
+      return std::strtoull(line.c_str() + 13, NULL, 10) * 1024;
+  }
+  return 0;
+}
+
+MemoryReport::MemoryReport()
+  : enabled_(false), peak_reset_supported_(false), interval_ms_(5), current_(-1), stop_(false)
+{
+}
+
+MemoryReport::~MemoryReport()
+{
+  if(sampler_.joinable())
+  {
+    stop_ = true;
+    wake_.notify_all();
+    sampler_.join();
+  }
+}
+
+void MemoryReport::enable(unsigned int sample_interval_ms)
+{
+  if(enabled_)
+    return;
+  enabled_ = true;
+  interval_ms_ = std::max(1u, sample_interval_ms);
+  peak_reset_supported_ = resetPeakRss();
+  sampler_ = std::thread(&MemoryReport::samplerLoop, this);
+}
+
+void MemoryReport::samplerLoop()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while(!stop_)
+  {
+    wake_.wait_for(lock, std::chrono::milliseconds(interval_ms_));
+    lock.unlock();
+    MemorySample sample = sampleMemory();
+    lock.lock();
+    raisePeak(sample);
+  }
+}
+
+void MemoryReport::raisePeak(const MemorySample& sample)
+{
+  if(current_ < 0)
+    return;
+  Stage& stage = stages_[current_];
+  stage.peak.rss_bytes = std::max(stage.peak.rss_bytes, sample.rss_bytes);
+  stage.peak.heap_bytes = std::max(stage.peak.heap_bytes, sample.heap_bytes);
+}
+
+void MemoryReport::beginStage(const std::string& name)
+{
+  if(peak_reset_supported_)
+    resetPeakRss();
+  MemorySample sample = sampleMemory();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stage stage;
+  stage.name = name;
+  stage.begin = sample;
+  stage.end = sample;
+  stage.peak = sample;
+  stages_.push_back(stage);
+  current_ = (int) stages_.size() - 1;
+}
+
+void MemoryReport::endStage()
+{
+  MemorySample sample = sampleMemory();
+  std::uint64_t hwm = peak_reset_supported_ ? readStatusKb("VmHWM:") * 1024 : 0;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(current_ < 0)
+    return;
+  Stage& stage = stages_[current_];
+  stage.end = sample;
+  raisePeak(sample);
+  stage.peak.rss_bytes = std::max(stage.peak.rss_bytes, hwm);
+  current_ = -1;
+}
+
+void MemoryReport::useBuffer(const std::string& name, std::uint64_t bytes)
+{
+  if(!enabled_)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  int stage = current_ >= 0 ? current_ : (int) stages_.size() - 1;
+  for(size_t i = 0; i < buffers_.size(); ++i)
+  {
+    if(buffers_[i].name == name)
+    {
+      buffers_[i].bytes = std::max(buffers_[i].bytes, bytes);
+      buffers_[i].last_used = std::max(buffers_[i].last_used, stage);
+      return;
+    }
+  }
+  Buffer buffer = {name, bytes, stage, stage};
+  buffers_.push_back(buffer);
+}
+
+static const char* stageName(const std::vector<std::string>& names, int index)
+{
+  return index >= 0 && index < (int) names.size() ? names[index].c_str() : "";
+}
+
+bool MemoryReport::writeJson(const std::string& path) const
+{
+  std::ofstream out(path.c_str());
+  if(!out.is_open())
+    return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::vector<std::string> names;
+  int peak_stage = -1;
+  for(size_t i = 0; i < stages_.size(); ++i)
+  {
+    names.push_back(stages_[i].name);
+    if(peak_stage < 0 || stages_[i].peak.rss_bytes > stages_[peak_stage].peak.rss_bytes)
+      peak_stage = (int) i;
+  }
+  const int last_stage = (int) stages_.size() - 1;
+
+  out << "{\n  \"peak_rss_reset\": " << (peak_reset_supported_ ? "true" : "false") << ",\n";
+  out << "  \"stages\": [\n";
+  for(size_t i = 0; i < stages_.size(); ++i)
+  {
+    const Stage& s = stages_[i];
+    out << "    {\"name\": \"" << s.name << "\""
+        << ", \"rss_begin\": " << s.begin.rss_bytes
+        << ", \"rss_end\": " << s.end.rss_bytes
+        << ", \"rss_peak\": " << s.peak.rss_bytes
+        << ", \"heap_begin\": " << s.begin.heap_bytes
+        << ", \"heap_end\": " << s.end.heap_bytes
+        << ", \"heap_peak\": " << s.peak.heap_bytes << "}"
+        << (i + 1 < stages_.size() ? ",\n" : "\n");
+  }
+  out << "  ],\n";
+
+  std::uint64_t freeable_at_peak = 0;
+  out << "  \"buffers\": [\n";
+  for(size_t i = 0; i < buffers_.size(); ++i)
+  {
+    const Buffer& b = buffers_[i];
+    bool freeable = b.last_used < last_stage;
+    if(peak_stage >= 0 && b.created <= peak_stage && b.last_used < peak_stage)
+      freeable_at_peak += b.bytes;
+    out << "    {\"name\": \"" << b.name << "\""
+        << ", \"bytes\": " << b.bytes
+        << ", \"created_in\": \"" << stageName(names, b.created) << "\""
+        << ", \"last_used_in\": \"" << stageName(names, b.last_used) << "\""
+        << ", \"freeable_after\": ";
+    if(freeable)
+      out << "\"" << stageName(names, b.last_used) << "\"";
+    else
+      out << "null";
+    out << "}" << (i + 1 < buffers_.size() ? ",\n" : "\n");
+  }
+  out << "  ],\n";
+  out << "  \"peak_stage\": \"" << stageName(names, peak_stage) << "\",\n";
+  out << "  \"freeable_bytes_at_peak\": " << freeable_at_peak << "\n}\n";
+  return out.good();
+}
+
+void MemoryReport::printSummary(std::ostream& os) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::ios::fmtflags flags = os.flags();
+  os << std::left << std::setw(28) << "stage" << std::right
+     << std::setw(14) << "rss end MB" << std::setw(14) << "rss peak MB"
+     << std::setw(14) << "heap peak MB" << "\n";
+  os << std::string(70, '-') << "\n";
+  os << std::fixed << std::setprecision(1);
+  for(size_t i = 0; i < stages_.size(); ++i)
+  {
+    const Stage& s = stages_[i];
+    os << std::left << std::setw(28) << s.name << std::right
+       << std::setw(14) << s.end.rss_bytes / 1048576.0
+       << std::setw(14) << s.peak.rss_bytes / 1048576.0
+       << std::setw(14) << s.peak.heap_bytes / 1048576.0 << "\n";
+  }
+  os.flags(flags);
+}
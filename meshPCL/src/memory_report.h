@@ -0,0 +1,128 @@
+/*********************************
+     MEMORY HIGH-WATER REPORT
+**********************************/
+// Records RSS and allocator bytes-in-use at each stage boundary and the
+// peak reached inside each stage, and attributes the size of every
+// intermediate buffer to the stages that create and read it. The JSON
+// report lists, per buffer, the last stage that needed it so buffers kept
+// alive past that point show up as early-free candidates.
+//
+// RSS peaks come from VmHWM (reset through /proc/self/clear_refs where the
+// kernel allows it); allocator peaks from a background sampler.
+
+#ifndef MESHPCL_MEMORY_REPORT_H
+#define MESHPCL_MEMORY_REPORT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct MemorySample
+{
+  std::uint64_t rss_bytes;
+  std::uint64_t heap_bytes;
+};
+
+MemorySample sampleMemory();
+
+// MemAvailable from /proc/meminfo, 0 when unknown.
+std::uint64_t availableMemoryBytes();
+
+// Bytes held by a pcl::PointCloud<T> (capacity, not size).
+template <typename CloudT>
+std::uint64_t cloudBytes(const CloudT& cloud)
+{
+  return sizeof(cloud) + cloud.points.capacity() * sizeof(typename CloudT::PointType);
+}
+
+// Bytes held by a pcl::PolygonMesh.
+template <typename MeshT>
+std::uint64_t meshBytes(const MeshT& mesh)
+{
+  std::uint64_t bytes = sizeof(mesh) + mesh.cloud.data.capacity();
+  for(size_t i = 0; i < mesh.polygons.size(); ++i)
+    bytes += sizeof(mesh.polygons[i]) + mesh.polygons[i].vertices.capacity() * sizeof(mesh.polygons[i].vertices[0]);
+  return bytes;
+}
+
+class MemoryReport
+{
+public:
+  MemoryReport();
+  ~MemoryReport();
+
+  void enable(unsigned int sample_interval_ms = 5);
+  bool enabled() const { return enabled_; }
+
+  void beginStage(const std::string& name);
+  void endStage();
+
+  // Declares that the current stage reads or produces buffer 'name'.
+  void useBuffer(const std::string& name, std::uint64_t bytes);
+
+  bool writeJson(const std::string& path) const;
+  void printSummary(std::ostream& os) const;
+
+private:
+  struct Stage
+  {
+    std::string name;
+    MemorySample begin;
+    MemorySample end;
+    MemorySample peak;
+  };
+
+  struct Buffer
+  {
+    std::string name;
+    std::uint64_t bytes;
+    int created;
+    int last_used;
+  };
+
+  void samplerLoop();
+  void raisePeak(const MemorySample& sample);
+
+  bool enabled_;
+  bool peak_reset_supported_;
+  unsigned int interval_ms_;
+  std::vector<Stage> stages_;
+  std::vector<Buffer> buffers_;
+  int current_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::atomic<bool> stop_;
+  std::thread sampler_;
+};
+
+class MemoryStageScope
+{
+public:
+  MemoryStageScope(MemoryReport& report, const std::string& name)
+    : report_(report)
+  {
+    if(report_.enabled())
+      report_.beginStage(name);
+  }
+
+  ~MemoryStageScope()
+  {
+    if(report_.enabled())
+      report_.endStage();
+  }
+
+private:
+  MemoryStageScope(const MemoryStageScope&);
+  MemoryStageScope& operator=(const MemoryStageScope&);
+
+  MemoryReport& report_;
+};
+
+#endif // MESHPCL_MEMORY_REPORT_H
@@ -0,0 +1,367 @@
+#include "merge_clouds.h"
+
+#include <pcl/console/print.h>
+#include <pcl/filters/voxel_grid.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+
+#include "cloud_io.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "trace.h"
+
+// Points per task of the overlap scans.
+static const std::size_t MERGE_TILE = 65536;
+
+CloudPointType commonPointType(const std::vector<std::string>& filenames)
+{
+  bool normals = !filenames.empty();
+  bool color = false;
+  for(std::size_t f = 0; f < filenames.size(); ++f)
+  {
+    const CloudPointType type = detectPointType(filenames[f]);
+    normals = normals && type == CLOUD_XYZ_NORMAL;
+    color = color || type == CLOUD_XYZRGB;
+  }
+  if(normals)
+    return CLOUD_XYZ_NORMAL;
+  return color ? CLOUD_XYZRGB : CLOUD_XYZ;
+}
+
+// One input file between the sizing and the filling pass.
+template <typename PointT>
+struct StationInput
+{
+  bool text;
+  bool with_color;
+  std::unique_ptr<TextCloudReader> reader;
+  typename pcl::PointCloud<PointT>::Ptr scratch;
+  Eigen::Vector3d offset;
+  std::size_t points;
+  int status;
+};
+
+template <typename PointT>
+int loadClouds(const std::vector<std::string>& filenames, typename pcl::PointCloud<PointT>::Ptr& cloud,
+  std::vector<std::size_t>& slices, Eigen::Vector3d& offset, const CloudRoi& roi)
+{
+  TRACE_SCOPE_VAR(span, "loadClouds", filenames.size());
+  const std::size_t files = filenames.size();
+  std::vector<StationInput<PointT> > inputs(files);
+
+  // Pass 1: sizes and frame origins, one task per file.
+  parallelFor(0, files, 1, [&](std::size_t first, std::size_t last)
+  {
+    for(std::size_t f = first; f < last; ++f)
+    {
+      StationInput<PointT>& input = inputs[f];
+      const std::string extension = boost::algorithm::to_lower_copy(boost::filesystem::path(filenames[f]).extension().string());
+      input.text = extension == ".txt" || extension == ".xyz";
+      input.with_color = extension == ".txt";
+      input.offset.setZero();
+      if(input.text)
+      {
+        input.reader.reset(new TextCloudReader);
+        input.status = input.reader->open(filenames[f], input.with_color, roi);
+        input.points = input.reader->points();
+        input.offset = input.reader->offset();
+      }
+      else
+      {
+        input.scratch.reset(new pcl::PointCloud<PointT>);
+        input.status = loadCloud<PointT>(filenames[f], input.scratch, input.offset, roi);
+        input.points = input.scratch->size();
+      }
+    }
+  });
+
+  // Whole-metre mean of the text frames, weighted by their points.
+  Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+  std::size_t text_points = 0;
+  slices.assign(files + 1, 0);
+  for(std::size_t f = 0; f < files; ++f)
+  {
+    if(inputs[f].status < 0)
+    {
+      pcl::console::print_error("Error. could not load %s\n", filenames[f].c_str());
+      return -1;
+    }
+    slices[f + 1] = slices[f] + inputs[f].points;
+    if(inputs[f].text)
+    {
+      sum += inputs[f].offset * (double) inputs[f].points;
+      text_points += inputs[f].points;
+    }
+  }
+  offset.setZero();
+  if(text_points > 0)
+  {
+    for(int k = 0; k < 3; ++k)
+      offset[k] = std::floor(sum[k] / text_points + 0.5);
+  }
+
+  // Pass 2: every file fills its own slice of the presized cloud.
+  cloud->points.resize(slices[files]);
+  cloud->width = (std::uint32_t) slices[files];
+  cloud->height = 1;
+  bool dense = true;
+  for(std::size_t f = 0; f < files; ++f)
+    dense = dense && (inputs[f].text || inputs[f].scratch->is_dense);
+  cloud->is_dense = dense;
+
+  parallelFor(0, files, 1, [&](std::size_t first, std::size_t last)
+  {
+    for(std::size_t f = first; f < last; ++f)
+    {
+      StationInput<PointT>& input = inputs[f];
+      const Eigen::Vector3d shift = input.offset - offset;
+      if(input.text)
+      {
+        const TextCloudReader& reader = *input.reader;
+        const bool with_color = input.with_color;
+        parallelFor(0, reader.chunks(), 1, [&](std::size_t chunk_first, std::size_t chunk_last)
+        {
+          for(std::size_t c = chunk_first; c < chunk_last; ++c)
+          {
+            std::size_t index = slices[f] + reader.chunkFirst(c);
+            reader.readChunk(c, [&](const double xyz[3], const unsigned char rgb[3])
+            {
+              PointT& pt = cloud->points[index++];
+              pt = PointT();
+              pt.x = (float) (xyz[0] + shift[0]);
+              pt.y = (float) (xyz[1] + shift[1]);
+              pt.z = (float) (xyz[2] + shift[2]);
+              if(with_color)
+              {
+                setPointColor(pt, rgb);
+              }
+            });
+          }
+        });
+        input.reader.reset();
+      }
+      else
+      {
+        const pcl::PointCloud<PointT>& scratch = *input.scratch;
+        parallelFor(0, scratch.size(), MERGE_TILE, [&](std::size_t begin, std::size_t end)
+        {
+          for(std::size_t i = begin; i < end; ++i)
+          {
+            PointT& pt = cloud->points[slices[f] + i];
+            pt = scratch.points[i];
+            pt.x = (float) (pt.x + shift[0]);
+            pt.y = (float) (pt.y + shift[1]);
+            pt.z = (float) (pt.z + shift[2]);
+          }
+        });
+        input.scratch.reset();
+      }
+    }
+  });
+
+  pcl::console::print_info("Merged %d files into %d points\n", (int) files, (int) cloud->size());
+  return 0;
+}
+
+typedef std::array<std::int64_t, 3> VoxelKey;
+
+struct VoxelKeyHash
+{
+  std::size_t operator()(const VoxelKey& key) const
+  {
+    std::uint64_t h = (std::uint64_t) key[0] * 73856093ULL ^ (std::uint64_t) key[1] * 19349663ULL ^ (std::uint64_t) key[2] * 83492791ULL;
+    return (std::size_t) (h ^ (h >> 29));
+  }
+};
+
+// Points of one station in one voxel.
+struct StationVoxel
+{
+  VoxelKey key;
+  std::uint32_t station;
+  std::uint64_t count;
+
+  bool operator<(const StationVoxel& other) const
+  {
+    return key < other.key || (key == other.key && station < other.station);
+  }
+};
+
+template <typename PointT>
+static inline bool voxelOf(const PointT& p, double inverse_leaf, VoxelKey& key)
+{
+  if(!pcl::isFinite(p))
+    return false;
+  key[0] = (std::int64_t) std::floor(p.x * inverse_leaf);
+  key[1] = (std::int64_t) std::floor(p.y * inverse_leaf);
+  key[2] = (std::int64_t) std::floor(p.z * inverse_leaf);
+  return true;
+}
+
+// Station of the point at 'index', from the one that held index - 1.
+static inline std::uint32_t stationOf(const std::vector<std::size_t>& slices, std::size_t index, std::uint32_t station)
+{
+  while(index >= slices[station + 1])
+    ++station;
+  return station;
+}
+
+// Indices of the finite points that are not in a voxel another station
+// holds more points of, ascending. Returns the number of points dropped.
+template <typename PointT>
+static std::size_t overlapFreeIndices(const pcl::PointCloud<PointT>& cloud, const std::vector<std::size_t>& slices,
+  float leaf_size, std::vector<int>& indices)
+{
+  TRACE_SCOPE_VAR(span, "downSampleMerged/overlaps", cloud.size());
+  const double inverse_leaf = 1.0 / leaf_size;
+  const std::size_t n = cloud.size();
+  const std::size_t tiles = (n + MERGE_TILE - 1) / MERGE_TILE;
+  const std::uint32_t first_station = (std::uint32_t) (std::upper_bound(slices.begin(), slices.end(), 0) - slices.begin() - 1);
+
+  // Per tile, then merged: stations meet in voxels of different tiles.
+  std::vector<std::vector<StationVoxel> > per_tile(tiles);
+  parallelFor(0, n, MERGE_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    std::vector<StationVoxel>& voxels = per_tile[begin / MERGE_TILE];
+    std::unordered_map<VoxelKey, std::size_t, VoxelKeyHash> index;
+    std::uint32_t station = first_station;
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      // The map is keyed by voxel alone, so it starts over with each station.
+      if(i > begin && i == slices[station + 1])
+        index.clear();
+      station = stationOf(slices, i, station);
+      VoxelKey key;
+      if(!voxelOf(cloud.points[i], inverse_leaf, key))
+        continue;
+      std::pair<std::unordered_map<VoxelKey, std::size_t, VoxelKeyHash>::iterator, bool> slot =
+        index.insert(std::make_pair(key, voxels.size()));
+      if(slot.second)
+      {
+        StationVoxel voxel;
+        voxel.key = key;
+        voxel.station = station;
+        voxel.count = 1;
+        voxels.push_back(voxel);
+      }
+      else
+        ++voxels[slot.first->second].count;
+    }
+  });
+
+  // Owner of every voxel more than one station reaches.
+  std::unordered_map<VoxelKey, std::uint32_t, VoxelKeyHash> owners;
+  {
+    TRACE_SCOPE_VAR(merge, "downSampleMerged/owners", tiles);
+    std::vector<StationVoxel> voxels;
+    std::size_t total = 0;
+    for(std::size_t t = 0; t < tiles; ++t)
+      total += per_tile[t].size();
+    voxels.reserve(total);
+    for(std::size_t t = 0; t < tiles; ++t)
+    {
+      voxels.insert(voxels.end(), per_tile[t].begin(), per_tile[t].end());
+      std::vector<StationVoxel>().swap(per_tile[t]);
+    }
+    std::sort(voxels.begin(), voxels.end());
+
+    for(std::size_t i = 0; i < voxels.size(); )
+    {
+      const VoxelKey key = voxels[i].key;
+      std::uint32_t best = voxels[i].station;
+      std::uint64_t best_count = 0;
+      bool shared = false;
+      while(i < voxels.size() && voxels[i].key == key)
+      {
+        const std::uint32_t station = voxels[i].station;
+        std::uint64_t count = 0;
+        for(; i < voxels.size() && voxels[i].key == key && voxels[i].station == station; ++i)
+          count += voxels[i].count;
+        shared = shared || station != best;
+        if(count > best_count)
+        {
+          best = station;
+          best_count = count;
+        }
+      }
+      if(shared)
+        owners[key] = best;
+    }
+  }
+
+  std::vector<unsigned char> keep(n);
+  std::vector<std::size_t> first(tiles + 1, 0);
+  parallelFor(0, n, MERGE_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    std::size_t count = 0;
+    std::uint32_t station = first_station;
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      station = stationOf(slices, i, station);
+      VoxelKey key;
+      keep[i] = 0;
+      if(!voxelOf(cloud.points[i], inverse_leaf, key))
+        continue;
+      std::unordered_map<VoxelKey, std::uint32_t, VoxelKeyHash>::const_iterator owner = owners.find(key);
+      keep[i] = owner == owners.end() || owner->second == station;
+      count += keep[i];
+    }
+    first[begin / MERGE_TILE + 1] = count;
+  });
+  for(std::size_t t = 0; t < tiles; ++t)
+    first[t + 1] += first[t];
+
+  indices.resize(first[tiles]);
+  parallelFor(0, n, MERGE_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    std::size_t out = first[begin / MERGE_TILE];
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      if(keep[i])
+        indices[out++] = (int) i;
+    }
+  });
+  pcl::console::print_info("Station overlaps: %d points dropped in %d shared voxels\n",
+    (int) (n - indices.size()), (int) owners.size());
+  return n - indices.size();
+}
+
+template <typename PointT>
+void downSampleMerged(typename pcl::PointCloud<PointT>::Ptr& cloud, const std::vector<std::size_t>& slices,
+  typename pcl::PointCloud<PointT>::Ptr& cloudFiltered, float leafSize)
+{
+  if(slices.size() <= 2)
+  {
+    downSample<PointT>(cloud, cloudFiltered, leafSize);
+    return;
+  }
+  TRACE_SCOPE_VAR(span, "downSampleMerged", cloud->size());
+  pcl::IndicesPtr indices(new std::vector<int>);
+  overlapFreeIndices(*cloud, slices, leafSize, *indices);
+
+  // The voxel grid reads the kept points in place instead of a copy.
+  pcl::VoxelGrid<PointT> sor;
+  sor.setInputCloud(cloud);
+  sor.setIndices(indices);
+  sor.setLeafSize(leafSize, leafSize, leafSize);
+  sor.filter(*cloudFiltered);
+
+  std::cerr << "PointCloud of " << slices.size() - 1 << " stations after filtering: "
+       << cloudFiltered->width * cloudFiltered->height << " data points." << std::endl;
+}
+
+template int loadClouds<pcl::PointXYZ>(const std::vector<std::string>&, pcl::PointCloud<pcl::PointXYZ>::Ptr&, std::vector<std::size_t>&, Eigen::Vector3d&, const CloudRoi&);
+template int loadClouds<pcl::PointXYZRGB>(const std::vector<std::string>&, pcl::PointCloud<pcl::PointXYZRGB>::Ptr&, std::vector<std::size_t>&, Eigen::Vector3d&, const CloudRoi&);
+template int loadClouds<pcl::PointNormal>(const std::vector<std::string>&, pcl::PointCloud<pcl::PointNormal>::Ptr&, std::vector<std::size_t>&, Eigen::Vector3d&, const CloudRoi&);
+template void downSampleMerged<pcl::PointXYZ>(pcl::PointCloud<pcl::PointXYZ>::Ptr&, const std::vector<std::size_t>&, pcl::PointCloud<pcl::PointXYZ>::Ptr&, float);
+template void downSampleMerged<pcl::PointXYZRGB>(pcl::PointCloud<pcl::PointXYZRGB>::Ptr&, const std::vector<std::size_t>&, pcl::PointCloud<pcl::PointXYZRGB>::Ptr&, float);
+template void downSampleMerged<pcl::PointNormal>(pcl::PointCloud<pcl::PointNormal>::Ptr&, const std::vector<std::size_t>&, pcl::PointCloud<pcl::PointNormal>::Ptr&, float);
@@ -0,0 +1,55 @@
+/*********************************
+       MULTI-STATION INPUT
+**********************************/
+// A survey arrives as one file per scanner station, in any mix of .pcd,
+// .ply, .txt and .xyz. loadClouds reads all of them into one cloud:
+//
+//   1. per file, concurrently: text files run their first pass (point
+//      count and frame origin), .pcd/.ply files load into a scratch cloud
+//   2. the merged cloud is sized once; file f owns [slices[f], slices[f+1])
+//   3. per file, concurrently: text files parse straight into their slice,
+//      scratch clouds are copied into theirs and released
+//
+// Text files each pick their own whole-metre origin. The merged cloud
+// uses the point-weighted mean of those, and each slice is shifted into it
+// in double before the float conversion.
+//
+// Overlapping stations never coincide exactly, and averaging two scans of
+// one wall into a voxel thickens it. downSampleMerged therefore keeps, in
+// each voxel that several stations reach, only the points of the station
+// with the most points there, then downsamples like downSample.
+
+#ifndef MESHPCL_MERGE_CLOUDS_H
+#define MESHPCL_MERGE_CLOUDS_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "point_fields.h"
+#include "roi.h"
+
+// Point type covering every file: normals only when all files have them,
+// colour when any file has it.
+CloudPointType commonPointType(const std::vector<std::string>& filenames);
+
+// Loads and concatenates 'filenames' in order; 'slices' receives the first
+// index of every file plus the total. 'offset' and 'roi' as for loadCloud.
+// Returns -1 if any file fails. Instantiated for the types in
+// point_fields.h.
+template <typename PointT>
+int loadClouds(const std::vector<std::string>& filenames, typename pcl::PointCloud<PointT>::Ptr& cloud,
+  std::vector<std::size_t>& slices, Eigen::Vector3d& offset, const CloudRoi& roi = CloudRoi());
+
+// downSample of 'cloud' without the points of all but the densest station
+// in each shared voxel. 'cloud' itself is left untouched.
+template <typename PointT>
+void downSampleMerged(typename pcl::PointCloud<PointT>::Ptr& cloud, const std::vector<std::size_t>& slices,
+  typename pcl::PointCloud<PointT>::Ptr& cloudFiltered, float leafSize);
+
+#endif // MESHPCL_MERGE_CLOUDS_H
@@ -0,0 +1,385 @@
+#include "mesh_metrics.h"
+
+#include <pcl/conversions.h>
+#include <pcl/search/search.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <vector>
+
+#include "parallel.h"
+#include "pipeline.h"
+#include "trace.h"
+
+// Queries per tile; partial sums are kept per tile and combined in order.
+static const std::size_t METRICS_TILE = 4096;
+// Triangles per BVH leaf.
+static const std::size_t BVH_LEAF = 4;
+
+typedef pcl::PointCloud<pcl::PointXYZ> CloudXYZ;
+
+struct Triangle
+{
+  Eigen::Vector3f a, b, c;
+};
+
+// Closest point to p on triangle abc, from the Voronoi regions of its
+// vertices, edges and face (Ericson, Real-Time Collision Detection 5.1.5).
+static Eigen::Vector3f closestPointOnTriangle(const Eigen::Vector3f& p, const Triangle& t)
+{
+  const Eigen::Vector3f ab = t.b - t.a;
+  const Eigen::Vector3f ac = t.c - t.a;
+  const Eigen::Vector3f ap = p - t.a;
+  const float d1 = ab.dot(ap);
+  const float d2 = ac.dot(ap);
+  if(d1 <= 0.0f && d2 <= 0.0f)
+    return t.a;
+
+  const Eigen::Vector3f bp = p - t.b;
+  const float d3 = ab.dot(bp);
+  const float d4 = ac.dot(bp);
+  if(d3 >= 0.0f && d4 <= d3)
+    return t.b;
+
+  const float vc = d1 * d4 - d3 * d2;
+  if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+    return t.a + ab * (d1 / (d1 - d3));
+
+  const Eigen::Vector3f cp = p - t.c;
+  const float d5 = ab.dot(cp);
+  const float d6 = ac.dot(cp);
+  if(d6 >= 0.0f && d5 <= d6)
+    return t.c;
+
+  const float vb = d5 * d2 - d1 * d6;
+  if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+    return t.a + ac * (d2 / (d2 - d6));
+
+  const float va = d3 * d6 - d5 * d4;
+  if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+    return t.b + (t.c - t.b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+  const float denominator = 1.0f / (va + vb + vc);
+  return t.a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// Bounding volume hierarchy over triangles: flat node array, children of
+// an inner node stored next to each other, split at the centroid median of
+// the longest axis.
+class TriangleBvh
+{
+public:
+  explicit TriangleBvh(std::vector<Triangle>& triangles) : triangles_(triangles)
+  {
+    if(triangles_.empty())
+      return;
+    nodes_.reserve(2 * (triangles_.size() / BVH_LEAF + 1));
+    nodes_.push_back(Node());
+    build(0, 0, triangles_.size());
+  }
+
+  // Squared distance from p to the closest triangle.
+  float closestSqrDistance(const Eigen::Vector3f& p) const
+  {
+    float best = std::numeric_limits<float>::infinity();
+    if(nodes_.empty())
+      return best;
+    std::uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while(top > 0)
+    {
+      const Node& node = nodes_[stack[--top]];
+      if(boxSqrDistance(p, node) >= best)
+        continue;
+      if(node.count > 0)
+      {
+        for(std::uint32_t i = node.first; i < node.first + node.count; ++i)
+          best = std::min(best, (closestPointOnTriangle(p, triangles_[i]) - p).squaredNorm());
+        continue;
+      }
+      // Nearer child on top of the stack so it tightens 'best' first.
+      const std::uint32_t left = node.first;
+      const float left_distance = boxSqrDistance(p, nodes_[left]);
+      const float right_distance = boxSqrDistance(p, nodes_[left + 1]);
+      if(left_distance <= right_distance)
+      {
+        stack[top++] = left + 1;
+        stack[top++] = left;
+      }
+      else
+      {
+        stack[top++] = left;
+        stack[top++] = left + 1;
+      }
+    }
+    return best;
+  }
+
+private:
+  // Leaf: triangles [first, first + count). Inner (count 0): children at
+  // first and first + 1.
+  struct Node
+  {
+    float min[3];
+    float max[3];
+    std::uint32_t first;
+    std::uint32_t count;
+  };
+
+  static float boxSqrDistance(const Eigen::Vector3f& p, const Node& node)
+  {
+    float distance = 0.0f;
+    for(int k = 0; k < 3; ++k)
+    {
+      const float d = std::max(std::max(node.min[k] - p[k], p[k] - node.max[k]), 0.0f);
+      distance += d * d;
+    }
+    return distance;
+  }
+
+  void build(std::size_t index, std::size_t first, std::size_t last)
+  {
+    Eigen::Vector3f box_min = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+    Eigen::Vector3f box_max = -box_min;
+    Eigen::Vector3f centroid_min = box_min;
+    Eigen::Vector3f centroid_max = box_max;
+    for(std::size_t i = first; i < last; ++i)
+    {
+      const Triangle& t = triangles_[i];
+      box_min = box_min.cwiseMin(t.a).cwiseMin(t.b).cwiseMin(t.c);
+      box_max = box_max.cwiseMax(t.a).cwiseMax(t.b).cwiseMax(t.c);
+      const Eigen::Vector3f centroid = t.a + t.b + t.c;
+      centroid_min = centroid_min.cwiseMin(centroid);
+      centroid_max = centroid_max.cwiseMax(centroid);
+    }
+    for(int k = 0; k < 3; ++k)
+    {
+      nodes_[index].min[k] = box_min[k];
+      nodes_[index].max[k] = box_max[k];
+    }
+
+    int axis;
+    const float extent = (centroid_max - centroid_min).maxCoeff(&axis);
+    if(last - first <= BVH_LEAF || !(extent > 0.0f))
+    {
+      nodes_[index].first = (std::uint32_t) first;
+      nodes_[index].count = (std::uint32_t) (last - first);
+      return;
+    }
+
+    const std::size_t middle = first + (last - first) / 2;
+    std::nth_element(triangles_.begin() + first, triangles_.begin() + middle, triangles_.begin() + last,
+      [axis](const Triangle& x, const Triangle& y)
+      {
+        return x.a[axis] + x.b[axis] + x.c[axis] < y.a[axis] + y.b[axis] + y.c[axis];
+      });
+
+    const std::size_t left = nodes_.size();
+    nodes_[index].first = (std::uint32_t) left;
+    nodes_[index].count = 0;
+    nodes_.push_back(Node());
+    nodes_.push_back(Node());
+    build(left, first, middle);
+    build(left + 1, middle, last);
+  }
+
+  std::vector<Triangle>& triangles_;
+  std::vector<Node> nodes_;
+};
+
+// Sum of squares, sum and maximum of distances, per tile.
+struct DistanceTotals
+{
+  double sqr_sum;
+  double sum;
+  double max;
+  std::size_t count;
+
+  DistanceTotals() : sqr_sum(0.0), sum(0.0), max(0.0), count(0) {}
+
+  void add(double sqr_distance)
+  {
+    sqr_sum += sqr_distance;
+    sum += std::sqrt(sqr_distance);
+    max = std::max(max, sqr_distance);
+    ++count;
+  }
+
+  void add(const DistanceTotals& other)
+  {
+    sqr_sum += other.sqr_sum;
+    sum += other.sum;
+    max = std::max(max, other.max);
+    count += other.count;
+  }
+};
+
+static DistanceTotals combineTiles(const std::vector<DistanceTotals>& tiles)
+{
+  DistanceTotals total;
+  for(std::size_t t = 0; t < tiles.size(); ++t)
+    total.add(tiles[t]);
+  return total;
+}
+
+template <typename PointT>
+bool computeMeshMetrics(const pcl::PointCloud<PointT>& cloud, const Eigen::Vector3d& shift,
+  const pcl::PolygonMesh& mesh, MeshMetrics& metrics)
+{
+  TRACE_SCOPE_VAR(span, "computeMeshMetrics", cloud.size());
+  metrics = MeshMetrics();
+
+  CloudXYZ vertices;
+  pcl::fromPCLPointCloud2(mesh.cloud, vertices);
+
+  // Fans of the valid polygons, and the vertices they use.
+  std::vector<Triangle> triangles;
+  std::vector<char> used(vertices.size(), 0);
+  triangles.reserve(mesh.polygons.size());
+  for(std::size_t f = 0; f < mesh.polygons.size(); ++f)
+  {
+    const std::vector<std::uint32_t>& v = mesh.polygons[f].vertices;
+    if(v.size() < 3)
+      continue;
+    bool valid = true;
+    for(std::size_t k = 0; k < v.size() && valid; ++k)
+      valid = v[k] < vertices.size() && pcl::isFinite(vertices.points[v[k]]);
+    if(!valid)
+      continue;
+    for(std::size_t k = 0; k < v.size(); ++k)
+      used[v[k]] = 1;
+    for(std::size_t k = 2; k < v.size(); ++k)
+    {
+      Triangle t;
+      t.a = vertices.points[v[0]].getVector3fMap();
+      t.b = vertices.points[v[k - 1]].getVector3fMap();
+      t.c = vertices.points[v[k]].getVector3fMap();
+      triangles.push_back(t);
+    }
+  }
+
+  CloudXYZ::Ptr points(new CloudXYZ);
+  points->reserve(cloud.size());
+  for(std::size_t i = 0; i < cloud.size(); ++i)
+  {
+    const PointT& p = cloud.points[i];
+    if(!pcl::isFinite(p))
+      continue;
+    points->push_back(pcl::PointXYZ((float) (p.x + shift[0]), (float) (p.y + shift[1]), (float) (p.z + shift[2])));
+  }
+
+  metrics.points = points->size();
+  metrics.triangles = triangles.size();
+  if(points->empty() || triangles.empty())
+    return false;
+
+  // Faces are sampled at their centroid before the BVH reorders them.
+  std::vector<Eigen::Vector3f, Eigen::aligned_allocator<Eigen::Vector3f> > samples;
+  samples.reserve(vertices.size() + triangles.size());
+  for(std::size_t i = 0; i < vertices.size(); ++i)
+  {
+    if(used[i])
+      samples.push_back(vertices.points[i].getVector3fMap());
+  }
+  for(std::size_t t = 0; t < triangles.size(); ++t)
+    samples.push_back((triangles[t].a + triangles[t].b + triangles[t].c) / 3.0f);
+  metrics.samples = samples.size();
+
+  DistanceTotals cloud_to_mesh;
+  {
+    TRACE_SCOPE_VAR(to_mesh, "computeMeshMetrics/cloudToMesh", points->size());
+    TriangleBvh bvh(triangles);
+    std::vector<DistanceTotals> tiles((points->size() + METRICS_TILE - 1) / METRICS_TILE);
+    parallelFor(0, points->size(), METRICS_TILE, [&](std::size_t first, std::size_t last)
+    {
+      DistanceTotals& tile = tiles[first / METRICS_TILE];
+      for(std::size_t i = first; i < last; ++i)
+        tile.add(bvh.closestSqrDistance(points->points[i].getVector3fMap()));
+    });
+    cloud_to_mesh = combineTiles(tiles);
+  }
+
+  DistanceTotals mesh_to_cloud;
+  {
+    TRACE_SCOPE_VAR(to_cloud, "computeMeshMetrics/meshToCloud", samples.size());
+    pcl::search::Search<pcl::PointXYZ>::Ptr index = buildSearchIndex<pcl::PointXYZ>(points);
+    std::vector<DistanceTotals> tiles((samples.size() + METRICS_TILE - 1) / METRICS_TILE);
+    parallelFor(0, samples.size(), METRICS_TILE, [&](std::size_t first, std::size_t last)
+    {
+      DistanceTotals& tile = tiles[first / METRICS_TILE];
+      std::vector<int> neighbour(1);
+      std::vector<float> sqr_distance(1);
+      for(std::size_t i = first; i < last; ++i)
+      {
+        const pcl::PointXYZ query(samples[i][0], samples[i][1], samples[i][2]);
+        if(index->nearestKSearch(query, 1, neighbour, sqr_distance) > 0)
+          tile.add(sqr_distance[0]);
+      }
+    });
+    mesh_to_cloud = combineTiles(tiles);
+  }
+
+  if(cloud_to_mesh.count > 0)
+  {
+    metrics.cloud_to_mesh_rms = std::sqrt(cloud_to_mesh.sqr_sum / cloud_to_mesh.count);
+    metrics.cloud_to_mesh_mean = cloud_to_mesh.sum / cloud_to_mesh.count;
+    metrics.cloud_to_mesh_max = std::sqrt(cloud_to_mesh.max);
+  }
+  if(mesh_to_cloud.count > 0)
+  {
+    metrics.mesh_to_cloud_rms = std::sqrt(mesh_to_cloud.sqr_sum / mesh_to_cloud.count);
+    metrics.mesh_to_cloud_mean = mesh_to_cloud.sum / mesh_to_cloud.count;
+    metrics.mesh_to_cloud_max = std::sqrt(mesh_to_cloud.max);
+  }
+  DistanceTotals both = cloud_to_mesh;
+  both.add(mesh_to_cloud);
+  if(both.count > 0)
+    metrics.rms = std::sqrt(both.sqr_sum / both.count);
+  metrics.hausdorff = std::max(metrics.cloud_to_mesh_max, metrics.mesh_to_cloud_max);
+  return true;
+}
+
+void printMeshMetrics(std::ostream& os, const MeshMetrics& metrics)
+{
+  std::ios::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+  os << std::setprecision(6);
+  os << "Mesh accuracy: " << metrics.points << " points, " << metrics.samples << " mesh samples, "
+     << metrics.triangles << " triangles\n";
+  os << "  cloud -> mesh   rms " << metrics.cloud_to_mesh_rms << "  mean " << metrics.cloud_to_mesh_mean
+     << "  max " << metrics.cloud_to_mesh_max << "\n";
+  os << "  mesh -> cloud   rms " << metrics.mesh_to_cloud_rms << "  mean " << metrics.mesh_to_cloud_mean
+     << "  max " << metrics.mesh_to_cloud_max << "\n";
+  os << "  symmetric       rms " << metrics.rms << "  hausdorff " << metrics.hausdorff << std::endl;
+  os.flags(flags);
+  os.precision(precision);
+}
+
+bool writeMeshMetricsJson(const std::string& path, const MeshMetrics& metrics)
+{
+  std::ofstream out(path.c_str());
+  if(!out.is_open())
+    return false;
+  out << std::setprecision(9);
+  out << "{\n  \"points\": " << metrics.points << ",\n";
+  out << "  \"mesh_samples\": " << metrics.samples << ",\n";
+  out << "  \"triangles\": " << metrics.triangles << ",\n";
+  out << "  \"cloud_to_mesh\": {\"rms\": " << metrics.cloud_to_mesh_rms
+      << ", \"mean\": " << metrics.cloud_to_mesh_mean
+      << ", \"hausdorff\": " << metrics.cloud_to_mesh_max << "},\n";
+  out << "  \"mesh_to_cloud\": {\"rms\": " << metrics.mesh_to_cloud_rms
+      << ", \"mean\": " << metrics.mesh_to_cloud_mean
+      << ", \"hausdorff\": " << metrics.mesh_to_cloud_max << "},\n";
+  out << "  \"symmetric\": {\"rms\": " << metrics.rms
+      << ", \"hausdorff\": " << metrics.hausdorff << "}\n}\n";
+  return out.good();
+}
+
+template bool computeMeshMetrics<pcl::PointXYZ>(const pcl::PointCloud<pcl::PointXYZ>&, const Eigen::Vector3d&, const pcl::PolygonMesh&, MeshMetrics&);
+template bool computeMeshMetrics<pcl::PointXYZRGB>(const pcl::PointCloud<pcl::PointXYZRGB>&, const Eigen::Vector3d&, const pcl::PolygonMesh&, MeshMetrics&);
+template bool computeMeshMetrics<pcl::PointNormal>(const pcl::PointCloud<pcl::PointNormal>&, const Eigen::Vector3d&, const pcl::PolygonMesh&, MeshMetrics&);
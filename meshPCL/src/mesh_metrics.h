@@ -0,0 +1,61 @@
+/*********************************
+        MESH ACCURACY METRICS
+**********************************/
+// Distances between a cloud and the mesh built from it, to weigh faster
+// settings against what they cost in accuracy:
+//
+//   cloud -> mesh   every finite cloud point to the closest point on any
+//                   triangle, through a BVH over the triangles
+//   mesh -> cloud   every used vertex and every face centroid to the
+//                   nearest cloud point, through a kd-tree over the cloud
+//
+// Each direction gives an RMS, a mean and a maximum (the one-sided
+// Hausdorff distance); the symmetric Hausdorff distance is the larger
+// maximum and the symmetric RMS runs over the samples of both directions.
+// Queries run in parallel over fixed tiles whose partial sums are combined
+// in tile order, so the numbers do not depend on the thread count.
+
+#ifndef MESHPCL_MESH_METRICS_H
+#define MESHPCL_MESH_METRICS_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PolygonMesh.h>
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+struct MeshMetrics
+{
+  std::size_t points;         // cloud points measured
+  std::size_t samples;        // mesh vertices and face centroids measured
+  std::size_t triangles;
+  double cloud_to_mesh_rms;
+  double cloud_to_mesh_mean;
+  double cloud_to_mesh_max;   // one-sided Hausdorff
+  double mesh_to_cloud_rms;
+  double mesh_to_cloud_mean;
+  double mesh_to_cloud_max;   // one-sided Hausdorff
+  double rms;                 // symmetric
+  double hausdorff;           // symmetric
+
+  MeshMetrics() : points(0), samples(0), triangles(0), cloud_to_mesh_rms(0.0), cloud_to_mesh_mean(0.0),
+    cloud_to_mesh_max(0.0), mesh_to_cloud_rms(0.0), mesh_to_cloud_mean(0.0), mesh_to_cloud_max(0.0),
+    rms(0.0), hausdorff(0.0) {}
+};
+
+// Compares 'cloud', moved by 'shift' into the frame of the mesh vertices,
+// with 'mesh'. Polygons with more than three vertices are split into fans.
+// Returns false when either side is empty. Instantiated for the types in
+// point_fields.h.
+template <typename PointT>
+bool computeMeshMetrics(const pcl::PointCloud<PointT>& cloud, const Eigen::Vector3d& shift,
+  const pcl::PolygonMesh& mesh, MeshMetrics& metrics);
+
+void printMeshMetrics(std::ostream& os, const MeshMetrics& metrics);
+bool writeMeshMetricsJson(const std::string& path, const MeshMetrics& metrics);
+
+#endif // MESHPCL_MESH_METRICS_H
@@ -0,0 +1,80 @@
+#include "morton_order.h"
+
+#include <cstring>
+
+// Spreads the low 21 bits of v so that bit i lands on bit 3i.
+static std::uint64_t spreadBits(std::uint32_t v)
+{
+  std::uint64_t x = v & 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+std::uint64_t mortonEncode(std::uint32_t x, std::uint32_t y, std::uint32_t z)
+{
+  return spreadBits(x) | spreadBits(y) << 1 | spreadBits(z) << 2;
+}
+
+// 8-bit digits; passes whose digit is the same for every key are skipped.
+static const int RADIX_BITS = 8;
+static const std::size_t RADIX_BUCKETS = std::size_t(1) << RADIX_BITS;
+
+void radixSortMorton(std::vector<std::uint64_t>& codes, std::vector<int>& order)
+{
+  const std::size_t n = codes.size();
+  if(n < 2)
+    return;
+  const std::size_t tiles = (n + MORTON_TILE - 1) / MORTON_TILE;
+
+  std::vector<std::uint64_t> codes_tmp(n);
+  std::vector<int> order_tmp(n);
+  std::vector<std::size_t> histogram(tiles * RADIX_BUCKETS);
+
+  for(int shift = 0; shift < 64; shift += RADIX_BITS)
+  {
+    // Per-tile digit counts.
+    parallelFor(0, n, MORTON_TILE, [&](std::size_t begin, std::size_t end)
+    {
+      std::size_t* counts = &histogram[(begin / MORTON_TILE) * RADIX_BUCKETS];
+      std::memset(counts, 0, RADIX_BUCKETS * sizeof(std::size_t));
+      for(std::size_t i = begin; i < end; ++i)
+        ++counts[(codes[i] >> shift) & (RADIX_BUCKETS - 1)];
+    });
+
+    // Exclusive prefix in digit-major, tile-minor order keeps the sort stable.
+    std::size_t total = 0;
+    bool trivial = false;
+    for(std::size_t d = 0; d < RADIX_BUCKETS; ++d)
+    {
+      std::size_t digit_count = 0;
+      for(std::size_t t = 0; t < tiles; ++t)
+      {
+        std::size_t count = histogram[t * RADIX_BUCKETS + d];
+        histogram[t * RADIX_BUCKETS + d] = total;
+        total += count;
+        digit_count += count;
+      }
+      if(digit_count == n)
+        trivial = true;
+    }
+    if(trivial)
+      continue;
+
+    parallelFor(0, n, MORTON_TILE, [&](std::size_t begin, std::size_t end)
+    {
+      std::size_t* offsets = &histogram[(begin / MORTON_TILE) * RADIX_BUCKETS];
+      for(std::size_t i = begin; i < end; ++i)
+      {
+        std::size_t slot = offsets[(codes[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+        codes_tmp[slot] = codes[i];
+        order_tmp[slot] = order[i];
+      }
+    });
+    codes.swap(codes_tmp);
+    order.swap(order_tmp);
+  }
+}
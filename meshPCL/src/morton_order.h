@@ -0,0 +1,129 @@
+/*********************************
+        MORTON POINT ORDER
+**********************************/
+// Reorders a cloud along a Z-order curve so that points close in space are
+// close in memory. The voxel grid emits points in its own hash/scan order;
+// after the reorder the kd-tree leaves of calculateNormals, MLS and GP3
+// each touch a few contiguous cache lines instead of the whole cloud.
+//
+// Codes interleave 21 bits per axis (63 bits), quantized over the cloud's
+// bounding cube, and are sorted with a parallel LSD radix sort that also
+// carries the original indices. The resulting permutation maps back:
+// reordered point i was input point order[i].
+
+#ifndef MESHPCL_MORTON_ORDER_H
+#define MESHPCL_MORTON_ORDER_H
+
+#include <pcl/point_cloud.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "parallel.h"
+
+// Points per task of the Morton stages.
+static const std::size_t MORTON_TILE = 65536;
+
+// Interleaves the low 21 bits of x, y and z (x in bit 0).
+std::uint64_t mortonEncode(std::uint32_t x, std::uint32_t y, std::uint32_t z);
+
+// Stable parallel radix sort of 'codes', applying the same moves to
+// 'order'. Both vectors must have the same size.
+void radixSortMorton(std::vector<std::uint64_t>& codes, std::vector<int>& order);
+
+// Gathers values[order[i]] into position i.
+template <typename T, typename Alloc>
+void applyPermutation(std::vector<T, Alloc>& values, const std::vector<int>& order)
+{
+  std::vector<T, Alloc> sorted(values.size());
+  parallelFor(0, order.size(), MORTON_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    for(std::size_t i = begin; i < end; ++i)
+      sorted[i] = values[order[i]];
+  });
+  values.swap(sorted);
+}
+
+// Computes the Morton order of 'cloud' into 'order' without moving points.
+// Non-finite points sort last.
+template <typename PointT>
+void computeMortonOrder(const pcl::PointCloud<PointT>& cloud, std::vector<int>& order)
+{
+  const std::size_t n = cloud.points.size();
+  const std::size_t tiles = (n + MORTON_TILE - 1) / MORTON_TILE;
+
+  // Bounding box per tile, then combined.
+  std::vector<float> bounds(tiles * 6);
+  parallelFor(0, n, MORTON_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    float* b = &bounds[(begin / MORTON_TILE) * 6];
+    for(int k = 0; k < 3; ++k)
+    {
+      b[k] = std::numeric_limits<float>::max();
+      b[k + 3] = -std::numeric_limits<float>::max();
+    }
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      const PointT& p = cloud.points[i];
+      if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+        continue;
+      const float xyz[3] = { p.x, p.y, p.z };
+      for(int k = 0; k < 3; ++k)
+      {
+        b[k] = std::min(b[k], xyz[k]);
+        b[k + 3] = std::max(b[k + 3], xyz[k]);
+      }
+    }
+  });
+  float min[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+  float max[3] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+  for(std::size_t t = 0; t < tiles; ++t)
+  {
+    for(int k = 0; k < 3; ++k)
+    {
+      min[k] = std::min(min[k], bounds[t * 6 + k]);
+      max[k] = std::max(max[k], bounds[t * 6 + k + 3]);
+    }
+  }
+  float extent = 0.0f;
+  for(int k = 0; k < 3; ++k)
+    extent = std::max(extent, max[k] - min[k]);
+  // One scale for all axes keeps the cells cubic.
+  const double scale = extent > 0.0f ? double((1u << 21) - 1) / extent : 0.0;
+
+  std::vector<std::uint64_t> codes(n);
+  order.resize(n);
+  parallelFor(0, n, MORTON_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      const PointT& p = cloud.points[i];
+      order[i] = (int) i;
+      if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+      {
+        codes[i] = std::numeric_limits<std::uint64_t>::max();
+        continue;
+      }
+      codes[i] = mortonEncode((std::uint32_t) ((p.x - min[0]) * scale),
+        (std::uint32_t) ((p.y - min[1]) * scale), (std::uint32_t) ((p.z - min[2]) * scale));
+    }
+  });
+  radixSortMorton(codes, order);
+}
+
+// Sorts 'cloud' into Morton order in place; 'order' receives the
+// permutation (new index -> input index) for mapping results back.
+template <typename PointT>
+void reorderMorton(pcl::PointCloud<PointT>& cloud, std::vector<int>& order)
+{
+  computeMortonOrder(cloud, order);
+  applyPermutation(cloud.points, order);
+  cloud.width = (std::uint32_t) cloud.points.size();
+  cloud.height = 1;
+}
+
+#endif // MESHPCL_MORTON_ORDER_H
@@ -0,0 +1,60 @@
+#include "organized.h"
+
+#include <pcl/common/io.h>
+#include <pcl/console/print.h>
+#include <pcl/features/integral_image_normal.h>
+#include <pcl/surface/organized_fast_mesh.h>
+#include <pcl/surface/simplification_remove_unused_vertices.h>
+
+#include "trace.h"
+
+template <typename PointT>
+void organizedNormals(const typename pcl::PointCloud<PointT>::Ptr& cloud, const OrganizedParams& params,
+  pcl::PointCloud<pcl::PointNormal>::Ptr& normals)
+{
+  TRACE_SCOPE_VAR(span, "organizedNormals", cloud->size());
+  pcl::PointCloud<pcl::Normal> estimated;
+  pcl::IntegralImageNormalEstimation<PointT, pcl::Normal> estimator;
+  estimator.setNormalEstimationMethod(pcl::IntegralImageNormalEstimation<PointT, pcl::Normal>::AVERAGE_3D_GRADIENT);
+  estimator.setMaxDepthChangeFactor(params.max_depth_change);
+  estimator.setNormalSmoothingSize(params.smoothing);
+  estimator.setViewPoint(cloud->sensor_origin_[0], cloud->sensor_origin_[1], cloud->sensor_origin_[2]);
+  estimator.setInputCloud(cloud);
+  estimator.compute(estimated);
+
+  pcl::concatenateFields(*cloud, estimated, *normals);
+  normals->width = cloud->width;
+  normals->height = cloud->height;
+  normals->is_dense = false;
+  normals->sensor_origin_ = cloud->sensor_origin_;
+  normals->sensor_orientation_ = cloud->sensor_orientation_;
+}
+
+void organizedMesh(const pcl::PointCloud<pcl::PointNormal>::Ptr& cloud, const OrganizedParams& params,
+  pcl::PolygonMesh& mesh)
+{
+  TRACE_SCOPE_VAR(span, "organizedMesh", cloud->size());
+  pcl::PolygonMesh grid_mesh;
+  {
+    TRACE_SCOPE_VAR(triangulate, "organizedMesh/triangulate", cloud->size());
+    pcl::OrganizedFastMesh<pcl::PointNormal> triangulation;
+    triangulation.setTrianglePixelSize(params.pixel_step);
+    triangulation.setTriangulationType(pcl::OrganizedFastMesh<pcl::PointNormal>::TRIANGLE_ADAPTIVE_CUT);
+    if(params.max_edge > 0.0f)
+      triangulation.setMaxEdgeLength(params.max_edge);
+    triangulation.setViewpoint(cloud->sensor_origin_.head<3>());
+    triangulation.setInputCloud(cloud);
+    triangulation.reconstruct(grid_mesh);
+  }
+  {
+    // The grid mesh carries every pixel, NaN ones included.
+    TRACE_SCOPE_VAR(compact, "organizedMesh/removeUnusedVertices", cloud->size());
+    pcl::surface::SimplificationRemoveUnusedVertices simplification;
+    simplification.simplify(grid_mesh, mesh);
+  }
+  pcl::console::print_info("Organized mesh: %d x %d grid, %d triangles\n",
+    (int) cloud->width, (int) cloud->height, (int) mesh.polygons.size());
+}
+
+template void organizedNormals<pcl::PointXYZ>(const pcl::PointCloud<pcl::PointXYZ>::Ptr&, const OrganizedParams&, pcl::PointCloud<pcl::PointNormal>::Ptr&);
+template void organizedNormals<pcl::PointXYZRGB>(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr&, const OrganizedParams&, pcl::PointCloud<pcl::PointNormal>::Ptr&);
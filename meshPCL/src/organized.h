@@ -0,0 +1,48 @@
+/*********************************
+      ORGANIZED CLOUD FAST PATH
+**********************************/
+// Terrestrial scans arrive as a row/column grid (height > 1), which
+// already says who neighbours whom. For such clouds the pipeline skips the
+// voxel grid, kd-tree, k-NN normals and Poisson: normals come from
+// integral images over the grid and the mesh from connecting adjacent grid
+// cells, both linear in the number of pixels with no neighbour search.
+// Invalid (NaN) pixels stay in place until the mesh is built, then the
+// vertices no face uses are dropped.
+
+#ifndef MESHPCL_ORGANIZED_H
+#define MESHPCL_ORGANIZED_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PolygonMesh.h>
+
+struct OrganizedParams
+{
+  int pixel_step;           // grid stride of the triangles, 1 uses every pixel
+  float max_depth_change;   // integral image normals: depth discontinuity factor
+  float smoothing;          // integral image normals: smoothing window in pixels
+  float max_edge;           // longest triangle edge, 0 for no limit
+
+  OrganizedParams() : pixel_step(1), max_depth_change(0.02f), smoothing(10.0f), max_edge(0.0f) {}
+};
+
+// Integral image normals of an organized cloud, oriented towards its
+// sensor origin. 'normals' keeps the grid layout of 'cloud'.
+template <typename PointT>
+void organizedNormals(const typename pcl::PointCloud<PointT>::Ptr& cloud, const OrganizedParams& params,
+  pcl::PointCloud<pcl::PointNormal>::Ptr& normals);
+
+template <>
+inline void organizedNormals<pcl::PointNormal>(const pcl::PointCloud<pcl::PointNormal>::Ptr& cloud,
+  const OrganizedParams&, pcl::PointCloud<pcl::PointNormal>::Ptr& normals)
+{
+  normals = cloud;
+}
+
+// Triangulates adjacent valid pixels of an organized cloud, cutting
+// quads along their shorter diagonal and skipping faces seen edge-on from
+// the sensor. Unused vertices are removed from 'mesh'.
+void organizedMesh(const pcl::PointCloud<pcl::PointNormal>::Ptr& cloud, const OrganizedParams& params,
+  pcl::PolygonMesh& mesh);
+
+#endif // MESHPCL_ORGANIZED_H
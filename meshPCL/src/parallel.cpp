@@ -0,0 +1,58 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "task_scheduler.h"
+
+unsigned int parallelThreads()
+{
+  static const unsigned int threads = []()
+  {
+    const char* env = std::getenv("MESHPCL_THREADS");
+    int requested = env ? std::atoi(env) : 0;
+    if(requested > 0)
+      return (unsigned int) requested;
+    return std::max(1u, std::thread::hardware_concurrency());
+  }();
+  return threads;
+}
+
+void parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+  const std::function<void(std::size_t, std::size_t)>& body)
+{
+  if(end <= begin)
+    return;
+  grain = std::max<std::size_t>(1, grain);
+
+  const std::size_t chunks = (end - begin + grain - 1) / grain;
+  TaskScheduler& scheduler = TaskScheduler::instance();
+  const std::size_t tasks = std::min<std::size_t>(scheduler.threads(), chunks);
+  if(tasks <= 1)
+  {
+    for(std::size_t b = begin; b < end; b += grain)
+      body(b, std::min(end, b + grain));
+    return;
+  }
+
+  // A few tasks pull chunks off a shared counter, so whichever thread is
+  // free takes the next chunk and no straggler holds the loop.
+  std::atomic<std::size_t> next(0);
+  auto run = [&]()
+  {
+    for(std::size_t c = next++; c < chunks; c = next++)
+    {
+      std::size_t b = begin + c * grain;
+      body(b, std::min(end, b + grain));
+    }
+  };
+
+  TaskGroup group(scheduler);
+  for(std::size_t t = 1; t < tasks; ++t)
+    group.run(run);
+  run();
+  group.wait();
+}
@@ -0,0 +1,22 @@
+/*********************************
+        PARALLEL LOOPS
+**********************************/
+
+#ifndef MESHPCL_PARALLEL_H
+#define MESHPCL_PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Worker count used by parallel stages: MESHPCL_THREADS if set, otherwise
+// the hardware concurrency.
+unsigned int parallelThreads();
+
+// Calls body(chunk_begin, chunk_end) over [begin, end) in chunks of at most
+// 'grain' elements on the shared TaskScheduler. Returns once every chunk
+// has run; the caller works on chunks meanwhile. Chunks may run in any
+// order, and body may itself call parallelFor.
+void parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+  const std::function<void(std::size_t, std::size_t)>& body);
+
+#endif // MESHPCL_PARALLEL_H
@@ -0,0 +1,766 @@
+/*********************************
+           HEADERS
+**********************************/
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/io/ply_io.h>
+#include <pcl/io/vtk_io.h>
+#include <pcl/io/io.h>
+#include <pcl/io/vtk_lib_io.h>
+#include <pcl/io/file_io.h>
+#include <pcl/io/ply/ply_parser.h>
+#include <pcl/io/ply/ply.h>
+
+#include <pcl/point_types.h>
+
+#include <pcl/console/print.h>
+#include <pcl/console/parse.h>
+#include <pcl/console/time.h>
+
+#include <pcl/range_image/range_image.h>
+
+#include <pcl/common/transforms.h>
+#include <pcl/common/geometry.h>
+#include <pcl/common/common.h>
+#include <pcl/common/common_headers.h>
+
+#include <pcl/ModelCoefficients.h>
+
+#include <pcl/features/normal_3d.h>
+#include <pcl/features/gasd.h>
+#include <pcl/features/normal_3d_omp.h>
+
+#include <pcl/filters/crop_box.h>
+#include <pcl/filters/crop_hull.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/filters/passthrough.h>
+#include <pcl/filters/extract_indices.h>
+#include <pcl/filters/project_inliers.h>
+#include <pcl/filters/radius_outlier_removal.h>
+#include <pcl/filters/statistical_outlier_removal.h>
+
+#include <pcl/segmentation/sac_segmentation.h>
+#include <pcl/segmentation/extract_clusters.h>
+
+#include <pcl/surface/poisson.h>
+#include <pcl/surface/mls.h>
+#include <pcl/surface/simplification_remove_unused_vertices.h>
+#include <pcl/surface/vtk_smoothing/vtk_utils.h>
+#include <pcl/surface/gp3.h>
+#include <pcl/surface/convex_hull.h>
+
+#include <pcl/sample_consensus/method_types.h>
+#include <pcl/sample_consensus/model_types.h>
+
+#include <pcl/search/search.h>
+#include <pcl/search/kdtree.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/algorithm.hpp>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include "cloud_io.h"
+#include "cloud_transform.h"
+#include "morton_order.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "roi_extract.h"
+#include "trace.h"
+
+// Points per task in the tiled normal and MLS stages.
+static const std::size_t STAGE_TILE = 4096;
+
+// Kd-tree shared by the tasks of one tiled stage. PCL estimators call
+// setInputCloud on their search method before every compute; this skips
+// the rebuild when the cloud is the one already indexed, so concurrent
+// tiles only ever search it.
+template <typename PointT>
+class SharedKdTree : public pcl::search::KdTree<PointT>
+{
+public:
+  typedef boost::shared_ptr<SharedKdTree<PointT> > Ptr;
+
+  void setInputCloud(const typename pcl::search::KdTree<PointT>::PointCloudConstPtr& cloud,
+    const pcl::IndicesConstPtr& indices = pcl::IndicesConstPtr()) override
+  {
+    if(cloud && cloud == this->getInputCloud() && !indices && !this->getIndices())
+      return;
+    pcl::search::KdTree<PointT>::setInputCloud(cloud, indices);
+  }
+};
+
+// Indices [begin, end) for restricting an estimator to one tile.
+static pcl::IndicesPtr tileIndices(std::size_t begin, std::size_t end)
+{
+  pcl::IndicesPtr indices(new std::vector<int>(end - begin));
+  for(std::size_t i = begin; i < end; ++i)
+    (*indices)[i - begin] = (int) i;
+  return indices;
+}
+
+CloudPointType detectPointType(const std::string& filename)
+{
+  std::string extension = boost::algorithm::to_lower_copy(boost::filesystem::path(filename).extension().string());
+  if(extension == ".txt")
+    return CLOUD_XYZRGB;
+  if(extension == ".xyz")
+    return CLOUD_XYZ;
+
+  // Header only: the fields decide the instantiation before any point is read.
+  pcl::PCLPointCloud2 header;
+  Eigen::Vector4f origin;
+  Eigen::Quaternionf orientation;
+  int version = 0;
+  int data_type = 0;
+  unsigned int data_idx = 0;
+  int result = -1;
+  if(extension == ".pcd")
+  {
+    pcl::PCDReader reader;
+    result = reader.readHeader(filename, header, origin, orientation, version, data_type, data_idx);
+  }
+  else if(extension == ".ply")
+  {
+    pcl::PLYReader reader;
+    result = reader.readHeader(filename, header, origin, orientation, version, data_type, data_idx);
+  }
+  if(result < 0)
+    return CLOUD_XYZRGB; // loadCloud reports the unreadable file
+
+  if(pcl::getFieldIndex(header, "normal_x") >= 0 && pcl::getFieldIndex(header, "normal_y") >= 0
+    && pcl::getFieldIndex(header, "normal_z") >= 0)
+    return CLOUD_XYZ_NORMAL;
+  if(pcl::getFieldIndex(header, "rgb") >= 0 || pcl::getFieldIndex(header, "rgba") >= 0)
+    return CLOUD_XYZRGB;
+  return CLOUD_XYZ;
+}
+
+template <typename PointT>
+int loadCloud(const std::string& filename, typename pcl::PointCloud<PointT>::Ptr& cloud)
+{
+  Eigen::Vector3d offset;
+  return loadCloud<PointT>(filename, cloud, offset);
+}
+
+// Drops the records of 'blob' outside 'roi' in place, keeping their order.
+// Returns the number of records dropped, or -1 without float x/y/z fields.
+static long cropRecords(pcl::PCLPointCloud2& blob, const CloudRoi& roi)
+{
+  const int fields[3] = { pcl::getFieldIndex(blob, "x"), pcl::getFieldIndex(blob, "y"), pcl::getFieldIndex(blob, "z") };
+  for(int k = 0; k < 3; ++k)
+  {
+    if(fields[k] < 0 || blob.fields[fields[k]].datatype != pcl::PCLPointField::FLOAT32)
+      return -1;
+  }
+  const std::size_t n = (std::size_t) blob.width * blob.height;
+  const std::size_t step = blob.point_step;
+  std::vector<unsigned char> keep(n);
+  parallelFor(0, n, TRANSFORM_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      double xyz[3];
+      for(int k = 0; k < 3; ++k)
+      {
+        float value;
+        std::memcpy(&value, &blob.data[i * step + blob.fields[fields[k]].offset], sizeof(float));
+        xyz[k] = value;
+      }
+      keep[i] = roi.contains(xyz);
+    }
+  });
+  std::size_t kept = 0;
+  for(std::size_t i = 0; i < n; ++i)
+  {
+    if(!keep[i])
+      continue;
+    if(kept != i)
+      std::memmove(&blob.data[kept * step], &blob.data[i * step], step);
+    ++kept;
+  }
+  blob.data.resize(kept * step);
+  blob.width = (std::uint32_t) kept;
+  blob.height = 1;
+  blob.row_step = (std::uint32_t) (kept * step);
+  return (long) (n - kept);
+}
+
+template <typename PointT>
+int loadCloud(const std::string& filename, typename pcl::PointCloud<PointT>::Ptr& cloud,
+  Eigen::Vector3d& offset, const CloudRoi& roi)
+{
+  offset.setZero();
+  pcl::console::TicToc tt;
+  tt.tic();
+
+  boost::filesystem::path path(filename);
+  std::string extension = boost::algorithm::to_lower_copy(path.extension().string());
+
+  if(roi.active() && (extension == ".pcd" || extension == ".ply"))
+  {
+    // PCL parses whole files, so the raw records are cropped before the
+    // PointT cloud is allocated; the ROI decides its size, not the file.
+    pcl::PCLPointCloud2 blob;
+    if(extension == ".pcd")
+    {
+      if(pcl::io::loadPCDFile(filename, blob) < 0){
+        std::cout << "Error loading point cloud " << filename << "\n";
+        return -1;
+      }
+    }
+    else if(pcl::io::loadPLYFile(filename, blob) < 0 || blob.width * blob.height == 0)
+    {
+      pcl::console::print_warn("\nloadPLYFile could not read the cloud, attempting to loadPolygonFile...\n");
+      pcl::PolygonMesh cl;
+      pcl::io::loadPolygonFile(filename, cl);
+      if(cl.cloud.width * cl.cloud.height == 0){
+        pcl::console::print_error("\nError. ply file is not compatible.\n");
+        return -1;
+      }
+      blob = cl.cloud;
+    }
+    const std::size_t records = (std::size_t) blob.width * blob.height;
+    if(cropRecords(blob, roi) < 0){
+      pcl::console::print_error("\nError. %s has no float x/y/z fields.\n", filename.c_str());
+      return -1;
+    }
+    pcl::fromPCLPointCloud2(blob, *cloud);
+    pcl::console::print_info("\nFound %s file, %d of %d points inside the region of interest\n",
+      extension.c_str() + 1, (int) cloud->points.size(), (int) records);
+  }
+  else if(extension == ".pcd")
+  {
+    if(pcl::io::loadPCDFile(filename, *cloud) < 0){
+      std::cout << "Error loading point cloud " << filename << "\n";
+      return -1;
+    }
+    pcl::console::print_info("\nFound pcd file.\n");
+  }
+  else if(extension == ".ply")
+  {
+    pcl::PolygonMesh cl;
+    pcl::io::loadPLYFile(filename, *cloud);
+    if(cloud->points.size()<=0 || (cloud->points[0].x<=0 && cloud->points[0].y<=0 && cloud->points[0].z<=0)){
+      pcl::console::print_warn("\nloadPLYFile could not read the cloud, attempting to loadPolygonFile...\n");
+      pcl::io::loadPolygonFile(filename, cl);
+      pcl::fromPCLPointCloud2(cl.cloud, *cloud);
+      if(cloud->points.size()<=0 || (cloud->points[0].x<=0 && cloud->points[0].y<=0 && cloud->points[0].z<=0)){
+        pcl::console::print_warn("\nloadPolygonFile could not read the cloud, attempting to PLYReader...\n");
+        pcl::PLYReader plyRead;
+        plyRead.read(filename, *cloud);
+        if(cloud->points.size()<=0 || (cloud->points[0].x<=0 && cloud->points[0].y<=0 && cloud->points[0].z<=0)){
+          pcl::console::print_error("\nError. ply file is not compatible.\n");
+          return -1;
+        }
+      }
+    }
+    pcl::console::print_info("\nFound ply file.");
+  }
+  else if(extension == ".txt" || extension == ".xyz")
+  {
+    // x y z r g b / x y z, parsed in double and stored relative to 'offset'
+    if(loadTextCloud(filename, extension == ".txt", *cloud, offset, roi) < 0){
+      return -1;
+    }
+    pcl::console::print_info("\nFound %s file, local frame offset %.3f %.3f %.3f\n",
+      extension.c_str() + 1, offset[0], offset[1], offset[2]);
+  }
+  else
+  {
+    pcl::console::print_error("\nError. unsupported file type: %s\n", filename.c_str());
+    return -1;
+  }
+
+  // Scanner grids keep their layout for the organized path.
+  if(cloud->height <= 1 || (std::size_t) cloud->width * cloud->height != cloud->points.size())
+  {
+    cloud->width = (int) cloud->points.size();
+    cloud->height = 1;
+    cloud->is_dense = true;
+  }
+
+  pcl::console::print_info ("[done, ");
+  pcl::console::print_value ("%g", tt.toc ());
+  pcl::console::print_info (" ms : ");
+  pcl::console::print_value ("%d", cloud->size ());
+  pcl::console::print_info (" points]\n");
+  return 0;
+}
+
+template <typename PointT>
+typename pcl::search::Search<PointT>::Ptr buildSearchIndex(const typename pcl::PointCloud<PointT>::Ptr& cloud)
+{
+  TRACE_SCOPE_VAR(span, "buildSearchIndex", cloud->size());
+  typename SharedKdTree<PointT>::Ptr index (new SharedKdTree<PointT>);
+  index->setInputCloud(cloud);
+  return index;
+}
+
+// The shared index when it was built on 'cloud', otherwise a fresh one;
+// tiles must never trigger a rebuild on a foreign index concurrently.
+template <typename PointT>
+static typename pcl::search::Search<PointT>::Ptr stageIndex(const typename pcl::PointCloud<PointT>::Ptr& cloud,
+  const typename pcl::search::Search<PointT>::Ptr& index)
+{
+  if(index && index->getInputCloud() == cloud)
+    return index;
+  return buildSearchIndex<PointT>(cloud);
+}
+
+template <typename PointT>
+std::size_t filterOutliers(typename pcl::PointCloud<PointT>::Ptr & cloud,
+  const OutlierParams& params,
+  typename pcl::search::Search<PointT>::Ptr& index)
+{
+  if(params.mode == OUTLIERS_NONE || cloud->empty())
+    return 0;
+  TRACE_SCOPE_VAR(span, "filterOutliers", cloud->size());
+  const bool statistical = params.mode == OUTLIERS_STATISTICAL;
+  index = stageIndex<PointT>(cloud, index);
+
+  const std::size_t n = cloud->size();
+  std::vector<char> keep(n, 1);
+  std::vector<float> mean_distance(statistical ? n : 0);
+  {
+    TRACE_SCOPE_VAR(query, "filterOutliers/query", n);
+    // Batched per tile: each task reuses its result buffers for the whole tile.
+    parallelFor(0, n, STAGE_TILE, [&](std::size_t begin, std::size_t end)
+    {
+      std::vector<int> neighbors;
+      std::vector<float> sqr_distances;
+      for(std::size_t i = begin; i < end; ++i)
+      {
+        const PointT& p = cloud->points[i];
+        if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+        {
+          keep[i] = 0;
+          continue;
+        }
+        if(statistical)
+        {
+          // the point itself comes back first
+          int found = index->nearestKSearch(p, params.mean_k + 1, neighbors, sqr_distances);
+          double sum = 0.0;
+          for(int j = 1; j < found; ++j)
+            sum += std::sqrt(sqr_distances[j]);
+          if(found > 1)
+            mean_distance[i] = (float) (sum / (found - 1));
+          else
+            keep[i] = 0;
+        }
+        else
+        {
+          int found = index->radiusSearch(p, params.radius, neighbors, sqr_distances, params.min_neighbors + 1);
+          keep[i] = found - 1 >= params.min_neighbors;
+        }
+      }
+    });
+  }
+
+  if(statistical)
+  {
+    TRACE_SCOPE_VAR(threshold, "filterOutliers/threshold", n);
+    // mean and standard deviation of the per-point mean distances
+    std::vector<double> sums(((n + STAGE_TILE - 1) / STAGE_TILE) * 3, 0.0);
+    parallelFor(0, n, STAGE_TILE, [&](std::size_t begin, std::size_t end)
+    {
+      double* sum = &sums[(begin / STAGE_TILE) * 3];
+      for(std::size_t i = begin; i < end; ++i)
+      {
+        if(!keep[i])
+          continue;
+        sum[0] += mean_distance[i];
+        sum[1] += (double) mean_distance[i] * mean_distance[i];
+        sum[2] += 1.0;
+      }
+    });
+    double total[3] = { 0.0, 0.0, 0.0 };
+    for(std::size_t t = 0; t < sums.size(); t += 3)
+    {
+      for(int k = 0; k < 3; ++k)
+        total[k] += sums[t + k];
+    }
+    if(total[2] > 0.0)
+    {
+      const double mean = total[0] / total[2];
+      const double variance = std::max(0.0, total[1] / total[2] - mean * mean);
+      const double limit = mean + params.stddev_mul * std::sqrt(variance);
+      for(std::size_t i = 0; i < n; ++i)
+      {
+        if(keep[i] && mean_distance[i] > limit)
+          keep[i] = 0;
+      }
+    }
+  }
+
+  std::size_t kept = 0;
+  for(std::size_t i = 0; i < n; ++i)
+    kept += keep[i];
+  const std::size_t removed = n - kept;
+  if(removed > 0)
+  {
+    typename pcl::PointCloud<PointT>::Ptr filtered (new pcl::PointCloud<PointT>);
+    filtered->points.reserve(kept);
+    for(std::size_t i = 0; i < n; ++i)
+    {
+      if(keep[i])
+        filtered->points.push_back(cloud->points[i]);
+    }
+    filtered->width = (std::uint32_t) kept;
+    filtered->height = 1;
+    filtered->is_dense = true;
+    cloud = filtered;
+    index = buildSearchIndex<PointT>(cloud);
+  }
+
+  pcl::console::print_info("Outlier removal (%s): removed %d of %d points\n",
+    statistical ? "statistical" : "radius", (int) removed, (int) n);
+  return removed;
+}
+
+template <typename PointT>
+void downSample(typename pcl::PointCloud<PointT>::Ptr & cloud,
+  typename pcl::PointCloud<PointT>::Ptr & cloudFiltered,
+  float leafSize)
+{
+
+  TRACE_SCOPE_VAR(span, "downSample", cloud->size());
+
+  pcl::VoxelGrid<PointT> sor;
+  // pcl::toPCLPointCloud2(cloud, point_cloud2);
+  sor.setInputCloud (cloud);
+  sor.setLeafSize (leafSize, leafSize, leafSize); // was 0.85f
+  sor.filter(*cloudFiltered);
+
+
+  std::cerr << "PointCloud before filtering: " << cloud->width * cloud->height 
+       << " data points (" << pcl::getFieldsList (*cloud) << ")." << std::endl;
+  std:cerr << "" << std::endl;
+  std::cerr << "PointCloud after filtering: " << cloudFiltered->width * cloudFiltered->height 
+       << " data points (" << pcl::getFieldsList (*cloudFiltered) << ")." << std::endl;
+}
+
+template <typename PointT>
+void reorderCloud(typename pcl::PointCloud<PointT>::Ptr & cloud,
+  std::vector<int>& order)
+{
+  TRACE_SCOPE_VAR(span, "reorderCloud", cloud->size());
+  reorderMorton(*cloud, order);
+  std::cout << "Cloud reordered along the Morton curve: " << cloud->size() << " points" << std::endl;
+}
+
+template <typename PointT>
+void decreaseRadius(typename pcl::PointCloud<PointT>::Ptr & cloud, 
+  typename pcl::PointCloud<PointT>::Ptr & cloudReduced)
+{
+  TRACE_SCOPE_VAR(span, "decreaseRadius", cloud->size());
+  if(cloud->empty())
+    return;
+  // One scan, no tree: the sphere of radius 100 around the first point.
+  RoiCenters centers(1, cloud->points[0].getVector3fMap());
+  std::vector<std::vector<int> > indices;
+  sphereIndices<PointT>(*cloud, centers, 100.0f, indices);
+  gatherPoints(*cloud, indices[0], *cloudReduced);
+}
+
+template <typename PointT>
+void calculateNormals(typename pcl::PointCloud<PointT>::Ptr& inputCloud,
+  pcl::PointCloud<pcl::PointNormal>::Ptr& outputCloud,
+  int kSearch,
+  const typename pcl::search::Search<PointT>::Ptr& index)
+{
+  TRACE_SCOPE_VAR(span, "calculateNormals", inputCloud->size());
+
+  std::cout << "Input dimension" << inputCloud->size()<<std::endl;
+  typename pcl::search::Search<PointT>::Ptr kdTree = stageIndex<PointT>(inputCloud, index);
+
+  //Normal Estimation
+  std::cout << "Using normal method estimation...";
+  pcl::PointCloud<pcl::Normal>::Ptr normals (new pcl::PointCloud<pcl::Normal>);
+  normals->resize(inputCloud->size());
+  {
+    TRACE_SCOPE_VAR(compute, "calculateNormals/estimate", inputCloud->size());
+    // One task per tile on the shared scheduler instead of an OMP region.
+    parallelFor(0, inputCloud->size(), STAGE_TILE, [&](std::size_t begin, std::size_t end)
+    {
+      TRACE_SCOPE_VAR(tile, "calculateNormals/tile", end - begin);
+      pcl::NormalEstimation<PointT, pcl::Normal> estimator;
+      pcl::PointCloud<pcl::Normal> tile_normals;
+      estimator.setInputCloud(inputCloud);
+      estimator.setIndices(tileIndices(begin, end));
+      estimator.setSearchMethod(kdTree);
+      estimator.setKSearch(kSearch); //It was 20
+      estimator.compute(tile_normals);//Normals are estimated using standard method.
+      std::copy(tile_normals.points.begin(), tile_normals.points.end(), normals->points.begin() + begin);
+    });
+  }
+
+  // pcl::PointCloud<pcl::PointNormal>::Ptr cloud_with_normals (new pcl::PointCloud<pcl::PointNormal> ());
+  {
+    TRACE_SCOPE_VAR(concat, "calculateNormals/concatenate", inputCloud->size());
+    pcl::concatenateFields(*inputCloud, *normals, *outputCloud);
+  }
+
+  std::cout << "Normal Estimation...[OK]" << std::endl;
+}
+
+template <typename PointT>
+void applySurfaceApproximation(typename pcl::PointCloud<PointT>::Ptr & cloud,
+  pcl::PointCloud<pcl::PointXYZ>::Ptr & outCloud,
+  const typename pcl::search::Search<PointT>::Ptr& index,
+  double search_radius)
+{
+
+  TRACE_SCOPE_VAR(span, "applySurfaceApproximation", cloud->size());
+
+  /* ****kdtree search and msl object**** */
+  typename pcl::search::Search<PointT>::Ptr kdTree = stageIndex<PointT>(cloud, index);
+
+  std::cout << "Using MLS for Surface Approximation...";
+
+  pcl::PointCloud<pcl::PointXYZ>::Ptr mls_points (new pcl::PointCloud<pcl::PointXYZ>());
+  // Tiles are projected independently and joined in input order.
+  std::vector<pcl::PointCloud<pcl::PointXYZ> > tiles((cloud->size() + STAGE_TILE - 1) / STAGE_TILE);
+  {
+    TRACE_SCOPE_VAR(process, "applySurfaceApproximation/process", cloud->size());
+    parallelFor(0, cloud->size(), STAGE_TILE, [&](std::size_t begin, std::size_t end)
+    {
+      TRACE_SCOPE_VAR(tile, "applySurfaceApproximation/tile", end - begin);
+      pcl::MovingLeastSquares<PointT, pcl::PointXYZ> mls;
+      mls.setNumberOfThreads(1);
+
+      // mls.setComputeNormals(true);
+      mls.setInputCloud(cloud); //ORIGINAL
+      mls.setIndices(tileIndices(begin, end));
+      // Set parameters
+      mls.setDilationIterations(10);
+      mls.setDilationVoxelSize(0.5);
+      mls.setSqrGaussParam(2.0);
+      mls.setUpsamplingRadius(5);
+      mls.setPolynomialOrder (2); 
+      mls.setPointDensity(30);
+
+      mls.setSearchMethod(kdTree);
+      mls.setSearchRadius(search_radius);
+      mls.process(tiles[begin / STAGE_TILE]);
+    });
+    std::size_t total = 0;
+    for(std::size_t t = 0; t < tiles.size(); ++t)
+      total += tiles[t].size();
+    mls_points->reserve(total);
+    for(std::size_t t = 0; t < tiles.size(); ++t)
+    {
+      *mls_points += tiles[t];
+    }
+  }
+
+  TRACE_SCOPE_VAR(copy, "applySurfaceApproximation/copy", mls_points->size());
+  pcl::PointCloud<pcl::PointXYZ>::Ptr temp(new pcl::PointCloud<pcl::PointXYZ>());
+  // pcl::PointCloud<pcl::PointXYZ>::Ptr outputCloud(new pcl::PointCloud<pcl::PointXYZ>());
+
+  temp->resize(mls_points->points.size());
+  for(size_t i = 0; i < mls_points->points.size(); i++)
+  {
+    pcl::PointXYZ& pt = temp->points[i];
+    pt.x = cloud->points[i].x; 
+    pt.y = cloud->points[i].y; 
+    pt.z = cloud->points[i].z;
+  }
+
+  pcl::concatenateFields (*temp, *mls_points, *outCloud);
+  // pcl::copyPointCloud(*outputCloud,*cloud);
+  std::cout << "MLS Surface Approximation...[OK]" << std::endl;
+}
+
+// void ballPivotingSurfaceReconstruction(){
+
+// }
+
+void createMesh(pcl::PointCloud<pcl::PointNormal>::Ptr& inputCloud,int& surface_mode,pcl::PolygonMesh& triangles)
+{
+  MeshParams params;
+  params.surface_mode = surface_mode;
+  createMesh(inputCloud, params, triangles);
+}
+
+void createMesh(pcl::PointCloud<pcl::PointNormal>::Ptr& inputCloud,const MeshParams& params,pcl::PolygonMesh& triangles)
+{
+  TRACE_SCOPE_VAR(span, "createMesh", inputCloud->size());
+  const int surface_mode = params.surface_mode;
+
+  bool gp3_mode = false;
+  bool poisson_mode = false;
+  bool rolling_ball_mode = false;
+
+  if(surface_mode == 1)
+  {
+    poisson_mode = true;
+  }
+  else if(surface_mode == 2)
+  {
+    gp3_mode = true;
+  }
+  else if(surface_mode == 3)
+  {
+    rolling_ball_mode = true;
+  }
+  else
+  {
+    std::cout << "Select: \n'1' for surface poisson method \n '2' for surface gp3 method " << std::endl;
+    std::exit(-1);
+  }
+
+  // Create search tree*
+  pcl::search::KdTree<pcl::PointNormal>::Ptr kdtree_normals (new pcl::search::KdTree<pcl::PointNormal>);
+  std::cout << inputCloud-> width << std::endl;
+  {
+    TRACE_SCOPE_VAR(build, "createMesh/kdtree", inputCloud->size());
+    kdtree_normals->setInputCloud(inputCloud);
+  }
+
+  std::cout << "Applying surface meshing...";
+
+  if(gp3_mode)
+  {
+    std::cout << "Using surface method: gp3 ..." << std::endl;
+
+    int searchK = 100;
+    double search_radius = params.gp3_radius;
+    int setMU = 5;
+    int maxiNearestNeighbors = 584682;
+    bool normalConsistency = false;
+
+    pcl::GreedyProjectionTriangulation<pcl::PointNormal> gp3;
+
+    gp3.setSearchRadius(search_radius);//It was 0.025
+    gp3.setMu(setMU); //It was 2.5
+    gp3.setMaximumNearestNeighbors(maxiNearestNeighbors);    //It was 100
+    gp3.setMaximumSurfaceAngle(M_PI/4); // 45 degrees    //it was 4
+    gp3.setMinimumAngle(M_PI/18); // 10 degrees //It was 18
+    gp3.setMaximumAngle(M_PI/1.5); // 120 degrees        //it was 1.5
+    gp3.setNormalConsistency(normalConsistency); //It was false
+    gp3.setInputCloud(inputCloud);
+    gp3.setSearchMethod(kdtree_normals);
+    {
+      TRACE_SCOPE_VAR(reconstruct, "createMesh/gp3", inputCloud->size());
+      gp3.reconstruct(triangles);
+    }
+
+    std::cout << "OK" << std::endl;
+  }
+  else if(poisson_mode)
+  {
+    std::cout << "Using surface method: poisson ..." << std::endl;
+
+    int nThreads=8;
+    int setKsearch=10;
+    int depth=params.poisson_depth; //typical 9
+    float pointWeight=4.0;
+    float samplePNode=1.5; // typical 1.5
+    float scale=0.4; //typical 1.1
+    int isoDivide=8;
+    bool confidence=true;
+    bool outputPolygons=true;
+    bool manifold=true;
+    int solverDivide=8;
+
+    pcl::Poisson<pcl::PointNormal> poisson;
+
+    poisson.setDepth(depth);//9
+    poisson.setInputCloud(inputCloud);
+    poisson.setPointWeight(pointWeight);//4
+    poisson.setDegree(2);
+    poisson.setSamplesPerNode(samplePNode);//1.5
+    poisson.setScale(scale);//1.1
+    poisson.setIsoDivide(isoDivide);//8
+    poisson.setConfidence(confidence);
+    poisson.setOutputPolygons(outputPolygons);
+    poisson.setManifold(manifold);
+    poisson.setSolverDivide(solverDivide);//8
+    {
+      // PCL's Poisson octree allocator is process-wide state; concurrent
+      // callers (batch workers, sweep jobs, clusters) take turns here.
+      static std::mutex poisson_mutex;
+      std::lock_guard<std::mutex> lock(poisson_mutex);
+      TRACE_SCOPE_VAR(reconstruct, "createMesh/poisson", inputCloud->size());
+      poisson.reconstruct(triangles);
+    }
+
+    //pcl::PolygonMesh mesh2;
+    //poisson.reconstruct(mesh2);
+    //pcl::surface::SimplificationRemoveUnusedVertices rem;
+    //rem.simplify(mesh2,triangles);
+
+    std::cout << "OK" << std::endl;
+  }
+  else if(rolling_ball_mode)
+  {
+
+  }
+  else
+  {
+    std::cout << "Select: \n'1' for surface poisson method \n '2' for surface gp3 method " << std::endl;
+    std::exit(-1);
+  }
+}
+
+template <typename PointT>
+void translateCloud(typename pcl::PointCloud<PointT>::Ptr& cloud) {
+  Eigen::Vector3d offset = Eigen::Vector3d::Zero();
+  translateCloud<PointT>(cloud, offset);
+}
+
+template <typename PointT>
+void translateCloud(typename pcl::PointCloud<PointT>::Ptr& cloud,
+  Eigen::Vector3d& offset) {
+  TRACE_SCOPE_VAR(span, "translateCloud", cloud->size());
+
+  /*****Translated point cloud to origin*****/
+  Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+  {
+    TRACE_SCOPE_VAR(reduce, "translateCloud/centroid", cloud->size());
+    computeCentroidKahan(*cloud, centroid);
+  }
+
+  // offset takes the shift actually applied, so original = translated + offset stays exact
+  Eigen::Vector3f shift = centroid.cast<float>();
+  {
+    TRACE_SCOPE_VAR(apply, "translateCloud/apply", cloud->size());
+    translateCloudInPlace(*cloud, Eigen::Vector3f(-shift));
+  }
+  offset += shift.cast<double>();
+  std::cout << "Cloud Translated width: " << cloud-> width << std::endl;
+}
+
+template <typename PointT>
+void transformCloud(typename pcl::PointCloud<PointT>::Ptr& cloud,
+  const Eigen::Affine3f& transform) {
+  TRACE_SCOPE_VAR(span, "transformCloud", cloud->size());
+  transformCloudInPlace(*cloud, transform);
+}
+
+#define MESHPCL_INSTANTIATE_STAGES(T) \
+  template int loadCloud<T>(const std::string&, pcl::PointCloud<T>::Ptr&); \
+  template int loadCloud<T>(const std::string&, pcl::PointCloud<T>::Ptr&, Eigen::Vector3d&, const CloudRoi&); \
+  template void downSample<T>(pcl::PointCloud<T>::Ptr&, pcl::PointCloud<T>::Ptr&, float); \
+  template void reorderCloud<T>(pcl::PointCloud<T>::Ptr&, std::vector<int>&); \
+  template void decreaseRadius<T>(pcl::PointCloud<T>::Ptr&, pcl::PointCloud<T>::Ptr&); \
+  template pcl::search::Search<T>::Ptr buildSearchIndex<T>(const pcl::PointCloud<T>::Ptr&); \
+  template std::size_t filterOutliers<T>(pcl::PointCloud<T>::Ptr&, const OutlierParams&, pcl::search::Search<T>::Ptr&); \
+  template void calculateNormals<T>(pcl::PointCloud<T>::Ptr&, pcl::PointCloud<pcl::PointNormal>::Ptr&, int, const pcl::search::Search<T>::Ptr&); \
+  template void applySurfaceApproximation<T>(pcl::PointCloud<T>::Ptr&, pcl::PointCloud<pcl::PointXYZ>::Ptr&, const pcl::search::Search<T>::Ptr&, double); \
+  template void translateCloud<T>(pcl::PointCloud<T>::Ptr&); \
+  template void translateCloud<T>(pcl::PointCloud<T>::Ptr&, Eigen::Vector3d&); \
+  template void transformCloud<T>(pcl::PointCloud<T>::Ptr&, const Eigen::Affine3f&);
+
+MESHPCL_INSTANTIATE_STAGES(pcl::PointXYZ)
+MESHPCL_INSTANTIATE_STAGES(pcl::PointXYZRGB)
+MESHPCL_INSTANTIATE_STAGES(pcl::PointNormal)
@@ -0,0 +1,155 @@
+/*********************************
+        PIPELINE STAGES
+**********************************/
+// Stage functions shared by pcd_write and the benchmark/tool targets.
+// Stages that only look at the points are templated on the point type and
+// instantiated in pipeline.cpp for the types listed in point_fields.h, so a
+// run carries exactly the fields its input has. Callers name the type
+// explicitly, e.g. downSample<pcl::PointXYZ>(...).
+
+#ifndef MESHPCL_PIPELINE_H
+#define MESHPCL_PIPELINE_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PolygonMesh.h>
+#include <pcl/search/search.h>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "point_fields.h"
+#include "roi.h"
+
+// Tuning knobs of the normal and meshing stages; defaults are the values
+// the pipeline has always used.
+struct MeshParams
+{
+  int surface_mode;    // 1 poisson, 2 gp3
+  int normal_k;        // NormalEstimation setKSearch
+  int poisson_depth;   // Poisson setDepth
+  double gp3_radius;   // GreedyProjectionTriangulation setSearchRadius
+  double mls_radius;   // MovingLeastSquares setSearchRadius
+
+  MeshParams() : surface_mode(1), normal_k(5), poisson_depth(7), gp3_radius(10), mls_radius(0.4) {}
+};
+
+enum OutlierMode
+{
+  OUTLIERS_NONE,
+  OUTLIERS_STATISTICAL,  // mean distance to the k nearest neighbours
+  OUTLIERS_RADIUS        // neighbour count within a radius
+};
+
+struct OutlierParams
+{
+  OutlierMode mode;
+  int mean_k;          // statistical: neighbours averaged per point
+  double stddev_mul;   // statistical: drop points above mean + stddev_mul * stddev
+  double radius;       // radius: search radius
+  int min_neighbors;   // radius: neighbours required within it
+
+  OutlierParams() : mode(OUTLIERS_NONE), mean_k(8), stddev_mul(1.0), radius(0.0), min_neighbors(2) {}
+};
+
+// Point type of a .pcd/.ply file from its header alone: normals win over
+// colour. Text files go by extension (.txt colour, .xyz none).
+CloudPointType detectPointType(const std::string& filename);
+
+// Loads a .pcd, .ply, .txt (x y z r g b) or .xyz (x y z) file. Organized
+// .pcd/.ply grids keep their width x height, everything else is loaded
+// unorganized. Returns -1 on failure. Text clouds are stored in a
+// local frame; 'offset' receives its origin (zero for .pcd/.ply). Only
+// points inside 'roi' (file coordinates) are kept: text files test it while
+// parsing, .pcd/.ply records are cropped before conversion to PointT.
+template <typename PointT>
+int loadCloud(const std::string& filename, typename pcl::PointCloud<PointT>::Ptr& cloud);
+template <typename PointT>
+int loadCloud(const std::string& filename, typename pcl::PointCloud<PointT>::Ptr& cloud,
+  Eigen::Vector3d& offset, const CloudRoi& roi = CloudRoi());
+
+template <typename PointT>
+void downSample(typename pcl::PointCloud<PointT>::Ptr & cloud,
+  typename pcl::PointCloud<PointT>::Ptr & cloudFiltered,
+  float leafSize);
+
+// Sorts the cloud into Morton order in place so that downstream neighbour
+// queries walk memory locally; order[i] is the input index of point i.
+template <typename PointT>
+void reorderCloud(typename pcl::PointCloud<PointT>::Ptr & cloud,
+  std::vector<int>& order);
+
+// Points within 100 units of the first point, in input order, replacing
+// the contents of cloudReduced. See roi_extract.h for general crops.
+template <typename PointT>
+void decreaseRadius(typename pcl::PointCloud<PointT>::Ptr & cloud,
+  typename pcl::PointCloud<PointT>::Ptr & cloudReduced);
+
+// Kd-tree over one cloud, built once and handed to every stage that
+// searches it. Stages given no index, or one built on another cloud, build
+// their own.
+template <typename PointT>
+typename pcl::search::Search<PointT>::Ptr buildSearchIndex(const typename pcl::PointCloud<PointT>::Ptr& cloud);
+
+// Drops outliers with parallel batched queries on 'index'. When points go,
+// 'cloud' is replaced by the filtered cloud and 'index' rebuilt on it.
+// Returns the number of points removed.
+template <typename PointT>
+std::size_t filterOutliers(typename pcl::PointCloud<PointT>::Ptr & cloud,
+  const OutlierParams& params,
+  typename pcl::search::Search<PointT>::Ptr& index);
+
+template <typename PointT>
+void calculateNormals(typename pcl::PointCloud<PointT>::Ptr& inputCloud,
+  pcl::PointCloud<pcl::PointNormal>::Ptr& outputCloud,
+  int kSearch = 5,
+  const typename pcl::search::Search<PointT>::Ptr& index = typename pcl::search::Search<PointT>::Ptr());
+
+// Normals for meshing: estimated for XYZ/XYZRGB input, taken as they are
+// when the input already has them.
+template <typename PointT>
+void meshNormals(typename pcl::PointCloud<PointT>::Ptr& inputCloud,
+  pcl::PointCloud<pcl::PointNormal>::Ptr& outputCloud,
+  int kSearch = 5,
+  const typename pcl::search::Search<PointT>::Ptr& index = typename pcl::search::Search<PointT>::Ptr())
+{
+  calculateNormals<PointT>(inputCloud, outputCloud, kSearch, index);
+}
+
+template <>
+inline void meshNormals<pcl::PointNormal>(pcl::PointCloud<pcl::PointNormal>::Ptr& inputCloud,
+  pcl::PointCloud<pcl::PointNormal>::Ptr& outputCloud,
+  int,
+  const pcl::search::Search<pcl::PointNormal>::Ptr&)
+{
+  outputCloud = inputCloud;
+}
+
+template <typename PointT>
+void applySurfaceApproximation(typename pcl::PointCloud<PointT>::Ptr & cloud,
+  pcl::PointCloud<pcl::PointXYZ>::Ptr & outCloud,
+  const typename pcl::search::Search<PointT>::Ptr& index = typename pcl::search::Search<PointT>::Ptr(),
+  double search_radius = MeshParams().mls_radius);
+
+// surface_mode: 1 poisson, 2 gp3.
+void createMesh(pcl::PointCloud<pcl::PointNormal>::Ptr& inputCloud,int& surface_mode,pcl::PolygonMesh& triangles);
+void createMesh(pcl::PointCloud<pcl::PointNormal>::Ptr& inputCloud,const MeshParams& params,pcl::PolygonMesh& triangles);
+
+// Moves the centroid to the origin, in place. The overload adds the shift
+// to 'offset' so that original = translated + offset still holds.
+template <typename PointT>
+void translateCloud(typename pcl::PointCloud<PointT>::Ptr& cloud);
+template <typename PointT>
+void translateCloud(typename pcl::PointCloud<PointT>::Ptr& cloud,
+  Eigen::Vector3d& offset);
+
+// Applies a rigid transform in place; normals, if any, are rotated too.
+template <typename PointT>
+void transformCloud(typename pcl::PointCloud<PointT>::Ptr& cloud,
+  const Eigen::Affine3f& transform);
+
+#endif // MESHPCL_PIPELINE_H
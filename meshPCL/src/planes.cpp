@@ -0,0 +1,288 @@
+#include "planes.h"
+
+#include <pcl/common/io.h>
+#include <pcl/conversions.h>
+#include <pcl/console/print.h>
+
+#include <Eigen/Eigenvalues>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <utility>
+
+#include "clusters.h"
+#include "parallel.h"
+#include "trace.h"
+
+// Points hypotheses are scored against; the winner is then counted on all.
+static const std::size_t PLANE_SAMPLE = 65536;
+// Points per task when marking the inliers of one plane.
+static const std::size_t PLANE_TILE = 65536;
+
+// Positions and normals as separate arrays for the vectorized count.
+struct PlanePoints
+{
+  std::vector<float> x, y, z, nx, ny, nz;
+
+  void resize(std::size_t n)
+  {
+    x.resize(n); y.resize(n); z.resize(n);
+    nx.resize(n); ny.resize(n); nz.resize(n);
+  }
+  void set(std::size_t i, const pcl::PointNormal& p)
+  {
+    x[i] = p.x; y[i] = p.y; z[i] = p.z;
+    nx[i] = p.normal_x; ny[i] = p.normal_y; nz[i] = p.normal_z;
+  }
+};
+
+// Inliers of 'plane' among points [begin, end): close to it and with a
+// normal within the angle. No branches, so the loop vectorizes.
+static std::size_t countInliers(const PlanePoints& points, std::size_t begin, std::size_t end,
+  const Eigen::Vector4f& plane, float distance, float min_cos)
+{
+  const float a = plane[0], b = plane[1], c = plane[2], d = plane[3];
+  const float* x = points.x.data();
+  const float* y = points.y.data();
+  const float* z = points.z.data();
+  const float* nx = points.nx.data();
+  const float* ny = points.ny.data();
+  const float* nz = points.nz.data();
+  std::uint32_t inliers = 0;
+  for(std::size_t i = begin; i < end; ++i)
+  {
+    const float dist = std::fabs(a * x[i] + b * y[i] + c * z[i] + d);
+    const float cosine = std::fabs(a * nx[i] + b * ny[i] + c * nz[i]);
+    inliers += (std::uint32_t) ((dist <= distance) & (cosine >= min_cos));
+  }
+  return inliers;
+}
+
+// Same test as countInliers, one flag per point.
+static void markInliers(const PlanePoints& points, std::size_t begin, std::size_t end,
+  const Eigen::Vector4f& plane, float distance, float min_cos, unsigned char* mask)
+{
+  const float a = plane[0], b = plane[1], c = plane[2], d = plane[3];
+  const float* x = points.x.data();
+  const float* y = points.y.data();
+  const float* z = points.z.data();
+  const float* nx = points.nx.data();
+  const float* ny = points.ny.data();
+  const float* nz = points.nz.data();
+  for(std::size_t i = begin; i < end; ++i)
+  {
+    const float dist = std::fabs(a * x[i] + b * y[i] + c * z[i] + d);
+    const float cosine = std::fabs(a * nx[i] + b * ny[i] + c * nz[i]);
+    mask[i] = (unsigned char) ((dist <= distance) & (cosine >= min_cos));
+  }
+}
+
+// Least-squares plane through the points: normal of least variance.
+static Eigen::Vector4f fitPlane(const pcl::PointCloud<pcl::PointNormal>& cloud, const std::vector<int>& indices)
+{
+  Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+  for(std::size_t i = 0; i < indices.size(); ++i)
+    mean += cloud.points[indices[i]].getVector3fMap().cast<double>();
+  mean /= (double) indices.size();
+  Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+  for(std::size_t i = 0; i < indices.size(); ++i)
+  {
+    Eigen::Vector3d p = cloud.points[indices[i]].getVector3fMap().cast<double>() - mean;
+    covariance += p * p.transpose();
+  }
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+  Eigen::Vector3d normal = solver.eigenvectors().col(0).normalized();
+  return Eigen::Vector4f((float) normal[0], (float) normal[1], (float) normal[2], (float) -normal.dot(mean));
+}
+
+void extractPlanes(const pcl::PointCloud<pcl::PointNormal>& cloud, const PlaneParams& params,
+  PlaneRegions& planes, std::vector<int>& remainder)
+{
+  TRACE_SCOPE_VAR(span, "extractPlanes", cloud.size());
+  planes.clear();
+  remainder.resize(cloud.size());
+  for(std::size_t i = 0; i < cloud.size(); ++i)
+    remainder[i] = (int) i;
+
+  const float distance = (float) params.distance;
+  const float min_cos = (float) std::cos(params.max_angle * M_PI / 180.0);
+  std::mt19937 random(12345);
+
+  while((int) planes.size() < params.max_planes && remainder.size() >= std::max<std::size_t>(params.min_points, 3))
+  {
+    TRACE_SCOPE_VAR(round, "extractPlanes/plane", remainder.size());
+    const std::size_t n = remainder.size();
+
+    // Evenly strided subsample of the remaining points.
+    const std::size_t sample_size = std::min(n, PLANE_SAMPLE);
+    PlanePoints sample;
+    sample.resize(sample_size);
+    for(std::size_t i = 0; i < sample_size; ++i)
+      sample.set(i, cloud.points[remainder[i * n / sample_size]]);
+
+    std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> > hypotheses;
+    std::uniform_int_distribution<std::size_t> pick(0, n - 1);
+    for(int h = 0; h < params.hypotheses; ++h)
+    {
+      const Eigen::Vector3f p0 = cloud.points[remainder[pick(random)]].getVector3fMap();
+      const Eigen::Vector3f p1 = cloud.points[remainder[pick(random)]].getVector3fMap();
+      const Eigen::Vector3f p2 = cloud.points[remainder[pick(random)]].getVector3fMap();
+      Eigen::Vector3f normal = (p1 - p0).cross(p2 - p0);
+      const float length = normal.norm();
+      if(!(length > 1e-12f))
+        continue;
+      normal /= length;
+      hypotheses.push_back(Eigen::Vector4f(normal[0], normal[1], normal[2], -normal.dot(p0)));
+    }
+    if(hypotheses.empty())
+      break;
+
+    std::vector<std::size_t> scores(hypotheses.size());
+    parallelFor(0, hypotheses.size(), 8, [&](std::size_t begin, std::size_t end)
+    {
+      for(std::size_t h = begin; h < end; ++h)
+        scores[h] = countInliers(sample, 0, sample_size, hypotheses[h], distance, min_cos);
+    });
+    const std::size_t best = std::max_element(scores.begin(), scores.end()) - scores.begin();
+
+    // All remaining points, counted for the winner and for its refit.
+    PlanePoints all;
+    all.resize(n);
+    parallelFor(0, n, PLANE_TILE, [&](std::size_t begin, std::size_t end)
+    {
+      for(std::size_t i = begin; i < end; ++i)
+        all.set(i, cloud.points[remainder[i]]);
+    });
+    std::vector<unsigned char> mask(n);
+    auto split = [&](const Eigen::Vector4f& plane, std::vector<int>& inliers, std::vector<int>& rest)
+    {
+      parallelFor(0, n, PLANE_TILE, [&](std::size_t begin, std::size_t end)
+      {
+        markInliers(all, begin, end, plane, distance, min_cos, mask.data());
+      });
+      inliers.clear();
+      rest.clear();
+      for(std::size_t i = 0; i < n; ++i)
+      {
+        if(mask[i])
+          inliers.push_back(remainder[i]);
+        else
+          rest.push_back(remainder[i]);
+      }
+    };
+
+    PlaneRegion region;
+    std::vector<int> rest;
+    split(hypotheses[best], region.indices, rest);
+    if(region.indices.size() < std::max<std::size_t>(params.min_points, 3))
+      break;
+    region.coefficients = fitPlane(cloud, region.indices);
+    split(region.coefficients, region.indices, rest);
+    if(region.indices.size() < std::max<std::size_t>(params.min_points, 3))
+      break;
+
+    pcl::console::print_info("Plane %d: %.3f %.3f %.3f %.3f, %d inliers\n", (int) planes.size(),
+      region.coefficients[0], region.coefficients[1], region.coefficients[2], region.coefficients[3],
+      (int) region.indices.size());
+    planes.push_back(region);
+    remainder.swap(rest);
+  }
+}
+
+void polygonizePlanes(const pcl::PointCloud<pcl::PointNormal>& cloud, const PlaneRegions& planes,
+  const PlaneParams& params, pcl::PolygonMesh& mesh)
+{
+  TRACE_SCOPE_VAR(span, "polygonizePlanes", planes.size());
+  pcl::PointCloud<pcl::PointNormal> vertices;
+  mesh.polygons.clear();
+  const double cell = params.cell > 0.0 ? params.cell : params.distance;
+
+  for(std::size_t p = 0; p < planes.size(); ++p)
+  {
+    const PlaneRegion& plane = planes[p];
+    Eigen::Vector3f normal = plane.coefficients.head<3>();
+
+    // Face the same way as the estimated normals of the inliers.
+    Eigen::Vector3f normal_sum = Eigen::Vector3f::Zero();
+    for(std::size_t i = 0; i < plane.indices.size(); ++i)
+      normal_sum += cloud.points[plane.indices[i]].getNormalVector3fMap();
+    if(normal.dot(normal_sum) < 0.0f)
+      normal = -normal;
+
+    // In-plane basis and origin.
+    Eigen::Vector3f u = normal.unitOrthogonal();
+    Eigen::Vector3f v = normal.cross(u);
+    Eigen::Vector3f origin = -plane.coefficients[3] * plane.coefficients.head<3>();
+
+    // Occupied cells as (row, column), sorted into rows of runs.
+    std::vector<std::pair<std::int64_t, std::int64_t> > cells(plane.indices.size());
+    for(std::size_t i = 0; i < plane.indices.size(); ++i)
+    {
+      Eigen::Vector3f q = cloud.points[plane.indices[i]].getVector3fMap() - origin;
+      cells[i].first = (std::int64_t) std::floor(q.dot(v) / cell);
+      cells[i].second = (std::int64_t) std::floor(q.dot(u) / cell);
+    }
+    std::sort(cells.begin(), cells.end());
+    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+    for(std::size_t i = 0; i < cells.size(); )
+    {
+      std::size_t j = i + 1;
+      while(j < cells.size() && cells[j].first == cells[i].first && cells[j].second == cells[j - 1].second + 1)
+        ++j;
+      const float v0 = (float) (cells[i].first * cell), v1 = (float) ((cells[i].first + 1) * cell);
+      const float u0 = (float) (cells[i].second * cell), u1 = (float) ((cells[j - 1].second + 1) * cell);
+      const Eigen::Vector3f corners[4] = { origin + u0 * u + v0 * v, origin + u1 * u + v0 * v,
+        origin + u1 * u + v1 * v, origin + u0 * u + v1 * v };
+
+      const std::uint32_t base = (std::uint32_t) vertices.size();
+      for(int k = 0; k < 4; ++k)
+      {
+        pcl::PointNormal vertex;
+        vertex.getVector3fMap() = corners[k];
+        vertex.getNormalVector3fMap() = normal;
+        vertex.curvature = 0.0f;
+        vertices.push_back(vertex);
+      }
+      // u x v = normal, so counter-clockwise in (u, v) faces along it.
+      pcl::Vertices first, second;
+      first.vertices.push_back(base); first.vertices.push_back(base + 1); first.vertices.push_back(base + 2);
+      second.vertices.push_back(base); second.vertices.push_back(base + 2); second.vertices.push_back(base + 3);
+      mesh.polygons.push_back(first);
+      mesh.polygons.push_back(second);
+      i = j;
+    }
+  }
+  vertices.width = (std::uint32_t) vertices.size();
+  vertices.height = 1;
+  pcl::toPCLPointCloud2(vertices, mesh.cloud);
+  pcl::console::print_info("Planes polygonized into %d triangles\n", (int) mesh.polygons.size());
+}
+
+void createPlanarMesh(const pcl::PointCloud<pcl::PointNormal>::Ptr& cloud, const PlaneParams& planes,
+  const MeshParams& params, double tolerance, std::size_t min_size, pcl::PolygonMesh& mesh)
+{
+  PlaneRegions regions;
+  std::vector<int> remainder;
+  if(planes.max_planes > 0)
+    extractPlanes(*cloud, planes, regions, remainder);
+  if(regions.empty())
+  {
+    createClusteredMesh(cloud, params, tolerance, min_size, mesh);
+    return;
+  }
+
+  std::vector<pcl::PolygonMesh> parts(2);
+  polygonizePlanes(*cloud, regions, planes, parts[0]);
+  pcl::console::print_info("Planes: %d of %d points on %d planes, meshing the remaining %d\n",
+    (int) (cloud->size() - remainder.size()), (int) cloud->size(), (int) regions.size(), (int) remainder.size());
+  if(remainder.size() >= 3)
+  {
+    pcl::PointCloud<pcl::PointNormal>::Ptr rest (new pcl::PointCloud<pcl::PointNormal>);
+    pcl::copyPointCloud(*cloud, remainder, *rest);
+    createClusteredMesh(rest, params, tolerance, min_size, parts[1]);
+  }
+  concatenateMeshes(parts, mesh);
+}
@@ -0,0 +1,67 @@
+/*********************************
+      DOMINANT PLANE FAST PATH
+**********************************/
+// Ground and facades are most of a street scan but trivial to mesh. This
+// stage pulls the largest planes out of the normal cloud with RANSAC and
+// turns each into a handful of quads; only the non-planar remainder goes
+// through createMesh.
+//
+// Hypotheses come from a seeded generator, so runs are reproducible, and
+// are scored in parallel against a fixed subsample kept as separate x/y/z
+// and normal arrays, so the inlier count is a branch-free loop the
+// compiler vectorizes. The winner is refitted to all its inliers by least
+// squares before they are removed.
+
+#ifndef MESHPCL_PLANES_H
+#define MESHPCL_PLANES_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PolygonMesh.h>
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <vector>
+
+#include "pipeline.h"
+
+struct PlaneParams
+{
+  int max_planes;          // planes extracted at most; 0 disables the stage
+  double distance;         // inlier distance to the plane
+  double max_angle;        // inlier normal deviation, degrees
+  std::size_t min_points;  // smaller planes end the search
+  int hypotheses;          // RANSAC samples per plane
+  double cell;             // quad grid cell on the plane
+
+  PlaneParams() : max_planes(0), distance(0.1), max_angle(20.0), min_points(1000), hypotheses(512), cell(0.2) {}
+};
+
+struct PlaneRegion
+{
+  Eigen::Vector4f coefficients;  // a x + b y + c z + d = 0, unit normal
+  std::vector<int> indices;      // inliers in the input cloud
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+typedef std::vector<PlaneRegion, Eigen::aligned_allocator<PlaneRegion> > PlaneRegions;
+
+// Extracts up to params.max_planes planes, largest first. 'remainder'
+// receives the indices of the points that belong to none.
+void extractPlanes(const pcl::PointCloud<pcl::PointNormal>& cloud, const PlaneParams& params,
+  PlaneRegions& planes, std::vector<int>& remainder);
+
+// Covers the inliers of each plane with axis-aligned quads of params.cell,
+// merged along rows, two triangles each. Vertices carry the plane normal.
+void polygonizePlanes(const pcl::PointCloud<pcl::PointNormal>& cloud, const PlaneRegions& planes,
+  const PlaneParams& params, pcl::PolygonMesh& mesh);
+
+// Quads for the planes plus createClusteredMesh on the remaining points,
+// concatenated into 'mesh'. Same as createClusteredMesh when
+// params.max_planes is 0 or no plane is found.
+void createPlanarMesh(const pcl::PointCloud<pcl::PointNormal>::Ptr& cloud, const PlaneParams& planes,
+  const MeshParams& params, double tolerance, std::size_t min_size, pcl::PolygonMesh& mesh);
+
+#endif // MESHPCL_PLANES_H
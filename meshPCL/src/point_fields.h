@@ -0,0 +1,66 @@
+/*********************************
+         POINT TYPE FIELDS
+**********************************/
+// The pipeline is instantiated for three point types, picked once per run
+// from the fields the input actually has:
+//
+//   CLOUD_XYZ         pcl::PointXYZ          .xyz, or pcd/ply without colour
+//   CLOUD_XYZRGB      pcl::PointXYZRGB       .txt, or pcd/ply with rgb(a)
+//   CLOUD_XYZ_NORMAL  pcl::PointNormal       pcd/ply with normal_x/y/z
+//
+// Helpers here let the loaders fill whichever of those types they are
+// given without branching at run time.
+
+#ifndef MESHPCL_POINT_FIELDS_H
+#define MESHPCL_POINT_FIELDS_H
+
+#include <pcl/point_types.h>
+
+#include <cstdint>
+#include <cstring>
+
+enum CloudPointType
+{
+  CLOUD_XYZ,
+  CLOUD_XYZRGB,
+  CLOUD_XYZ_NORMAL
+};
+
+inline const char* cloudPointTypeName(CloudPointType type)
+{
+  switch(type)
+  {
+    case CLOUD_XYZ: return "PointXYZ";
+    case CLOUD_XYZRGB: return "PointXYZRGB";
+    case CLOUD_XYZ_NORMAL: return "PointNormal";
+  }
+  return "unknown";
+}
+
+// CloudPointType of a pipeline point type, e.g. CloudPointTypeOf<pcl::PointXYZ>::value.
+template <typename PointT> struct CloudPointTypeOf;
+template <> struct CloudPointTypeOf<pcl::PointXYZ> { static const CloudPointType value = CLOUD_XYZ; };
+template <> struct CloudPointTypeOf<pcl::PointXYZRGB> { static const CloudPointType value = CLOUD_XYZRGB; };
+template <> struct CloudPointTypeOf<pcl::PointNormal> { static const CloudPointType value = CLOUD_XYZ_NORMAL; };
+
+namespace point_fields_detail
+{
+  template <typename PointT>
+  auto setColor(PointT& p, const unsigned char rgb[3], int) -> decltype(p.rgb, void())
+  {
+    std::uint32_t packed = (std::uint32_t) rgb[0] << 16 | (std::uint32_t) rgb[1] << 8 | (std::uint32_t) rgb[2];
+    std::memcpy(&p.rgb, &packed, sizeof(packed));
+  }
+
+  template <typename PointT>
+  void setColor(PointT&, const unsigned char*, long) {}
+}
+
+// Sets the packed rgb of points that have one; a no-op for other types.
+template <typename PointT>
+inline void setPointColor(PointT& p, const unsigned char rgb[3])
+{
+  point_fields_detail::setColor(p, rgb, 0);
+}
+
+#endif // MESHPCL_POINT_FIELDS_H
@@ -0,0 +1,160 @@
+#include "progressive.h"
+
+#include <pcl/console/print.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "cloud_io.h"
+#include "trace.h"
+
+// Writes next to 'path' and renames over it.
+static bool replaceMesh(const std::string& path, const pcl::PolygonMesh& mesh, const Eigen::Vector3d& offset)
+{
+  const std::string temporary = path + ".tmp";
+  if(saveMeshPLYBinary(temporary, mesh, offset) < 0)
+    return false;
+  boost::system::error_code error;
+  boost::filesystem::rename(temporary, path, error);
+  if(error)
+  {
+    boost::filesystem::remove(temporary, error);
+    return false;
+  }
+  return true;
+}
+
+template <typename PointT>
+ProgressiveMesher<PointT>::ProgressiveMesher(const Source& source, const ProgressiveParams& progressive,
+  float leaf_size, const MeshParams& params, const OutlierParams& outliers, const PlaneParams& planes,
+  double cluster_tolerance, std::size_t cluster_min, bool morton, const Eigen::Vector3d& origin,
+  const std::string& output)
+  : source_(source), progressive_(progressive), leaf_size_(leaf_size), params_(params), outliers_(outliers),
+    planes_(planes), cluster_tolerance_(cluster_tolerance), cluster_min_(cluster_min), morton_(morton),
+    origin_(origin), output_(output), cancelled_(false), latest_offset_(origin), written_(0),
+    last_seconds_(0.0), last_points_(0)
+{
+  progressive_.levels = std::max(1, progressive_.levels);
+}
+
+template <typename PointT>
+ProgressiveMesher<PointT>::~ProgressiveMesher()
+{
+  cancel();
+  if(worker_.joinable())
+    worker_.join();
+}
+
+template <typename PointT>
+bool ProgressiveMesher<PointT>::meshLevel(int level, CloudPtr& cloud)
+{
+  TRACE_SCOPE_VAR(span, "progressive/level", cloud->size());
+  std::chrono::steady_clock::time_point level_start = std::chrono::steady_clock::now();
+
+  // Each level below the last halves the resolution once more.
+  const int coarser = progressive_.levels - 1 - level;
+  const double scale = std::ldexp(1.0, coarser);
+  MeshParams params = params_;
+  params.gp3_radius *= scale;
+  params.poisson_depth = std::max(params_.poisson_depth - coarser, std::min(params_.poisson_depth, 5));
+  OutlierParams outliers = outliers_;
+  outliers.radius *= scale;
+  // Point counts per surface area fall with the square of the leaf.
+  const double area_scale = scale * scale;
+  PlaneParams planes = planes_;
+  planes.distance *= scale;
+  planes.cell *= scale;
+  planes.min_points = std::max<std::size_t>(1, (std::size_t) (planes_.min_points / area_scale));
+  const double cluster_tolerance = cluster_tolerance_ * scale;
+  const std::size_t cluster_min = std::max<std::size_t>(1, (std::size_t) (cluster_min_ / area_scale));
+
+  const std::size_t points = cloud->size();
+  if(morton_)
+  {
+    std::vector<int> order;
+    reorderCloud<PointT>(cloud, order);
+  }
+  Eigen::Vector3d offset = origin_;
+  translateCloud<PointT>(cloud, offset);
+  typename pcl::search::Search<PointT>::Ptr index = buildSearchIndex<PointT>(cloud);
+  filterOutliers<PointT>(cloud, outliers, index);
+  pcl::PointCloud<pcl::PointNormal>::Ptr normals (new pcl::PointCloud<pcl::PointNormal>);
+  meshNormals<PointT>(cloud, normals, params.normal_k, index);
+  cloud.reset();
+  pcl::PolygonMesh mesh;
+  createPlanarMesh(normals, planes, params, cluster_tolerance, cluster_min, mesh);
+
+  if(!replaceMesh(output_, mesh, offset))
+  {
+    pcl::console::print_error("Could not write level %d to %s\n", level + 1, output_.c_str());
+    return false;
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - level_start).count();
+  pcl::console::print_info("Progressive level %d of %d: leaf %g, %d points, %d triangles, %.1f s, written to %s\n",
+    level + 1, progressive_.levels, leaf_size_ * scale, (int) points, (int) mesh.polygons.size(), seconds,
+    output_.c_str());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(level == 0)
+    preview_ = mesh;
+  latest_ = mesh;
+  latest_offset_ = offset;
+  last_seconds_ = seconds;
+  last_points_ = points;
+  ++written_;
+  return true;
+}
+
+template <typename PointT>
+bool ProgressiveMesher<PointT>::start()
+{
+  start_ = std::chrono::steady_clock::now();
+  CloudPtr cloud;
+  source_(leaf_size_ * (float) std::ldexp(1.0, progressive_.levels - 1), cloud);
+  if(!meshLevel(0, cloud))
+    return false;
+  if(progressive_.levels > 1)
+    worker_ = std::thread(&ProgressiveMesher<PointT>::refine, this);
+  return true;
+}
+
+template <typename PointT>
+void ProgressiveMesher<PointT>::refine()
+{
+  for(int level = 1; level < progressive_.levels && !cancelled_; ++level)
+  {
+    CloudPtr cloud;
+    source_(leaf_size_ * (float) std::ldexp(1.0, progressive_.levels - 1 - level), cloud);
+    if(progressive_.seconds > 0.0 && last_points_ > 0)
+    {
+      const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+      const double estimate = last_seconds_ * cloud->size() / last_points_;
+      if(elapsed + estimate > progressive_.seconds)
+      {
+        pcl::console::print_info("Progressive meshing stops at level %d of %d: the next would end after about %.1f s of a %.1f s budget\n",
+          written_, progressive_.levels, elapsed + estimate, progressive_.seconds);
+        return;
+      }
+    }
+    if(!meshLevel(level, cloud))
+      return;
+  }
+}
+
+template <typename PointT>
+int ProgressiveMesher<PointT>::wait(pcl::PolygonMesh& mesh, Eigen::Vector3d& offset)
+{
+  if(worker_.joinable())
+    worker_.join();
+  std::lock_guard<std::mutex> lock(mutex_);
+  mesh = latest_;
+  offset = latest_offset_;
+  return written_;
+}
+
+template class ProgressiveMesher<pcl::PointXYZ>;
+template class ProgressiveMesher<pcl::PointXYZRGB>;
+template class ProgressiveMesher<pcl::PointNormal>;
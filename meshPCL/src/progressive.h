@@ -0,0 +1,103 @@
+/*********************************
+     COARSE-TO-FINE MESHING
+**********************************/
+// Operators should not wait for the full-resolution mesh to see anything.
+// Progressive meshing runs the pipeline several times, from a coarse leaf
+// size and Poisson depth up to the requested ones, doubling the resolution
+// at every level, with the same stages as a single run (Morton order,
+// planes, clusters). The coarsest level is meshed and written before start()
+// returns. The finer ones run on a background thread, each replacing the
+// output file with a rename, so readers only ever see a complete mesh.
+//
+// With a time budget, a level is not started when the previous level's
+// time, scaled by its point count, says it would end past the budget.
+
+#ifndef MESHPCL_PROGRESSIVE_H
+#define MESHPCL_PROGRESSIVE_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PolygonMesh.h>
+
+#include <Eigen/Core>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "pipeline.h"
+#include "planes.h"
+
+struct ProgressiveParams
+{
+  int levels;        // meshes written, coarsest first; 0 disables progressive meshing
+  double seconds;    // stop refining once this is spent, 0 for no budget
+
+  ProgressiveParams() : levels(0), seconds(0.0) {}
+};
+
+template <typename PointT>
+class ProgressiveMesher
+{
+public:
+  typedef typename pcl::PointCloud<PointT>::Ptr CloudPtr;
+  // Fills 'cloud' with the input downsampled at 'leaf_size', in the frame
+  // of the loaded input. Called from the background thread too.
+  typedef std::function<void(float leaf_size, CloudPtr& cloud)> Source;
+
+  // The last level runs the same stages as a single run: Morton order when
+  // 'morton', outliers, normals and createPlanarMesh with 'planes' and the
+  // cluster settings, all as given. Every coarser level doubles the leaf
+  // and the distances and lowers the Poisson depth. 'origin' is the frame
+  // of what 'source' returns.
+  ProgressiveMesher(const Source& source, const ProgressiveParams& progressive, float leaf_size,
+    const MeshParams& params, const OutlierParams& outliers, const PlaneParams& planes,
+    double cluster_tolerance, std::size_t cluster_min, bool morton, const Eigen::Vector3d& origin,
+    const std::string& output);
+  // Cancels and waits for the level in progress.
+  ~ProgressiveMesher();
+
+  // Meshes and writes the coarsest level, then starts refining in the
+  // background. False when the coarsest level could not be written.
+  bool start();
+  // Stops refining after the level in progress.
+  void cancel() { cancelled_ = true; }
+  // Waits for the refinement. 'mesh' and 'offset' receive the finest
+  // level written; returns the number of levels written.
+  int wait(pcl::PolygonMesh& mesh, Eigen::Vector3d& offset);
+
+  // The coarsest level, valid once start() returned true.
+  const pcl::PolygonMesh& preview() const { return preview_; }
+
+private:
+  bool meshLevel(int level, CloudPtr& cloud);
+  void refine();
+
+  Source source_;
+  ProgressiveParams progressive_;
+  float leaf_size_;
+  MeshParams params_;
+  OutlierParams outliers_;
+  PlaneParams planes_;
+  double cluster_tolerance_;
+  std::size_t cluster_min_;
+  bool morton_;
+  Eigen::Vector3d origin_;
+  std::string output_;
+
+  std::chrono::steady_clock::time_point start_;
+  std::thread worker_;
+  std::atomic<bool> cancelled_;
+  std::mutex mutex_;          // guards the finest level below
+  pcl::PolygonMesh preview_;
+  pcl::PolygonMesh latest_;
+  Eigen::Vector3d latest_offset_;
+  int written_;
+  double last_seconds_;       // meshing time of the finest level written
+  std::size_t last_points_;
+};
+
+#endif // MESHPCL_PROGRESSIVE_H
@@ -0,0 +1,236 @@
+#include "result_cache.h"
+
+#include <pcl/console/print.h>
+#include <pcl/io/pcd_io.h>
+#include <pcl/io/ply_io.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "parallel.h"
+#include "trace.h"
+
+// Bytes per independently hashed block of a file.
+static const std::size_t HASH_BLOCK = std::size_t(8) << 20;
+
+static const std::uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+static const std::uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const std::uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+static const std::uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static const std::uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static inline std::uint64_t rotl(std::uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline std::uint64_t read64(const unsigned char* p)
+{
+  std::uint64_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline std::uint64_t round64(std::uint64_t acc, std::uint64_t input)
+{
+  return rotl(acc + input * PRIME2, 31) * PRIME1;
+}
+
+std::uint64_t hashBytes(const void* data, std::size_t size, std::uint64_t seed)
+{
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  const unsigned char* end = p + size;
+  std::uint64_t h;
+  if(size >= 32)
+  {
+    // Four independent lanes keep the multipliers busy.
+    std::uint64_t lanes[4] = { seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1 };
+    for(; p + 32 <= end; p += 32)
+    {
+      for(int k = 0; k < 4; ++k)
+        lanes[k] = round64(lanes[k], read64(p + 8 * k));
+    }
+    h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    for(int k = 0; k < 4; ++k)
+      h = (h ^ round64(0, lanes[k])) * PRIME1 + PRIME4;
+  }
+  else
+    h = seed + PRIME5;
+  h += (std::uint64_t) size;
+
+  for(; p + 8 <= end; p += 8)
+    h = rotl(h ^ round64(0, read64(p)), 27) * PRIME1 + PRIME4;
+  for(; p < end; ++p)
+    h = rotl(h ^ (*p * PRIME5), 11) * PRIME1;
+
+  h ^= h >> 33;
+  h *= PRIME2;
+  h ^= h >> 29;
+  h *= PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+static std::string hex(std::uint64_t value)
+{
+  char text[17];
+  std::snprintf(text, sizeof(text), "%016llx", (unsigned long long) value);
+  return text;
+}
+
+std::string hashFileContents(const std::string& filename)
+{
+  TRACE_SCOPE("hashFileContents");
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0)
+    return std::string();
+  struct stat info;
+  if(fstat(fd, &info) != 0)
+  {
+    close(fd);
+    return std::string();
+  }
+  const std::size_t size = (std::size_t) info.st_size;
+  if(size == 0)
+  {
+    close(fd);
+    return hex(hashBytes(NULL, 0));
+  }
+  void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(mapped == MAP_FAILED)
+    return std::string();
+  madvise(mapped, size, MADV_SEQUENTIAL);
+  const unsigned char* data = static_cast<const unsigned char*>(mapped);
+
+  // Block hashes in file order, hashed once more.
+  const std::size_t blocks = (size + HASH_BLOCK - 1) / HASH_BLOCK;
+  std::vector<std::uint64_t> hashes(blocks);
+  parallelFor(0, blocks, 1, [&](std::size_t first, std::size_t last)
+  {
+    for(std::size_t b = first; b < last; ++b)
+    {
+      const std::size_t begin = b * HASH_BLOCK;
+      hashes[b] = hashBytes(data + begin, std::min(HASH_BLOCK, size - begin), b);
+    }
+  });
+  munmap(mapped, size);
+  return hex(hashBytes(hashes.data(), hashes.size() * sizeof(std::uint64_t), size));
+}
+
+ResultCache::ResultCache(const std::string& directory) : directory_(directory)
+{
+  if(directory_.empty())
+    return;
+  boost::system::error_code error;
+  boost::filesystem::create_directories(directory_, error);
+  if(!boost::filesystem::is_directory(directory_))
+  {
+    pcl::console::print_warn("Cache directory %s is not usable, caching disabled\n", directory_.c_str());
+    directory_.clear();
+  }
+}
+
+std::string ResultCache::key(const std::string& parent, const std::string& stage, const std::string& params)
+{
+  const std::string text = parent + '\n' + stage + '\n' + params + '\n' + MESHPCL_CACHE_VERSION;
+  return stage + "-" + hex(hashBytes(text.data(), text.size()));
+}
+
+std::string ResultCache::path(const std::string& key, const char* extension) const
+{
+  return (boost::filesystem::path(directory_) / (key + extension)).string();
+}
+
+bool ResultCache::readOffset(const std::string& key, Eigen::Vector3d& offset) const
+{
+  FILE* file = std::fopen(path(key, ".offset").c_str(), "r");
+  if(!file)
+    return false;
+  const bool ok = std::fscanf(file, "%lf %lf %lf", &offset[0], &offset[1], &offset[2]) == 3;
+  std::fclose(file);
+  return ok;
+}
+
+void ResultCache::commit(const std::string& key, const std::string& temporary, const char* extension,
+  const Eigen::Vector3d& offset) const
+{
+  boost::system::error_code error;
+  boost::filesystem::rename(temporary, path(key, extension), error);
+  if(error)
+  {
+    boost::filesystem::remove(temporary, error);
+    return;
+  }
+  const std::string offset_temporary = path(key, ".offset.tmp") + hex((std::uint64_t) getpid());
+  FILE* file = std::fopen(offset_temporary.c_str(), "w");
+  if(!file)
+    return;
+  const bool ok = std::fprintf(file, "%.17g %.17g %.17g\n", offset[0], offset[1], offset[2]) > 0;
+  if(std::fclose(file) == 0 && ok)
+    boost::filesystem::rename(offset_temporary, path(key, ".offset"), error);
+  else
+    boost::filesystem::remove(offset_temporary, error);
+}
+
+template <typename PointT>
+bool ResultCache::loadCloud(const std::string& key, pcl::PointCloud<PointT>& cloud, Eigen::Vector3d& offset) const
+{
+  if(!enabled() || !readOffset(key, offset))
+    return false;
+  TRACE_SCOPE("ResultCache::loadCloud");
+  if(pcl::io::loadPCDFile(path(key, ".pcd"), cloud) < 0)
+    return false;
+  pcl::console::print_info("Cache hit: %s\n", key.c_str());
+  return true;
+}
+
+template <typename PointT>
+void ResultCache::storeCloud(const std::string& key, const pcl::PointCloud<PointT>& cloud, const Eigen::Vector3d& offset) const
+{
+  if(!enabled())
+    return;
+  TRACE_SCOPE_VAR(span, "ResultCache::storeCloud", cloud.size());
+  const std::string temporary = path(key, ".pcd.tmp") + hex((std::uint64_t) getpid());
+  if(pcl::io::savePCDFileBinary(temporary, cloud) < 0)
+    return;
+  commit(key, temporary, ".pcd", offset);
+}
+
+bool ResultCache::loadMesh(const std::string& key, pcl::PolygonMesh& mesh, Eigen::Vector3d& offset) const
+{
+  if(!enabled() || !readOffset(key, offset))
+    return false;
+  TRACE_SCOPE("ResultCache::loadMesh");
+  if(pcl::io::loadPLYFile(path(key, ".ply"), mesh) < 0)
+    return false;
+  pcl::console::print_info("Cache hit: %s\n", key.c_str());
+  return true;
+}
+
+void ResultCache::storeMesh(const std::string& key, const pcl::PolygonMesh& mesh, const Eigen::Vector3d& offset) const
+{
+  if(!enabled())
+    return;
+  TRACE_SCOPE_VAR(span, "ResultCache::storeMesh", mesh.polygons.size());
+  const std::string temporary = path(key, ".ply.tmp") + hex((std::uint64_t) getpid());
+  if(pcl::io::savePLYFileBinary(temporary, mesh) < 0)
+    return;
+  commit(key, temporary, ".ply", offset);
+}
+
+template bool ResultCache::loadCloud<pcl::PointXYZ>(const std::string&, pcl::PointCloud<pcl::PointXYZ>&, Eigen::Vector3d&) const;
+template bool ResultCache::loadCloud<pcl::PointXYZRGB>(const std::string&, pcl::PointCloud<pcl::PointXYZRGB>&, Eigen::Vector3d&) const;
+template bool ResultCache::loadCloud<pcl::PointNormal>(const std::string&, pcl::PointCloud<pcl::PointNormal>&, Eigen::Vector3d&) const;
+template void ResultCache::storeCloud<pcl::PointXYZ>(const std::string&, const pcl::PointCloud<pcl::PointXYZ>&, const Eigen::Vector3d&) const;
+template void ResultCache::storeCloud<pcl::PointXYZRGB>(const std::string&, const pcl::PointCloud<pcl::PointXYZRGB>&, const Eigen::Vector3d&) const;
+template void ResultCache::storeCloud<pcl::PointNormal>(const std::string&, const pcl::PointCloud<pcl::PointNormal>&, const Eigen::Vector3d&) const;
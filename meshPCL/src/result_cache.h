@@ -0,0 +1,68 @@
+/*********************************
+       ON-DISK RESULT CACHE
+**********************************/
+// Content-addressed store for stage outputs across runs. A stage key is a
+// hash of its parent key, the stage name, the stage parameters and
+// MESHPCL_CACHE_VERSION; the root of the chain is a hash of the input
+// file's bytes. Identical input and options therefore map to the same
+// files, whatever the file is called or when it was written.
+//
+// Every entry is <key>.pcd or <key>.ply plus <key>.offset holding the
+// local frame origin. Both are written to a temporary name and renamed,
+// the offset last, so an entry without its .offset is incomplete and
+// ignored; concurrent runs at worst compute the same entry twice.
+
+#ifndef MESHPCL_RESULT_CACHE_H
+#define MESHPCL_RESULT_CACHE_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PolygonMesh.h>
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Bump when a cached stage changes its output for the same parameters.
+#define MESHPCL_CACHE_VERSION "1"
+
+// XXH64-style hash of a byte range.
+std::uint64_t hashBytes(const void* data, std::size_t size, std::uint64_t seed = 0);
+
+// Hash of a file's contents as 16 hex digits, hashed in parallel over
+// fixed-size blocks so the value does not depend on the thread count.
+// Empty if the file cannot be read.
+std::string hashFileContents(const std::string& filename);
+
+class ResultCache
+{
+public:
+  // An empty directory disables the cache; it is created when missing.
+  explicit ResultCache(const std::string& directory);
+
+  bool enabled() const { return !directory_.empty(); }
+
+  // Key of a stage computed from 'parent' with the given parameter text.
+  static std::string key(const std::string& parent, const std::string& stage, const std::string& params);
+
+  // False on a miss; instantiated for the types in point_fields.h.
+  template <typename PointT>
+  bool loadCloud(const std::string& key, pcl::PointCloud<PointT>& cloud, Eigen::Vector3d& offset) const;
+  template <typename PointT>
+  void storeCloud(const std::string& key, const pcl::PointCloud<PointT>& cloud, const Eigen::Vector3d& offset) const;
+
+  bool loadMesh(const std::string& key, pcl::PolygonMesh& mesh, Eigen::Vector3d& offset) const;
+  void storeMesh(const std::string& key, const pcl::PolygonMesh& mesh, const Eigen::Vector3d& offset) const;
+
+private:
+  std::string path(const std::string& key, const char* extension) const;
+  bool readOffset(const std::string& key, Eigen::Vector3d& offset) const;
+  void commit(const std::string& key, const std::string& temporary, const char* extension,
+    const Eigen::Vector3d& offset) const;
+
+  std::string directory_;
+};
+
+#endif // MESHPCL_RESULT_CACHE_H
@@ -0,0 +1,77 @@
+/*********************************
+        REGION OF INTEREST
+**********************************/
+// Box, sphere, Z range and XY polygon hull around a site, in the
+// coordinates of the input file. The loaders test every point against it
+// while parsing, so points outside are never stored, indexed or meshed.
+// All active constraints must hold; an ROI with none keeps every point.
+// Non-finite points are never inside an active ROI.
+
+#ifndef MESHPCL_ROI_H
+#define MESHPCL_ROI_H
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+struct CloudRoi
+{
+  bool has_box;
+  Eigen::Vector3d box_min;
+  Eigen::Vector3d box_max;
+  bool has_sphere;
+  Eigen::Vector3d center;
+  double radius;
+  bool has_z;
+  double z_min;
+  double z_max;
+  // Closed polygon in XY, any orientation; fewer than 3 vertices disables it.
+  std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > hull;
+
+  CloudRoi() : has_box(false), box_min(Eigen::Vector3d::Zero()), box_max(Eigen::Vector3d::Zero()),
+    has_sphere(false), center(Eigen::Vector3d::Zero()), radius(0.0), has_z(false), z_min(0.0), z_max(0.0) {}
+
+  bool active() const
+  {
+    return has_box || has_sphere || has_z || hull.size() >= 3;
+  }
+
+  bool contains(const double xyz[3]) const
+  {
+    if(!std::isfinite(xyz[0]) || !std::isfinite(xyz[1]) || !std::isfinite(xyz[2]))
+      return false;
+    if(has_z && (xyz[2] < z_min || xyz[2] > z_max))
+      return false;
+    if(has_box && (xyz[0] < box_min[0] || xyz[0] > box_max[0] || xyz[1] < box_min[1] || xyz[1] > box_max[1]
+      || xyz[2] < box_min[2] || xyz[2] > box_max[2]))
+      return false;
+    if(has_sphere)
+    {
+      const double dx = xyz[0] - center[0], dy = xyz[1] - center[1], dz = xyz[2] - center[2];
+      if(dx * dx + dy * dy + dz * dz > radius * radius)
+        return false;
+    }
+    if(hull.size() >= 3 && !insideHull(xyz[0], xyz[1]))
+      return false;
+    return true;
+  }
+
+  // Even-odd crossing test against the XY polygon.
+  bool insideHull(double x, double y) const
+  {
+    bool inside = false;
+    for(std::size_t i = 0, j = hull.size() - 1; i < hull.size(); j = i++)
+    {
+      const Eigen::Vector2d& a = hull[i];
+      const Eigen::Vector2d& b = hull[j];
+      if((a[1] > y) != (b[1] > y) && x < (b[0] - a[0]) * (y - a[1]) / (b[1] - a[1]) + a[0])
+        inside = !inside;
+    }
+    return inside;
+  }
+};
+
+#endif // MESHPCL_ROI_H
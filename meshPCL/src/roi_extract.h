@@ -0,0 +1,206 @@
+/*********************************
+      REGION OF INTEREST EXTRACTION
+**********************************/
+// Crops clouds that are already in memory. Selection and copy are split:
+// the selection produces index lists, and gatherPoints copies them into a
+// presized cloud in parallel, so several crops of one cloud cost one
+// selection and one copy each, never a push_back per point.
+//
+// roiIndices scans the cloud once per CloudRoi, tile by tile, and writes
+// the hits in input order. sphereIndices crops many sites at once: with a
+// search index built on the cloud it runs one radius query per site in
+// parallel; without one it bins the sites into a grid of 'radius' cells
+// and answers all of them in a single parallel pass over the points.
+
+#ifndef MESHPCL_ROI_EXTRACT_H
+#define MESHPCL_ROI_EXTRACT_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/search/search.h>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "parallel.h"
+#include "roi.h"
+
+// Points per task of the extraction scans.
+static const std::size_t ROI_TILE = 65536;
+
+typedef std::vector<Eigen::Vector3f, Eigen::aligned_allocator<Eigen::Vector3f> > RoiCenters;
+
+// Indices of the points inside 'roi', ascending. The ROI is tested on
+// point + offset in double, so it can be given in georeferenced
+// coordinates for a cloud stored in a local frame.
+template <typename PointT>
+void roiIndices(const pcl::PointCloud<PointT>& cloud, const CloudRoi& roi, std::vector<int>& indices,
+  const Eigen::Vector3d& offset = Eigen::Vector3d::Zero())
+{
+  const std::size_t n = cloud.points.size();
+  const std::size_t tiles = (n + ROI_TILE - 1) / ROI_TILE;
+  std::vector<unsigned char> inside(n);
+  std::vector<std::size_t> first(tiles + 1, 0);
+  parallelFor(0, n, ROI_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    std::size_t count = 0;
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      const PointT& p = cloud.points[i];
+      const double xyz[3] = { p.x + offset[0], p.y + offset[1], p.z + offset[2] };
+      inside[i] = roi.contains(xyz);
+      count += inside[i];
+    }
+    first[begin / ROI_TILE + 1] = count;
+  });
+  for(std::size_t t = 0; t < tiles; ++t)
+    first[t + 1] += first[t];
+
+  indices.resize(first[tiles]);
+  parallelFor(0, n, ROI_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    std::size_t out = first[begin / ROI_TILE];
+    for(std::size_t i = begin; i < end; ++i)
+    {
+      if(inside[i])
+        indices[out++] = (int) i;
+    }
+  });
+}
+
+// Indices of the points within 'radius' of each center, ascending, one
+// list per center. 'index' is used when it was built on 'cloud'.
+template <typename PointT>
+void sphereIndices(const pcl::PointCloud<PointT>& cloud, const RoiCenters& centers, float radius,
+  std::vector<std::vector<int> >& indices,
+  const typename pcl::search::Search<PointT>::Ptr& index = typename pcl::search::Search<PointT>::Ptr())
+{
+  indices.assign(centers.size(), std::vector<int>());
+  if(centers.empty() || cloud.points.empty() || !(radius > 0.0f))
+    return;
+
+  if(index && index->getInputCloud().get() == &cloud)
+  {
+    parallelFor(0, centers.size(), 1, [&](std::size_t begin, std::size_t end)
+    {
+      std::vector<float> sqr_distances;
+      for(std::size_t c = begin; c < end; ++c)
+      {
+        PointT query;
+        query.x = centers[c][0];
+        query.y = centers[c][1];
+        query.z = centers[c][2];
+        index->radiusSearch(query, radius, indices[c], sqr_distances);
+        std::sort(indices[c].begin(), indices[c].end());
+      }
+    });
+    return;
+  }
+
+  // Centers binned into cells of edge 'radius': a point can only be within
+  // reach of the centers in its own and the 26 neighbouring cells.
+  const float inverse = 1.0f / radius;
+  const float sqr_radius = radius * radius;
+  auto cellKey = [](std::int64_t x, std::int64_t y, std::int64_t z)
+  {
+    const std::uint64_t mask = (std::uint64_t(1) << 21) - 1;
+    return ((std::uint64_t) x & mask) | (((std::uint64_t) y & mask) << 21) | (((std::uint64_t) z & mask) << 42);
+  };
+  std::unordered_map<std::uint64_t, std::vector<int> > grid;
+  for(std::size_t c = 0; c < centers.size(); ++c)
+  {
+    grid[cellKey((std::int64_t) std::floor(centers[c][0] * inverse), (std::int64_t) std::floor(centers[c][1] * inverse),
+      (std::int64_t) std::floor(centers[c][2] * inverse))].push_back((int) c);
+  }
+
+  // Calls hit(center) for every center within reach of point i.
+  auto visit = [&](std::size_t i, auto hit)
+  {
+    const PointT& p = cloud.points[i];
+    if(!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+      return;
+    const std::int64_t x = (std::int64_t) std::floor(p.x * inverse);
+    const std::int64_t y = (std::int64_t) std::floor(p.y * inverse);
+    const std::int64_t z = (std::int64_t) std::floor(p.z * inverse);
+    for(std::int64_t dz = -1; dz <= 1; ++dz)
+    for(std::int64_t dy = -1; dy <= 1; ++dy)
+    for(std::int64_t dx = -1; dx <= 1; ++dx)
+    {
+      auto cell = grid.find(cellKey(x + dx, y + dy, z + dz));
+      if(cell == grid.end())
+        continue;
+      for(std::size_t k = 0; k < cell->second.size(); ++k)
+      {
+        const int c = cell->second[k];
+        if((p.getVector3fMap() - centers[c]).squaredNorm() <= sqr_radius)
+          hit(c);
+      }
+    }
+  };
+
+  // Hits per tile and center, then each tile writes at its own offsets, so
+  // every list comes out in input order.
+  const std::size_t n = cloud.points.size();
+  const std::size_t tiles = (n + ROI_TILE - 1) / ROI_TILE;
+  const std::size_t sites = centers.size();
+  std::vector<std::size_t> first(tiles * sites, 0);
+  parallelFor(0, n, ROI_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    std::size_t* counts = &first[(begin / ROI_TILE) * sites];
+    for(std::size_t i = begin; i < end; ++i)
+      visit(i, [&](int c) { ++counts[c]; });
+  });
+  for(std::size_t c = 0; c < sites; ++c)
+  {
+    std::size_t total = 0;
+    for(std::size_t t = 0; t < tiles; ++t)
+    {
+      const std::size_t count = first[t * sites + c];
+      first[t * sites + c] = total;
+      total += count;
+    }
+    indices[c].resize(total);
+  }
+  parallelFor(0, n, ROI_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    std::size_t* out = &first[(begin / ROI_TILE) * sites];
+    for(std::size_t i = begin; i < end; ++i)
+      visit(i, [&](int c) { indices[c][out[c]++] = (int) i; });
+  });
+}
+
+// Copies cloud.points[indices[i]] to out.points[i]; 'out' must not be 'cloud'.
+template <typename PointT>
+void gatherPoints(const pcl::PointCloud<PointT>& cloud, const std::vector<int>& indices,
+  pcl::PointCloud<PointT>& out)
+{
+  out.points.resize(indices.size());
+  parallelFor(0, indices.size(), ROI_TILE, [&](std::size_t begin, std::size_t end)
+  {
+    for(std::size_t i = begin; i < end; ++i)
+      out.points[i] = cloud.points[indices[i]];
+  });
+  out.header = cloud.header;
+  out.width = (std::uint32_t) out.points.size();
+  out.height = 1;
+  out.is_dense = cloud.is_dense;
+}
+
+// roiIndices followed by gatherPoints.
+template <typename PointT>
+void extractRoi(const pcl::PointCloud<PointT>& cloud, const CloudRoi& roi, pcl::PointCloud<PointT>& out,
+  const Eigen::Vector3d& offset = Eigen::Vector3d::Zero())
+{
+  std::vector<int> indices;
+  roiIndices(cloud, roi, indices, offset);
+  gatherPoints(cloud, indices, out);
+}
+
+#endif // MESHPCL_ROI_EXTRACT_H
@@ -0,0 +1,79 @@
+/*********************************
+      MEMOIZED STAGE RESULTS
+**********************************/
+// Thread-safe memo for stage outputs shared between jobs. The first caller
+// for a key computes the value; concurrent callers for the same key block
+// on that computation instead of repeating it.
+
+#ifndef MESHPCL_STAGE_MEMO_H
+#define MESHPCL_STAGE_MEMO_H
+
+#include <cstddef>
+#include <future>
+#include <map>
+#include <mutex>
+
+template <typename Key, typename Value>
+class StageMemo
+{
+public:
+  StageMemo() : hits_(0), misses_(0) {}
+
+  // Returns the value for key, calling compute() at most once per key.
+  // 'computed' is set when this call did the work.
+  template <typename Compute>
+  Value get(const Key& key, Compute compute, bool* computed = NULL)
+  {
+    std::promise<Value> promise;
+    std::shared_future<Value> future;
+    bool owner = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      typename std::map<Key, std::shared_future<Value> >::iterator it = values_.find(key);
+      if(it == values_.end())
+      {
+        future = promise.get_future().share();
+        values_.insert(std::make_pair(key, future));
+        owner = true;
+        ++misses_;
+      }
+      else
+      {
+        future = it->second;
+        ++hits_;
+      }
+    }
+
+    if(owner)
+    {
+      try
+      {
+        promise.set_value(compute());
+      }
+      catch(...)
+      {
+        promise.set_exception(std::current_exception());
+      }
+    }
+    if(computed)
+      *computed = owner;
+    return future.get();
+  }
+
+  void erase(const Key& key)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    values_.erase(key);
+  }
+
+  std::size_t hits() const { std::lock_guard<std::mutex> lock(mutex_); return hits_; }
+  std::size_t misses() const { std::lock_guard<std::mutex> lock(mutex_); return misses_; }
+
+private:
+  mutable std::mutex mutex_;
+  std::map<Key, std::shared_future<Value> > values_;
+  std::size_t hits_;
+  std::size_t misses_;
+};
+
+#endif // MESHPCL_STAGE_MEMO_H
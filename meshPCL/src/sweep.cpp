@@ -0,0 +1,282 @@
+#include "sweep.h"
+
+#include <pcl/common/io.h>
+#include <pcl/console/print.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+#include "memory_report.h"
+#include "mesh_metrics.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "stage_memo.h"
+#include "trace.h"
+
+typedef pcl::PointCloud<pcl::PointXYZ> CloudXYZ;
+typedef pcl::PointCloud<pcl::PointNormal> CloudNormal;
+
+struct SweepJob
+{
+  std::size_t leaf;   // index into SweepOptions::leaf_sizes
+  float leaf_size;
+  MeshParams params;
+};
+
+struct SweepResult
+{
+  std::size_t points;
+  double prep_ms;      // downsample + centre, 0 when served from the memo
+  double normals_ms;   // 0 when served from the memo
+  double mesh_ms;
+  std::size_t triangles;
+  MeshMetrics metrics;   // against the full input cloud
+};
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Bytes a single combination allocates on top of the shared inputs.
+static std::uint64_t estimateJobBytes(const SweepJob& job, std::size_t points)
+{
+  if(job.params.surface_mode == 1)
+    return (std::uint64_t) points * 200 + (std::uint64_t(1) << (2 * job.params.poisson_depth)) * 256;
+  return (std::uint64_t) points * 350;
+}
+
+static void printTable(std::ostream& os, const std::vector<SweepJob>& jobs, const std::vector<SweepResult>& results)
+{
+  std::ios::fmtflags flags = os.flags();
+  os << std::setw(8) << "leaf" << std::setw(9) << "method" << std::setw(5) << "k"
+     << std::setw(7) << "depth" << std::setw(8) << "radius" << std::setw(11) << "points"
+     << std::setw(11) << "prep ms" << std::setw(12) << "normals ms" << std::setw(11) << "mesh ms"
+     << std::setw(11) << "triangles" << std::setw(12) << "rms" << std::setw(12) << "hausdorff" << "\n";
+  os << std::string(117, '-') << "\n";
+  for(size_t i = 0; i < jobs.size(); ++i)
+  {
+    const SweepJob& j = jobs[i];
+    const SweepResult& r = results[i];
+    bool poisson = j.params.surface_mode == 1;
+    os << std::fixed << std::setprecision(3) << std::setw(8) << j.leaf_size
+       << std::setw(9) << (poisson ? "poisson" : "gp3") << std::setw(5) << j.params.normal_k;
+    if(poisson)
+      os << std::setw(7) << j.params.poisson_depth << std::setw(8) << "-";
+    else
+      os << std::setw(7) << "-" << std::setw(8) << std::setprecision(2) << j.params.gp3_radius;
+    os << std::setw(11) << r.points << std::setprecision(1)
+       << std::setw(11) << r.prep_ms << std::setw(12) << r.normals_ms << std::setw(11) << r.mesh_ms
+       << std::setw(11) << r.triangles << std::setprecision(4) << std::setw(12) << r.metrics.rms
+       << std::setw(12) << r.metrics.hausdorff << "\n";
+  }
+  os.flags(flags);
+}
+
+static bool writeCsv(const std::string& path, const std::vector<SweepJob>& jobs, const std::vector<SweepResult>& results)
+{
+  std::ofstream out(path.c_str());
+  if(!out.is_open())
+    return false;
+  out << "leaf_size,surface_mode,normal_k,poisson_depth,gp3_radius,points,prep_ms,normals_ms,mesh_ms,triangles,"
+         "cloud_to_mesh_rms,cloud_to_mesh_hausdorff,mesh_to_cloud_rms,mesh_to_cloud_hausdorff,rms,hausdorff\n";
+  for(size_t i = 0; i < jobs.size(); ++i)
+  {
+    const SweepJob& j = jobs[i];
+    const SweepResult& r = results[i];
+    out << j.leaf_size << "," << j.params.surface_mode << "," << j.params.normal_k << ",";
+    if(j.params.surface_mode == 1)
+      out << j.params.poisson_depth << ",,";
+    else
+      out << "," << j.params.gp3_radius << ",";
+    out << r.points << "," << r.prep_ms << "," << r.normals_ms << "," << r.mesh_ms << ","
+        << r.triangles << "," << r.metrics.cloud_to_mesh_rms << "," << r.metrics.cloud_to_mesh_max << ","
+        << r.metrics.mesh_to_cloud_rms << "," << r.metrics.mesh_to_cloud_max << ","
+        << r.metrics.rms << "," << r.metrics.hausdorff << "\n";
+  }
+  return out.good();
+}
+
+int runParameterSweep(pcl::PointCloud<pcl::PointXYZRGB>::Ptr& cloud, const SweepOptions& options)
+{
+  std::vector<SweepJob> jobs;
+  for(size_t l = 0; l < options.leaf_sizes.size(); ++l)
+  {
+    for(size_t m = 0; m < options.surface_modes.size(); ++m)
+    {
+      for(size_t k = 0; k < options.normal_ks.size(); ++k)
+      {
+        SweepJob job;
+        job.leaf = l;
+        job.leaf_size = options.leaf_sizes[l];
+        job.params.surface_mode = options.surface_modes[m];
+        job.params.normal_k = options.normal_ks[k];
+        if(job.params.surface_mode == 1)
+        {
+          for(size_t d = 0; d < options.poisson_depths.size(); ++d)
+          {
+            job.params.poisson_depth = options.poisson_depths[d];
+            jobs.push_back(job);
+          }
+        }
+        else if(job.params.surface_mode == 2)
+        {
+          for(size_t r = 0; r < options.gp3_radii.size(); ++r)
+          {
+            job.params.gp3_radius = options.gp3_radii[r];
+            jobs.push_back(job);
+          }
+        }
+        else
+        {
+          pcl::console::print_error("Error. sweep surface method must be 1 or 2, got %d\n", job.params.surface_mode);
+          return -1;
+        }
+      }
+    }
+  }
+  if(jobs.empty())
+  {
+    pcl::console::print_error("Error. the sweep has no parameter combinations\n");
+    return -1;
+  }
+
+  // PCL's Poisson keeps static allocator state and runs one reconstruction
+  // at a time, so Poisson jobs get a single lane of their own: more threads
+  // would only hold memory while they wait. GP3 jobs share the rest of the
+  // threads as far as the memory left after the Poisson lane allows.
+  std::vector<std::size_t> poisson_jobs, gp3_jobs;
+  std::uint64_t poisson_bytes = 0, gp3_bytes = 0;
+  for(size_t i = 0; i < jobs.size(); ++i)
+  {
+    const std::uint64_t bytes = estimateJobBytes(jobs[i], cloud->size());
+    if(jobs[i].params.surface_mode == 1)
+    {
+      poisson_jobs.push_back(i);
+      poisson_bytes = std::max(poisson_bytes, bytes);
+    }
+    else
+    {
+      gp3_jobs.push_back(i);
+      gp3_bytes = std::max(gp3_bytes, bytes);
+    }
+  }
+  const std::size_t poisson_lanes = poisson_jobs.empty() ? 0 : 1;
+  std::size_t gp3_lanes = 0;
+  if(!gp3_jobs.empty())
+  {
+    gp3_lanes = std::min<std::size_t>(std::max<std::size_t>(1, parallelThreads() - poisson_lanes), gp3_jobs.size());
+    std::uint64_t budget = availableMemoryBytes() / 2;
+    if(budget > 0)
+    {
+      budget = budget > poisson_bytes ? budget - poisson_bytes : 0;
+      gp3_lanes = std::max<std::size_t>(1, std::min<std::size_t>(gp3_lanes, budget / std::max<std::uint64_t>(1, gp3_bytes)));
+    }
+  }
+
+  pcl::console::print_info("Sweeping %d combinations: %d Poisson one at a time, %d GP3 %d at a time\n",
+    (int) jobs.size(), (int) poisson_jobs.size(), (int) gp3_jobs.size(), (int) gp3_lanes);
+
+  struct Prep { CloudXYZ::Ptr cloud; Eigen::Vector3d offset; double ms; };
+  struct Normals { CloudNormal::Ptr cloud; double ms; };
+  StageMemo<float, Prep> prep_memo;
+  StageMemo<std::pair<float, int>, Normals> normals_memo;
+
+  // Jobs still to run per leaf size; the last one to finish drops that
+  // leaf's memo entries, so only leaves in progress hold their clouds.
+  std::vector<std::atomic<std::size_t> > leaf_jobs(options.leaf_sizes.size());
+  for(size_t i = 0; i < jobs.size(); ++i)
+    ++leaf_jobs[jobs[i].leaf];
+
+  std::vector<SweepResult> results(jobs.size());
+  std::atomic<std::size_t> next_poisson(0), next_gp3(0);
+
+  // Runs the jobs of one lane list, taking them in order from 'next'.
+  auto worker = [&](const std::vector<std::size_t>& lane, std::atomic<std::size_t>& next)
+  {
+    for(std::size_t n = next++; n < lane.size(); n = next++)
+    {
+      const std::size_t i = lane[n];
+      const SweepJob& job = jobs[i];
+      SweepResult& result = results[i];
+      TRACE_SCOPE("sweep/job");
+
+      bool computed = false;
+      Prep prep = prep_memo.get(job.leaf_size, [&]()
+      {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr filtered(new pcl::PointCloud<pcl::PointXYZRGB>);
+        Prep p;
+        p.cloud.reset(new CloudXYZ);
+        downSample<pcl::PointXYZRGB>(cloud, filtered, job.leaf_size);
+        pcl::copyPointCloud(*filtered, *p.cloud);
+        p.offset = Eigen::Vector3d::Zero();
+        translateCloud<pcl::PointXYZ>(p.cloud, p.offset);
+        p.ms = elapsedMs(start);
+        return p;
+      }, &computed);
+      result.prep_ms = computed ? prep.ms : 0.0;
+      result.points = prep.cloud->size();
+
+      Normals normals = normals_memo.get(std::make_pair(job.leaf_size, job.params.normal_k), [&]()
+      {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        Normals n;
+        n.cloud.reset(new CloudNormal);
+        calculateNormals<pcl::PointXYZ>(prep.cloud, n.cloud, job.params.normal_k);
+        n.ms = elapsedMs(start);
+        return n;
+      }, &computed);
+      result.normals_ms = computed ? normals.ms : 0.0;
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      pcl::PolygonMesh mesh;
+      createMesh(normals.cloud, job.params, mesh);
+      result.mesh_ms = elapsedMs(start);
+      result.triangles = mesh.polygons.size();
+      // Measured against the full cloud, so coarser leaves pay for what they drop.
+      computeMeshMetrics<pcl::PointXYZRGB>(*cloud, -prep.offset, mesh, result.metrics);
+
+      if(--leaf_jobs[job.leaf] == 0)
+      {
+        prep_memo.erase(job.leaf_size);
+        for(size_t k = 0; k < options.normal_ks.size(); ++k)
+          normals_memo.erase(std::make_pair(job.leaf_size, options.normal_ks[k]));
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  // The calling thread runs the Poisson lane, or a GP3 one when there is none.
+  for(std::size_t t = poisson_lanes ? 0 : 1; t < gp3_lanes; ++t)
+    threads.push_back(std::thread(worker, std::cref(gp3_jobs), std::ref(next_gp3)));
+  if(poisson_lanes)
+    worker(poisson_jobs, next_poisson);
+  else
+    worker(gp3_jobs, next_gp3);
+  for(size_t t = 0; t < threads.size(); ++t)
+    threads[t].join();
+
+  std::cout << std::endl;
+  printTable(std::cout, jobs, results);
+  pcl::console::print_info("Stage memo: %d preprocess and %d normal results reused\n",
+    (int) prep_memo.hits(), (int) normals_memo.hits());
+
+  if(!options.csv_path.empty())
+  {
+    if(writeCsv(options.csv_path, jobs, results))
+      pcl::console::print_info("Sweep table written to %s\n", options.csv_path.c_str());
+    else
+      pcl::console::print_error("Could not write sweep table to %s\n", options.csv_path.c_str());
+  }
+  return 0;
+}
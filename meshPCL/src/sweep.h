@@ -0,0 +1,32 @@
+/*********************************
+        PARAMETER SWEEP
+**********************************/
+// Meshes one loaded cloud with every combination of leaf size, surface
+// method, normal k, Poisson depth and GP3 radius. Downsampled/centred
+// clouds are memoized per leaf size and normals per (leaf size, k) until
+// the last combination of that leaf size finishes, and combinations run
+// concurrently as far as free memory allows.
+
+#ifndef MESHPCL_SWEEP_H
+#define MESHPCL_SWEEP_H
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <string>
+#include <vector>
+
+struct SweepOptions
+{
+  std::vector<float> leaf_sizes;
+  std::vector<int> surface_modes;
+  std::vector<int> normal_ks;
+  std::vector<int> poisson_depths;  // only combined with surface mode 1
+  std::vector<double> gp3_radii;    // only combined with surface mode 2
+  std::string csv_path;             // empty: table on stdout only
+};
+
+// Returns -1 when the options describe no valid combination.
+int runParameterSweep(pcl::PointCloud<pcl::PointXYZRGB>::Ptr& cloud, const SweepOptions& options);
+
+#endif // MESHPCL_SWEEP_H
@@ -0,0 +1,294 @@
+#include "synthetic_cloud.h"
+
+#include <cmath>
+
+static const double TWO_PI = 6.283185307179586;
+
+static const char* const SHAPE_NAMES[SHAPE_COUNT] = {"plane", "sphere", "terrain", "ellipse", "buildings", "cylinders"};
+
+const char* syntheticShapeName(SyntheticShape shape)
+{
+  return shape >= 0 && shape < SHAPE_COUNT ? SHAPE_NAMES[shape] : "unknown";
+}
+
+SyntheticShape syntheticShapeFromName(const std::string& name)
+{
+  for(int i = 0; i < SHAPE_COUNT; ++i)
+  {
+    if(name == SHAPE_NAMES[i])
+      return (SyntheticShape) i;
+  }
+  return SHAPE_COUNT;
+}
+
+float spacingForDensity(float density)
+{
+  return density > 0.0f ? 1.0f / std::sqrt(density) : 0.1f;
+}
+
+// splitmix64: a counter-based generator, so point i never depends on i-1.
+static inline std::uint64_t mix64(std::uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static inline double uniform01(std::uint64_t seed, std::uint64_t index, std::uint64_t stream)
+{
+  return (mix64(seed ^ mix64(index * 8 + stream)) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline double cellUniform(std::uint64_t seed, std::int64_t cx, std::int64_t cy, std::uint64_t stream)
+{
+  std::uint64_t key = mix64((std::uint64_t) cx * 0x9e3779b97f4a7c15ULL ^ (std::uint64_t) cy * 0xc2b2ae3d27d4eb4fULL);
+  return (mix64(seed ^ key ^ (stream * 0x165667b19e3779f9ULL)) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline double gaussian(std::uint64_t seed, std::uint64_t index)
+{
+  double u1 = uniform01(seed, index, 2);
+  double u2 = uniform01(seed, index, 3);
+  if(u1 < 1e-300)
+    u1 = 1e-300;
+  return std::sqrt(-2.0 * std::log(u1)) * std::cos(TWO_PI * u2);
+}
+
+// Red -> green -> blue ramp, as in the pcl_visualizer ellipse example.
+static inline void colorRamp(double t, SyntheticPoint& p)
+{
+  t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+  if(t < 0.5)
+  {
+    p.r = (std::uint8_t)(255 * (1.0 - 2.0 * t));
+    p.g = (std::uint8_t)(255 * 2.0 * t);
+    p.b = 15;
+  }
+  else
+  {
+    p.r = 15;
+    p.g = (std::uint8_t)(255 * (2.0 - 2.0 * t));
+    p.b = (std::uint8_t)(255 * (2.0 * t - 1.0));
+  }
+}
+
+static inline double terrainHeight(double x, double y, double side)
+{
+  const double l1 = side / 6.0, l2 = side / 17.0, l3 = side / 41.0;
+  return side / 20.0 * (std::sin(x / l1) * std::cos(y / l1)
+    + 0.5 * std::sin(x / l2 + 1.3) * std::sin(y / l2)
+    + 0.25 * std::cos(x / l3 - 0.7) * std::sin(y / l3 + 2.1));
+}
+
+// Buildings and cylinders sit one per square cell of a city grid. The
+// share of points on walls uses the expected wall area per cell, so the
+// density is uniform on average rather than per building:
+//   boxes:     E[4 w h]      = 4 * 0.6 c * 0.9 c  = 2.16 c^2
+//   cylinders: E[2 pi r h]   = 2 pi * 0.2 c * 1.25 c ~ 1.571 c^2
+static const double BUILDING_WALL_AREA = 2.16;
+static const double CYLINDER_WALL_AREA = 1.5708;
+
+struct ShapeFrame
+{
+  double side;        // extent of planar shapes
+  double radius;      // sphere radius
+  double ellipse_b;   // ellipse major semi-axis and half height
+  double cell;        // city grid cell for buildings/cylinders
+  double min[3];
+  double max[3];
+};
+
+static ShapeFrame shapeFrame(const SyntheticParams& params)
+{
+  const double n = (double) (params.total_points > 0 ? params.total_points : 1);
+  const double s = params.spacing;
+  ShapeFrame f;
+  // Every shape is sized so its surface area is n * spacing^2.
+  f.side = s * std::sqrt(n);
+  f.radius = s * std::sqrt(n / (2.0 * TWO_PI));
+  // Ellipse with a = b / 2, extruded over 2b: perimeter ~4.844 b.
+  f.ellipse_b = s * std::sqrt(n / (4.844 * 2.0));
+  f.cell = 0.0;
+
+  switch(params.shape)
+  {
+    case SHAPE_SPHERE:
+      for(int k = 0; k < 3; ++k) { f.min[k] = -f.radius; f.max[k] = f.radius; }
+      break;
+    case SHAPE_ELLIPSE:
+      f.min[0] = -0.5 * f.ellipse_b; f.max[0] = 0.5 * f.ellipse_b;
+      f.min[1] = f.min[2] = -f.ellipse_b; f.max[1] = f.max[2] = f.ellipse_b;
+      break;
+    case SHAPE_BUILDINGS:
+    case SHAPE_CYLINDERS:
+    {
+      double walls = params.shape == SHAPE_BUILDINGS ? BUILDING_WALL_AREA : CYLINDER_WALL_AREA;
+      f.side = s * std::sqrt(n / (1.0 + walls));
+      f.cell = f.side / std::max(1.0, std::floor(f.side / 25.0));
+      f.min[0] = f.min[1] = -0.5 * f.side; f.max[0] = f.max[1] = 0.5 * f.side;
+      f.min[2] = 0.0; f.max[2] = 2.0 * f.cell;
+      break;
+    }
+    case SHAPE_TERRAIN:
+      f.min[0] = f.min[1] = -0.5 * f.side; f.max[0] = f.max[1] = 0.5 * f.side;
+      f.min[2] = -f.side / 10.0; f.max[2] = f.side / 10.0;
+      break;
+    case SHAPE_PLANE:
+    default:
+      f.min[0] = f.min[1] = -0.5 * f.side; f.max[0] = f.max[1] = 0.5 * f.side;
+      f.min[2] = -f.side / 100.0; f.max[2] = f.side / 100.0;
+      break;
+  }
+  return f;
+}
+
+// Ground point at (x, y) of a buildings/cylinders scene: roof or cap when it
+// falls inside the cell's footprint.
+static double cityGroundHeight(const SyntheticParams& params, const ShapeFrame& f, double x, double y)
+{
+  std::int64_t cx = (std::int64_t) std::floor((x - f.min[0]) / f.cell);
+  std::int64_t cy = (std::int64_t) std::floor((y - f.min[1]) / f.cell);
+  double ox = f.min[0] + (cx + 0.5) * f.cell;
+  double oy = f.min[1] + (cy + 0.5) * f.cell;
+  if(params.shape == SHAPE_BUILDINGS)
+  {
+    double half = 0.5 * f.cell * (0.4 + 0.4 * cellUniform(params.seed, cx, cy, 0));
+    if(std::fabs(x - ox) < half && std::fabs(y - oy) < half)
+      return f.cell * (0.3 + 1.2 * cellUniform(params.seed, cx, cy, 1));
+  }
+  else
+  {
+    double r = f.cell * (0.1 + 0.2 * cellUniform(params.seed, cx, cy, 0));
+    if((x - ox) * (x - ox) + (y - oy) * (y - oy) < r * r)
+      return f.cell * (0.5 + 1.5 * cellUniform(params.seed, cx, cy, 1));
+  }
+  return 0.0;
+}
+
+// Wall point: picks a cell, then a position on its building's walls.
+static void cityWallPoint(const SyntheticParams& params, const ShapeFrame& f, std::uint64_t i,
+  double e, double& x, double& y, double& z)
+{
+  const std::int64_t cells = (std::int64_t) std::floor(f.side / f.cell + 0.5);
+  std::int64_t c = (std::int64_t) (uniform01(params.seed, i, 4) * cells * cells);
+  std::int64_t cx = c % cells, cy = c / cells;
+  double ox = f.min[0] + (cx + 0.5) * f.cell;
+  double oy = f.min[1] + (cy + 0.5) * f.cell;
+  double a = uniform01(params.seed, i, 0);
+  double h = uniform01(params.seed, i, 1);
+
+  if(params.shape == SHAPE_BUILDINGS)
+  {
+    double half = 0.5 * f.cell * (0.4 + 0.4 * cellUniform(params.seed, cx, cy, 0));
+    double height = f.cell * (0.3 + 1.2 * cellUniform(params.seed, cx, cy, 1));
+    int wall = (int) (a * 4.0);
+    double t = (a * 4.0 - wall) * 2.0 - 1.0;
+    double d = half + e;
+    switch(wall)
+    {
+      case 0: x = ox + t * half; y = oy - d; break;
+      case 1: x = ox + d; y = oy + t * half; break;
+      case 2: x = ox - t * half; y = oy + d; break;
+      default: x = ox - d; y = oy - t * half; break;
+    }
+    z = h * height;
+  }
+  else
+  {
+    double r = f.cell * (0.1 + 0.2 * cellUniform(params.seed, cx, cy, 0)) + e;
+    double height = f.cell * (0.5 + 1.5 * cellUniform(params.seed, cx, cy, 1));
+    x = ox + r * std::cos(TWO_PI * a);
+    y = oy + r * std::sin(TWO_PI * a);
+    z = h * height;
+  }
+}
+
+void generateSyntheticPoints(const SyntheticParams& params, std::uint64_t first,
+  std::uint64_t count, SyntheticPoint* out)
+{
+  const ShapeFrame f = shapeFrame(params);
+  const double wall_share = params.shape == SHAPE_BUILDINGS ? BUILDING_WALL_AREA / (1.0 + BUILDING_WALL_AREA)
+    : CYLINDER_WALL_AREA / (1.0 + CYLINDER_WALL_AREA);
+
+  for(std::uint64_t k = 0; k < count; ++k)
+  {
+    const std::uint64_t i = first + k;
+    const double u = uniform01(params.seed, i, 0);
+    const double v = uniform01(params.seed, i, 1);
+    const double e = params.noise > 0.0f ? params.noise * gaussian(params.seed, i) : 0.0;
+    double x, y, z;
+
+    if(params.outlier_ratio > 0.0f && uniform01(params.seed, i, 5) < params.outlier_ratio)
+    {
+      x = f.min[0] + u * (f.max[0] - f.min[0]);
+      y = f.min[1] + v * (f.max[1] - f.min[1]);
+      z = f.min[2] + uniform01(params.seed, i, 6) * (f.max[2] - f.min[2]);
+    }
+    else
+    {
+      switch(params.shape)
+      {
+        case SHAPE_SPHERE:
+        {
+          double cz = 2.0 * u - 1.0;
+          double rxy = std::sqrt(1.0 - cz * cz);
+          double phi = TWO_PI * v;
+          double r = f.radius + e;
+          x = r * rxy * std::cos(phi);
+          y = r * rxy * std::sin(phi);
+          z = r * cz;
+          break;
+        }
+        case SHAPE_TERRAIN:
+        {
+          x = (u - 0.5) * f.side;
+          y = (v - 0.5) * f.side;
+          z = terrainHeight(x, y, f.side) + e;
+          break;
+        }
+        case SHAPE_ELLIPSE:
+        {
+          double angle = TWO_PI * u;
+          double b = f.ellipse_b + e;
+          x = 0.5 * b * std::cos(angle);
+          y = b * std::sin(angle);
+          z = (2.0 * v - 1.0) * f.ellipse_b;
+          break;
+        }
+        case SHAPE_BUILDINGS:
+        case SHAPE_CYLINDERS:
+        {
+          if(uniform01(params.seed, i, 7) < wall_share)
+          {
+            cityWallPoint(params, f, i, e, x, y, z);
+          }
+          else
+          {
+            x = (u - 0.5) * f.side;
+            y = (v - 0.5) * f.side;
+            z = cityGroundHeight(params, f, x, y) + e;
+          }
+          break;
+        }
+        case SHAPE_PLANE:
+        default:
+        {
+          x = (u - 0.5) * f.side;
+          y = (v - 0.5) * f.side;
+          z = e;
+          break;
+        }
+      }
+    }
+
+    SyntheticPoint& p = out[k];
+    p.x = (float) x;
+    p.y = (float) y;
+    p.z = (float) z;
+    if(params.colored)
+      colorRamp((z - f.min[2]) / (f.max[2] - f.min[2]), p);
+    else
+      p.r = p.g = p.b = 0;
+  }
+}
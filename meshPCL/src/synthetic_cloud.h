@@ -0,0 +1,106 @@
+/*********************************
+     SYNTHETIC POINT CLOUDS
+**********************************/
+// Deterministic surface samplers for benchmarks and load tests. Point i of
+// a cloud depends only on (params, i), so any range of indices can be
+// generated independently and in parallel, and a billion-point cloud can be
+// streamed chunk by chunk without ever being held in memory.
+
+#ifndef MESHPCL_SYNTHETIC_CLOUD_H
+#define MESHPCL_SYNTHETIC_CLOUD_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "parallel.h"
+
+enum SyntheticShape
+{
+  SHAPE_PLANE = 0,
+  SHAPE_SPHERE,
+  SHAPE_TERRAIN,
+  SHAPE_ELLIPSE,
+  SHAPE_BUILDINGS,  // ground plane with box buildings
+  SHAPE_CYLINDERS,  // ground plane with capped vertical cylinders
+  SHAPE_COUNT
+};
+
+struct SyntheticParams
+{
+  SyntheticShape shape;
+  std::uint64_t total_points;
+  std::uint64_t seed;
+  float spacing;        // mean distance between neighbouring samples
+  float noise;          // gaussian sigma added along the surface normal
+  float outlier_ratio;  // fraction of points scattered uniformly in the bounds
+  bool colored;         // height colour ramp, otherwise r = g = b = 0
+
+  SyntheticParams()
+    : shape(SHAPE_PLANE), total_points(0), seed(1), spacing(0.1f), noise(0.0f),
+      outlier_ratio(0.0f), colored(true) {}
+};
+
+struct SyntheticPoint
+{
+  float x, y, z;
+  std::uint8_t r, g, b;
+};
+
+const char* syntheticShapeName(SyntheticShape shape);
+// Returns SHAPE_COUNT for unknown names.
+SyntheticShape syntheticShapeFromName(const std::string& name);
+
+// Spacing that gives 'density' points per square unit of surface.
+float spacingForDensity(float density);
+
+// Writes points [first, first + count) of the cloud described by params.
+void generateSyntheticPoints(const SyntheticParams& params, std::uint64_t first,
+  std::uint64_t count, SyntheticPoint* out);
+
+namespace synthetic_detail
+{
+  template <typename PointT>
+  auto assignColor(PointT& p, const SyntheticPoint& s, int) -> decltype(p.r, void())
+  {
+    p.r = s.r;
+    p.g = s.g;
+    p.b = s.b;
+  }
+
+  template <typename PointT>
+  void assignColor(PointT&, const SyntheticPoint&, long) {}
+}
+
+// Fills a pcl::PointCloud with the whole synthetic cloud. Works for any
+// point type with x/y/z; colour is copied when the type has r/g/b.
+template <typename CloudT>
+void generateSyntheticCloud(const SyntheticParams& params, CloudT& cloud)
+{
+  const std::size_t chunk = 1024;
+
+  cloud.points.resize(params.total_points);
+  parallelFor(0, params.total_points, 64 * chunk, [&](std::size_t begin, std::size_t end)
+  {
+    SyntheticPoint buffer[chunk];
+    for(std::size_t first = begin; first < end; first += chunk)
+    {
+      std::size_t n = std::min(chunk, end - first);
+      generateSyntheticPoints(params, first, n, buffer);
+      for(std::size_t j = 0; j < n; ++j)
+      {
+        typename CloudT::PointType& p = cloud.points[first + j];
+        p.x = buffer[j].x;
+        p.y = buffer[j].y;
+        p.z = buffer[j].z;
+        synthetic_detail::assignColor(p, buffer[j], 0);
+      }
+    }
+  });
+  cloud.width = (std::uint32_t) cloud.points.size();
+  cloud.height = 1;
+  cloud.is_dense = true;
+}
+
+#endif // MESHPCL_SYNTHETIC_CLOUD_H
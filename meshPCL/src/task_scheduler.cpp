@@ -0,0 +1,162 @@
+#include "task_scheduler.h"
+
+#include "parallel.h"
+
+// Queue owned by the current thread; external threads have none.
+static thread_local std::size_t current_queue = (std::size_t) -1;
+
+TaskScheduler& TaskScheduler::instance()
+{
+  static TaskScheduler scheduler(parallelThreads());
+  return scheduler;
+}
+
+TaskScheduler::TaskScheduler(unsigned int threads)
+  : queued_(0), next_queue_(0), stop_(false)
+{
+  const std::size_t workers = threads > 1 ? threads - 1 : 0;
+  // one queue per worker plus one fed by external threads
+  for(std::size_t i = 0; i <= workers; ++i)
+    queues_.push_back(std::unique_ptr<Queue>(new Queue));
+  for(std::size_t i = 0; i < workers; ++i)
+    workers_.push_back(std::thread(&TaskScheduler::workerLoop, this, i));
+}
+
+TaskScheduler::~TaskScheduler()
+{
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for(std::size_t i = 0; i < workers_.size(); ++i)
+    workers_[i].join();
+}
+
+void TaskScheduler::submit(std::function<void()> task)
+{
+  std::size_t target = current_queue;
+  if(target >= queues_.size())
+    target = workers_.empty() ? 0 : next_queue_++ % queues_.size();
+  ++queued_;
+  {
+    std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+    queues_[target]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+  }
+  wake_.notify_one();
+}
+
+bool TaskScheduler::popOrSteal(std::size_t home, std::function<void()>& task)
+{
+  if(home < queues_.size())
+  {
+    Queue& own = *queues_[home];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if(!own.tasks.empty())
+    {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      --queued_;
+      return true;
+    }
+  }
+  const std::size_t n = queues_.size();
+  const std::size_t start = home < n ? home + 1 : 0;
+  for(std::size_t i = 0; i < n; ++i)
+  {
+    Queue& victim = *queues_[(start + i) % n];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if(!victim.tasks.empty())
+    {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      --queued_;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TaskScheduler::runOne()
+{
+  std::function<void()> task;
+  if(!popOrSteal(current_queue, task))
+    return false;
+  task();
+  return true;
+}
+
+void TaskScheduler::helpUntilDone(const std::atomic<std::size_t>& outstanding)
+{
+  while(outstanding > 0)
+  {
+    if(runOne())
+      continue;
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wake_.wait(lock, [&]() { return outstanding == 0 || queued_ > 0; });
+  }
+}
+
+void TaskScheduler::wakeWaiters()
+{
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+  }
+  wake_.notify_all();
+}
+
+void TaskScheduler::workerLoop(std::size_t index)
+{
+  current_queue = index;
+  for(;;)
+  {
+    if(runOne())
+      continue;
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wake_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+    if(stop_)
+      return;
+  }
+}
+
+void TaskGroup::run(std::function<void()> task)
+{
+  ++outstanding_;
+  // The group may be gone once outstanding_ drops to 0; the scheduler is not.
+  TaskScheduler& scheduler = scheduler_;
+  scheduler_.submit([this, task, &scheduler]()
+  {
+    try
+    {
+      task();
+    }
+    catch(...)
+    {
+      std::lock_guard<std::mutex> lock(error_mutex_);
+      if(!error_)
+        error_ = std::current_exception();
+    }
+    if(--outstanding_ == 0)
+      scheduler.wakeWaiters();
+  });
+}
+
+void TaskGroup::drain()
+{
+  scheduler_.helpUntilDone(outstanding_);
+}
+
+void TaskGroup::wait()
+{
+  drain();
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    std::swap(error, error_);
+  }
+  if(error)
+    std::rethrow_exception(error);
+}
@@ -0,0 +1,92 @@
+/*********************************
+     WORK-STEALING SCHEDULER
+**********************************/
+// One pool of worker threads shared by every parallel stage. Each worker
+// owns a deque: it pops its own newest task and steals the oldest task of
+// another worker when it runs dry. A thread waiting on a TaskGroup runs
+// queued tasks instead of blocking, so nested parallel loops and several
+// concurrent stages share the same cores without oversubscribing them.
+// With nothing left to run it sleeps until a task is queued or its group's
+// last task completes, rather than spinning through a long tail.
+//
+// Tasks must not block on anything but another TaskGroup.
+
+#ifndef MESHPCL_TASK_SCHEDULER_H
+#define MESHPCL_TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskScheduler
+{
+public:
+  // Pool with parallelThreads() - 1 workers; the waiting thread is the last one.
+  static TaskScheduler& instance();
+
+  explicit TaskScheduler(unsigned int threads);
+  ~TaskScheduler();
+
+  unsigned int threads() const { return (unsigned int) workers_.size() + 1; }
+
+  void submit(std::function<void()> task);
+
+  // Runs one queued task on the calling thread. Returns false if none was found.
+  bool runOne();
+
+  // Runs queued tasks until 'outstanding' reaches 0, sleeping while the
+  // queues are empty. Whoever brings it to 0 must call wakeWaiters().
+  void helpUntilDone(const std::atomic<std::size_t>& outstanding);
+  void wakeWaiters();
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<std::function<void()> > tasks;
+  };
+
+  bool popOrSteal(std::size_t home, std::function<void()>& task);
+  void workerLoop(std::size_t index);
+
+  std::vector<std::unique_ptr<Queue> > queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<std::size_t> queued_;
+  std::atomic<std::size_t> next_queue_;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  bool stop_;
+};
+
+// Tasks that are waited for together. The first exception thrown by a task
+// is rethrown from wait().
+class TaskGroup
+{
+public:
+  explicit TaskGroup(TaskScheduler& scheduler = TaskScheduler::instance())
+    : scheduler_(scheduler), outstanding_(0) {}
+  ~TaskGroup() { drain(); }
+
+  void run(std::function<void()> task);
+  void wait();
+
+private:
+  void drain();
+
+  TaskGroup(const TaskGroup&);
+  TaskGroup& operator=(const TaskGroup&);
+
+  TaskScheduler& scheduler_;
+  std::atomic<std::size_t> outstanding_;
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+};
+
+#endif // MESHPCL_TASK_SCHEDULER_H
@@ -0,0 +1,96 @@
+#include "thumbnail.h"
+
+#include <pcl/console/print.h>
+#include <pcl/surface/vtk_smoothing/vtk_utils.h>
+
+#include <vtkActor.h>
+#include <vtkCamera.h>
+#include <vtkPNGWriter.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkProperty.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderer.h>
+#include <vtkRenderingOpenGLConfigure.h>
+#include <vtkSmartPointer.h>
+#include <vtkWindowToImageFilter.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include "trace.h"
+
+// Whether VTK can create a render window here. With OSMesa or EGL it never
+// needs a display; an X-backed build connects to one even offscreen and
+// aborts the process when DISPLAY is unset.
+static bool offscreenAvailable()
+{
+#if defined(VTK_OPENGL_HAS_OSMESA) || defined(VTK_OPENGL_HAS_EGL) || !defined(VTK_USE_X)
+  return true;
+#else
+  const char* display = std::getenv("DISPLAY");
+  return display != NULL && display[0] != '\0';
+#endif
+}
+
+int renderMeshThumbnail(const pcl::PolygonMesh& mesh, const std::string& png_file, int width, int height)
+{
+  TRACE_SCOPE_VAR(span, "renderMeshThumbnail", mesh.polygons.size());
+
+  if(!offscreenAvailable())
+  {
+    pcl::console::print_warn("VTK has no OSMesa/EGL offscreen backend and DISPLAY is not set, skipping thumbnail %s\n",
+      png_file.c_str());
+    return -1;
+  }
+
+  vtkSmartPointer<vtkPolyData> poly_data;
+  if(pcl::VTKUtils::convertToVTK(mesh, poly_data) < 0 || mesh.polygons.empty())
+  {
+    pcl::console::print_error("Error. no mesh to render into %s\n", png_file.c_str());
+    return -1;
+  }
+
+  vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
+  mapper->SetInputData(poly_data);
+
+  vtkSmartPointer<vtkActor> actor = vtkSmartPointer<vtkActor>::New();
+  actor->SetMapper(mapper);
+  // meshes without colour fields are drawn in the viewer's grey
+  actor->GetProperty()->SetColor(0.8, 0.8, 0.8);
+
+  vtkSmartPointer<vtkRenderer> renderer = vtkSmartPointer<vtkRenderer>::New();
+  renderer->AddActor(actor);
+  renderer->SetBackground(1.0, 1.0, 1.0);
+  renderer->ResetCamera();
+  renderer->GetActiveCamera()->Elevation(-35.0);
+  renderer->GetActiveCamera()->Azimuth(30.0);
+  renderer->ResetCameraClippingRange();
+
+  // Never mapped to the screen, so no interactor; X-backed builds still
+  // connect to the display checked above.
+  vtkSmartPointer<vtkRenderWindow> window = vtkSmartPointer<vtkRenderWindow>::New();
+  window->SetOffScreenRendering(1);
+  window->SetSize(width, height);
+  window->AddRenderer(renderer);
+  window->Render();
+
+  vtkSmartPointer<vtkWindowToImageFilter> image = vtkSmartPointer<vtkWindowToImageFilter>::New();
+  image->SetInput(window);
+  image->ReadFrontBufferOff();
+  image->Update();
+
+  std::remove(png_file.c_str());
+  vtkSmartPointer<vtkPNGWriter> writer = vtkSmartPointer<vtkPNGWriter>::New();
+  writer->SetFileName(png_file.c_str());
+  writer->SetInputConnection(image->GetOutputPort());
+  writer->Write();
+
+  if(!std::ifstream(png_file.c_str()).good())
+  {
+    pcl::console::print_error("Error. could not write thumbnail %s\n", png_file.c_str());
+    return -1;
+  }
+  return 0;
+}
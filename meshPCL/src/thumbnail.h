@@ -0,0 +1,22 @@
+/*********************************
+        MESH THUMBNAIL
+**********************************/
+// Renders a mesh to a PNG without opening a window, for headless batch
+// nodes. Uses VTK offscreen rendering, so no X server is needed when VTK is
+// built with OSMesa or EGL. X-backed builds still need a display; without
+// one the thumbnail is skipped with a warning.
+
+#ifndef MESHPCL_THUMBNAIL_H
+#define MESHPCL_THUMBNAIL_H
+
+#include <pcl/PolygonMesh.h>
+
+#include <string>
+
+// Writes a width x height PNG of the mesh seen from above at an angle.
+// Returns -1 if the mesh is empty, no offscreen context can be created or
+// the image could not be written.
+int renderMeshThumbnail(const pcl::PolygonMesh& mesh, const std::string& png_file,
+  int width = 256, int height = 256);
+
+#endif // MESHPCL_THUMBNAIL_H
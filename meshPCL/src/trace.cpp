@@ -0,0 +1,171 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+#include <unistd.h>
+
+static std::uint64_t steadyNanos()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Tracer& Tracer::instance()
+{
+  static Tracer tracer;
+  return tracer;
+}
+
+Tracer::Tracer()
+  : enabled_(false), epoch_ns_(steadyNanos())
+{
+}
+
+std::uint64_t Tracer::now() const
+{
+  return (steadyNanos() - epoch_ns_) / 1000;
+}
+
+Tracer::ThreadBuffer& Tracer::localBuffer()
+{
+  // Buffers are owned by the tracer so spans of finished worker threads
+  // survive until the trace is written.
+  thread_local ThreadBuffer* buffer = nullptr;
+  if(buffer == nullptr)
+  {
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    buffers_.emplace_back(new ThreadBuffer());
+    buffer = buffers_.back().get();
+    buffer->tid = (int) buffers_.size();
+  }
+  return *buffer;
+}
+
+void Tracer::record(const char* name, std::uint64_t begin_us, std::uint64_t end_us, std::int64_t points)
+{
+  ThreadBuffer& buffer = localBuffer();
+  TraceEvent event = {name, begin_us, end_us, points};
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.events.push_back(event);
+}
+
+static void writeJsonString(std::ostream& os, const char* s)
+{
+  os << '"';
+  for(; *s; ++s)
+  {
+    if(*s == '"' || *s == '\\')
+      os << '\\' << *s;
+    else if((unsigned char) *s < 0x20)
+      os << ' ';
+    else
+      os << *s;
+  }
+  os << '"';
+}
+
+bool Tracer::writeChromeTrace(const std::string& path) const
+{
+  std::ofstream out(path.c_str());
+  if(!out.is_open())
+    return false;
+
+  const int pid = (int) getpid();
+  bool first = true;
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+  std::lock_guard<std::mutex> lock(buffers_mutex_);
+  for(size_t b = 0; b < buffers_.size(); ++b)
+  {
+    ThreadBuffer& buffer = *buffers_[b];
+    std::lock_guard<std::mutex> buffer_lock(buffer.mutex);
+
+    out << (first ? "" : ",\n")
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer.tid
+        << ",\"args\":{\"name\":\"thread " << buffer.tid << "\"}}";
+    first = false;
+
+    for(size_t i = 0; i < buffer.events.size(); ++i)
+    {
+      const TraceEvent& e = buffer.events[i];
+      out << ",\n{\"name\":";
+      writeJsonString(out, e.name);
+      out << ",\"cat\":\"meshpcl\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << buffer.tid
+          << ",\"ts\":" << e.begin_us << ",\"dur\":" << (e.end_us - e.begin_us);
+      if(e.points >= 0)
+        out << ",\"args\":{\"points\":" << e.points << "}";
+      out << "}";
+    }
+  }
+  out << "\n]}\n";
+  return out.good();
+}
+
+void Tracer::printSummary(std::ostream& os) const
+{
+  struct Row
+  {
+    std::uint64_t calls = 0;
+    std::uint64_t total_us = 0;
+    std::uint64_t max_us = 0;
+    std::int64_t points = 0;
+    std::uint64_t first_us = ~std::uint64_t(0);
+  };
+  std::map<std::string, Row> rows;
+
+  {
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    for(size_t b = 0; b < buffers_.size(); ++b)
+    {
+      std::lock_guard<std::mutex> buffer_lock(buffers_[b]->mutex);
+      const std::vector<TraceEvent>& events = buffers_[b]->events;
+      for(size_t i = 0; i < events.size(); ++i)
+      {
+        Row& row = rows[events[i].name];
+        std::uint64_t dur = events[i].end_us - events[i].begin_us;
+        row.calls++;
+        row.total_us += dur;
+        row.max_us = std::max(row.max_us, dur);
+        row.first_us = std::min(row.first_us, events[i].begin_us);
+        if(events[i].points > 0)
+          row.points += events[i].points;
+      }
+    }
+  }
+
+  // Order of first appearance reads like the pipeline.
+  std::vector<std::pair<std::string, Row> > ordered(rows.begin(), rows.end());
+  std::sort(ordered.begin(), ordered.end(),
+    [](const std::pair<std::string, Row>& a, const std::pair<std::string, Row>& b)
+    { return a.second.first_us < b.second.first_us; });
+
+  std::ios::fmtflags flags = os.flags();
+  os << std::left << std::setw(32) << "stage" << std::right
+     << std::setw(8) << "calls" << std::setw(14) << "total ms"
+     << std::setw(12) << "mean ms" << std::setw(12) << "max ms"
+     << std::setw(16) << "Mpoints/s" << "\n";
+  os << std::string(94, '-') << "\n";
+  os << std::fixed << std::setprecision(2);
+  for(size_t i = 0; i < ordered.size(); ++i)
+  {
+    const Row& row = ordered[i].second;
+    os << std::left << std::setw(32) << ordered[i].first << std::right
+       << std::setw(8) << row.calls
+       << std::setw(14) << row.total_us / 1000.0
+       << std::setw(12) << row.total_us / 1000.0 / row.calls
+       << std::setw(12) << row.max_us / 1000.0;
+    if(row.points > 0 && row.total_us > 0)
+      os << std::setw(16) << (double) row.points / row.total_us;
+    else
+      os << std::setw(16) << "-";
+    os << "\n";
+  }
+  os.flags(flags);
+}
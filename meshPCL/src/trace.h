@@ -0,0 +1,109 @@
+/*********************************
+     STAGE TRACING
+**********************************/
+// Scoped spans around pipeline stages. Spans are buffered per thread and
+// written out as a Chrome/Perfetto trace (chrome://tracing, ui.perfetto.dev)
+// plus a per-stage summary table.
+//
+// Tracing is off until Tracer::instance().enable() is called; a disabled
+// TRACE_SCOPE costs one relaxed atomic load. Building with
+// -DMESHPCL_TRACE=OFF removes the macros entirely.
+
+#ifndef MESHPCL_TRACE_H
+#define MESHPCL_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TraceEvent
+{
+  const char* name;
+  std::uint64_t begin_us;
+  std::uint64_t end_us;
+  std::int64_t points;  // -1 when the span has no point count
+};
+
+class Tracer
+{
+public:
+  static Tracer& instance();
+
+  void enable(bool on = true) { enabled_.store(on, std::memory_order_relaxed); }
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  // Microseconds since the tracer was created.
+  std::uint64_t now() const;
+
+  // Called by TraceScope; name must outlive the tracer (string literals).
+  void record(const char* name, std::uint64_t begin_us, std::uint64_t end_us, std::int64_t points);
+
+  bool writeChromeTrace(const std::string& path) const;
+  void printSummary(std::ostream& os) const;
+
+private:
+  struct ThreadBuffer
+  {
+    int tid;
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+  };
+
+  Tracer();
+  ThreadBuffer& localBuffer();
+
+  std::atomic<bool> enabled_;
+  std::uint64_t epoch_ns_;
+  mutable std::mutex buffers_mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer> > buffers_;
+};
+
+class TraceScope
+{
+public:
+  explicit TraceScope(const char* name, std::int64_t points = -1)
+    : name_(name), points_(points), active_(Tracer::instance().enabled())
+  {
+    if(active_)
+      begin_ = Tracer::instance().now();
+  }
+
+  ~TraceScope()
+  {
+    if(active_)
+      Tracer::instance().record(name_, begin_, Tracer::instance().now(), points_);
+  }
+
+  // Point counts are often only known once the stage has run.
+  void setPoints(std::int64_t points) { points_ = points; }
+
+private:
+  TraceScope(const TraceScope&);
+  TraceScope& operator=(const TraceScope&);
+
+  const char* name_;
+  std::int64_t points_;
+  std::uint64_t begin_;
+  bool active_;
+};
+
+#define MESHPCL_TRACE_CAT_(a, b) a##b
+#define MESHPCL_TRACE_CAT(a, b) MESHPCL_TRACE_CAT_(a, b)
+
+#ifdef MESHPCL_TRACE
+// Anonymous span for the rest of the enclosing block.
+#define TRACE_SCOPE(name) TraceScope MESHPCL_TRACE_CAT(trace_scope_, __LINE__)(name)
+// Named span, so the body can call var.setPoints(n).
+#define TRACE_SCOPE_VAR(var, name, points) TraceScope var(name, points)
+#define TRACE_SET_POINTS(var, points) var.setPoints(points)
+#else
+#define TRACE_SCOPE(name) do {} while(0)
+#define TRACE_SCOPE_VAR(var, name, points) do {} while(0)
+#define TRACE_SET_POINTS(var, points) do {} while(0)
+#endif
+
+#endif // MESHPCL_TRACE_H